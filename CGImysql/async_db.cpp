@@ -0,0 +1,454 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <mysql/errmsg.h>
+
+#include "async_db.h"
+#include "../timer/clock.h"
+
+static const int RECONNECT_INTERVAL_MS = 1000;  // 重连失败后的重试间隔(毫秒)
+
+AsyncDB::AsyncDB()
+{
+    m_enabled = false;
+    m_epollfd = -1;
+    m_close_log = 0;
+    m_wakeup_fd = -1;
+    m_escape = NULL;
+    m_port = 0;
+}
+
+AsyncDB::~AsyncDB()
+{
+    for (size_t i = 0; i < m_conns.size(); ++i)
+    {
+        if (m_conns[i]->mysql)
+        {
+            mysql_close(m_conns[i]->mysql);
+        }
+        delete m_conns[i];
+    }
+    if (m_escape)
+    {
+        mysql_close(m_escape);
+    }
+    if (m_wakeup_fd >= 0)
+    {
+        close(m_wakeup_fd);
+    }
+}
+
+AsyncDB *AsyncDB::getInstance()
+{
+    static AsyncDB asyncDB;
+    return &asyncDB;
+}
+
+#ifdef MYSQL_WAIT_READ  // MariaDB 客户端的非阻塞 API
+
+bool AsyncDB::init(string url, string user, string password, string databaseName, int port,
+                   int conn_num, int epollfd, int close_log)
+{
+    m_epollfd = epollfd;
+    m_close_log = close_log;
+    m_url = url;
+    m_user = user;
+    m_password = password;
+    m_databaseName = databaseName;
+    m_port = port;
+
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd < 0)
+    {
+        LOG_ERROR("async db: eventfd failed");
+        return false;
+    }
+    m_wakeup.fd = m_wakeup_fd;
+    m_wakeup.state = CONN_WAKEUP;
+
+    for (int i = 0; i < conn_num; ++i)
+    {
+        MYSQL *mysql = mysql_init(NULL);
+        if (mysql == NULL)
+        {
+            LOG_ERROR("async db: mysql_init failed");
+            break;
+        }
+        // 非阻塞模式：mysql_*_start / mysql_*_cont 可用；建立连接在启动时同步完成
+        mysql_options(mysql, MYSQL_OPT_NONBLOCK, 0);
+        if (mysql_real_connect(mysql, url.c_str(), user.c_str(), password.c_str(), databaseName.c_str(), port, NULL, 0) == NULL)
+        {
+            LOG_ERROR("async db: mysql_real_connect failed: %s", mysql_error(mysql));
+            mysql_close(mysql);
+            break;
+        }
+
+        Conn *conn = new Conn;
+        conn->mysql = mysql;
+        conn->fd = -1;
+        conn->state = CONN_IDLE;
+        conn->err = 0;
+        conn->result = NULL;
+        conn->connected = mysql;
+        conn->deadline_ms = 0;
+        m_conns.push_back(conn);
+        m_idle.push_back(conn);
+
+        // 空闲连接的 socket 只关注对端关闭，有查询等待读写时再修改
+        watch(conn, EPOLLRDHUP);
+    }
+    if (m_conns.empty())
+    {
+        return false;
+    }
+
+    // 未连接的句柄使用客户端默认字符集，与各连接相同（连接时不指定字符集）
+    m_escape = mysql_init(NULL);
+    if (m_escape == NULL)
+    {
+        LOG_ERROR("async db: mysql_init failed");
+        return false;
+    }
+
+    epoll_event event;
+    event.data.fd = m_wakeup_fd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakeup_fd, &event);
+    if (m_wakeup_fd >= (int)m_fd_conn.size())
+    {
+        m_fd_conn.resize(m_wakeup_fd + 1, NULL);
+    }
+    m_fd_conn[m_wakeup_fd] = &m_wakeup;
+
+    m_enabled = true;
+    LOG_INFO("async db: %d nonblocking connections", (int)m_conns.size());
+    return true;
+}
+
+void AsyncDB::submit(const char *sql, bool need_result, AsyncQueryCallback cb, void *arg)
+{
+    Query q;
+    q.sql = sql;
+    q.need_result = need_result;
+    q.cb = cb;
+    q.arg = arg;
+
+    m_lock.lock();
+    m_pending.push_back(q);
+    m_lock.unlock();
+
+    // 唤醒主线程，由主线程把查询交给空闲连接
+    uint64_t one = 1;
+    ssize_t ret = write(m_wakeup_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+/* 非阻塞连接上没有预处理语句，只读取连接的字符集转义，不发起通信 */
+char *AsyncDB::escape(char *to, const char *from)
+{
+    mysql_real_escape_string(m_escape, to, from, strlen(from));
+    return to;
+}
+
+/* 主线程：把待执行的查询交给空闲连接 */
+void AsyncDB::dispatch()
+{
+    while (!m_idle.empty())
+    {
+        m_lock.lock();
+        if (m_pending.empty())
+        {
+            m_lock.unlock();
+            return;
+        }
+        Conn *conn = m_idle.back();
+        m_idle.pop_back();
+        conn->query = m_pending.front();
+        m_pending.pop_front();
+        m_lock.unlock();
+
+        start(conn);
+    }
+}
+
+void AsyncDB::start(Conn *conn)
+{
+    conn->state = CONN_QUERY;
+    conn->err = 0;
+    conn->result = NULL;
+    int status = mysql_real_query_start(&conn->err, conn->mysql, conn->query.sql.c_str(), conn->query.sql.size());
+    step(conn, status);
+}
+
+/* 推进状态机：status 非0表示需要等待 socket 事件，为0表示当前步骤完成 */
+void AsyncDB::step(Conn *conn, int status)
+{
+    while (0 == status)
+    {
+        if (CONN_QUERY == conn->state && 0 == conn->err && conn->query.need_result)
+        {
+            conn->state = CONN_STORE;
+            status = mysql_store_result_start(&conn->result, conn->mysql);
+            continue;
+        }
+        if (CONN_STORE == conn->state && conn->result == NULL)
+        {
+            conn->err = mysql_errno(conn->mysql);
+        }
+        complete(conn);
+        return;
+    }
+    wait(conn, status);
+}
+
+/* 按客户端库要求的事件修改 epoll 注册 */
+void AsyncDB::wait(Conn *conn, int status)
+{
+    uint32_t events = 0;
+    if (status & MYSQL_WAIT_READ)
+        events |= EPOLLIN;
+    if (status & MYSQL_WAIT_WRITE)
+        events |= EPOLLOUT;
+    if (status & MYSQL_WAIT_EXCEPT)
+        events |= EPOLLPRI;
+    watch(conn, events);
+
+    conn->deadline_ms = 0;
+    if (status & MYSQL_WAIT_TIMEOUT)
+    {
+        conn->deadline_ms = Clock::getInstance()->mono_ms() + mysql_get_timeout_value_ms(conn->mysql);
+    }
+}
+
+/* 查询完成：回调，释放结果集，连接回到空闲并取下一个查询 */
+void AsyncDB::complete(Conn *conn)
+{
+    unsigned int code = 0;
+    if (conn->err)
+    {
+        code = mysql_errno(conn->mysql);
+        LOG_ERROR("async db: %s: %s", conn->query.sql.c_str(), mysql_error(conn->mysql));
+    }
+    conn->query.cb(conn->query.arg, conn->err, conn->result);
+    if (conn->result)
+    {
+        mysql_free_result(conn->result);
+        conn->result = NULL;
+    }
+
+    // 连接已断开：查询已以错误回调，连接重连成功后再取下一个查询
+    if (CR_SERVER_GONE_ERROR == code || CR_SERVER_LOST == code)
+    {
+        reconnect(conn);
+        return;
+    }
+    watch(conn, EPOLLRDHUP);
+    conn->state = CONN_IDLE;
+    conn->deadline_ms = 0;
+    m_idle.push_back(conn);
+    dispatch();
+}
+
+/* 按连接当前的 socket 修改 epoll 注册：重连后 socket 会更换，旧的先移出再加入新的 */
+void AsyncDB::watch(Conn *conn, uint32_t events)
+{
+    int fd = mysql_get_socket(conn->mysql);
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = events;
+    if (fd == conn->fd)
+    {
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &event);
+        return;
+    }
+
+    if (conn->fd >= 0)
+    {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, conn->fd, NULL);
+        m_fd_conn[conn->fd] = NULL;
+    }
+    conn->fd = fd;
+    if (fd < 0)
+    {
+        return;
+    }
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event);
+    if (fd >= (int)m_fd_conn.size())
+    {
+        m_fd_conn.resize(fd + 1, NULL);
+    }
+    m_fd_conn[fd] = conn;
+}
+
+/* 关闭连接：socket 先移出 epoll 再关闭，关闭后 fd 号可能马上被新的客户连接复用 */
+void AsyncDB::drop(Conn *conn)
+{
+    if (conn->fd >= 0)
+    {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, conn->fd, NULL);
+        m_fd_conn[conn->fd] = NULL;
+        conn->fd = -1;
+    }
+    if (conn->mysql)
+    {
+        mysql_close(conn->mysql);
+        conn->mysql = NULL;
+    }
+}
+
+/* 关闭断开的连接，以 init 的连接参数非阻塞地重新连接 */
+void AsyncDB::reconnect(Conn *conn)
+{
+    drop(conn);
+    conn->state = CONN_CONNECT;
+    conn->deadline_ms = 0;
+    conn->connected = NULL;
+    conn->mysql = mysql_init(NULL);
+    if (conn->mysql == NULL)
+    {
+        connect_step(conn, 0);
+        return;
+    }
+    mysql_options(conn->mysql, MYSQL_OPT_NONBLOCK, 0);
+    int status = mysql_real_connect_start(&conn->connected, conn->mysql, m_url.c_str(), m_user.c_str(), m_password.c_str(),
+                                          m_databaseName.c_str(), m_port, NULL, 0);
+    connect_step(conn, status);
+}
+
+/* 推进重连：成功后连接回到空闲，失败则等待 RECONNECT_INTERVAL_MS 后重试 */
+void AsyncDB::connect_step(Conn *conn, int status)
+{
+    if (status)
+    {
+        wait(conn, status);
+        return;
+    }
+    if (conn->connected == NULL)
+    {
+        LOG_ERROR("async db: reconnect failed: %s", conn->mysql ? mysql_error(conn->mysql) : "mysql_init failed");
+        drop(conn);
+        conn->state = CONN_BROKEN;
+        conn->deadline_ms = Clock::getInstance()->mono_ms() + RECONNECT_INTERVAL_MS;
+        return;
+    }
+
+    LOG_INFO("async db: reconnected");
+    watch(conn, EPOLLRDHUP);
+    conn->state = CONN_IDLE;
+    conn->deadline_ms = 0;
+    m_idle.push_back(conn);
+    dispatch();
+}
+
+void AsyncDB::handle_event(int fd, uint32_t events)
+{
+    Conn *conn = m_fd_conn[fd];
+    if (CONN_WAKEUP == conn->state)
+    {
+        uint64_t n;
+        ssize_t ret = read(m_wakeup_fd, &n, sizeof(n));
+        (void)ret;
+        dispatch();
+        return;
+    }
+    if (CONN_IDLE == conn->state)
+    {
+        // 服务器重启或 wait_timeout 关闭了空闲连接：立即重连，不等下一个查询失败
+        if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+            LOG_WARN("async db: idle connection closed by server, reconnecting");
+            m_idle.erase(find(m_idle.begin(), m_idle.end(), conn));
+            reconnect(conn);
+        }
+        return;
+    }
+
+    int status = 0;
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        status |= MYSQL_WAIT_READ;
+    if (events & EPOLLOUT)
+        status |= MYSQL_WAIT_WRITE;
+    if (events & EPOLLPRI)
+        status |= MYSQL_WAIT_EXCEPT;
+
+    if (CONN_CONNECT == conn->state)
+    {
+        status = mysql_real_connect_cont(&conn->connected, conn->mysql, status);
+        connect_step(conn, status);
+        return;
+    }
+    if (CONN_QUERY == conn->state)
+    {
+        status = mysql_real_query_cont(&conn->err, conn->mysql, status);
+    }
+    else
+    {
+        status = mysql_store_result_cont(&conn->result, conn->mysql, status);
+    }
+    step(conn, status);
+}
+
+void AsyncDB::tick()
+{
+    long long now = Clock::getInstance()->mono_ms();
+    for (size_t i = 0; i < m_conns.size(); ++i)
+    {
+        Conn *conn = m_conns[i];
+        if (conn->state != CONN_IDLE && conn->deadline_ms != 0 && now >= conn->deadline_ms)
+        {
+            if (CONN_BROKEN == conn->state)
+            {
+                reconnect(conn);
+                continue;
+            }
+            if (CONN_CONNECT == conn->state)
+            {
+                connect_step(conn, mysql_real_connect_cont(&conn->connected, conn->mysql, MYSQL_WAIT_TIMEOUT));
+                continue;
+            }
+
+            int status;
+            if (CONN_QUERY == conn->state)
+            {
+                status = mysql_real_query_cont(&conn->err, conn->mysql, MYSQL_WAIT_TIMEOUT);
+            }
+            else
+            {
+                status = mysql_store_result_cont(&conn->result, conn->mysql, MYSQL_WAIT_TIMEOUT);
+            }
+            step(conn, status);
+        }
+    }
+}
+
+#else   // 客户端库没有非阻塞 API，只能使用同步查询
+
+bool AsyncDB::init(string /*url*/, string /*user*/, string /*password*/, string /*databaseName*/, int /*port*/,
+                   int /*conn_num*/, int /*epollfd*/, int close_log)
+{
+    m_close_log = close_log;
+    LOG_WARN("async db: client library has no nonblocking API, using blocking queries");
+    return false;
+}
+
+void AsyncDB::submit(const char * /*sql*/, bool /*need_result*/, AsyncQueryCallback /*cb*/, void * /*arg*/)
+{
+}
+
+char *AsyncDB::escape(char *to, const char *from)
+{
+    strcpy(to, from);
+    return to;
+}
+
+void AsyncDB::handle_event(int /*fd*/, uint32_t /*events*/)
+{
+}
+
+void AsyncDB::tick()
+{
+}
+
+#endif
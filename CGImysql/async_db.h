@@ -0,0 +1,132 @@
+#ifndef ASYNC_DB_H
+#define ASYNC_DB_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <vector>
+#include <string>
+#include <mysql/mysql.h>
+#include "../lock/locker.h"
+#include "../log/log.h"
+
+using namespace std;
+
+/**
+ * 异步数据库（单例模式）：基于 MariaDB 客户端的非阻塞 API（mysql_*_start / mysql_*_cont）
+ * 每条连接的 socket 注册到服务器的 epoll 内核事件表中，由主线程在事件循环里推进查询，
+ * 查询完成后在主线程中回调；工作线程提交查询后立即返回，不再阻塞等待数据库往返
+ * 少量连接即可同时执行大量查询，排不上连接的查询在队列中等待
+ *
+ * 客户端库不支持非阻塞 API（MySQL 官方 libmysqlclient）时 init 返回 false，调用方使用同步查询
+ *
+ * 连接断开（服务器重启、wait_timeout 关闭空闲连接）后非阻塞地重新连接，重连失败则间隔一段时间重试，
+ * 断开时正在执行的查询以错误回调，不重新执行（无法确定服务器是否已经执行过）
+ */
+
+/* 查询完成回调（在主线程中调用）：err 为 mysql_errno，result 只在回调期间有效 */
+typedef void (*AsyncQueryCallback)(void *arg, int err, MYSQL_RES *result);
+
+class AsyncDB
+{
+public:
+    static AsyncDB *getInstance();
+
+    /* 建立 conn_num 条非阻塞连接，socket 注册到 epollfd */
+    bool init(string url, string user, string password, string databaseName, int port,
+              int conn_num, int epollfd, int close_log);
+
+    /* 是否可用 */
+    bool enabled()
+    {
+        return m_enabled;
+    }
+
+    /* 提交查询（任意线程），need_result 为 true 时读取结果集，完成后在主线程调用 cb */
+    void submit(const char *sql, bool need_result, AsyncQueryCallback cb, void *arg);
+
+    /* 按连接字符集转义字符串（to 至少 2*strlen(from)+1 字节），用于拼接非阻塞查询的SQL */
+    char *escape(char *to, const char *from);
+
+    /* 主线程：fd 是否属于异步数据库（连接的 socket 或唤醒用的 eventfd）*/
+    bool owns(int fd)
+    {
+        return fd >= 0 && fd < (int)m_fd_conn.size() && m_fd_conn[fd] != NULL;
+    }
+
+    /* 主线程：处理 fd 上的事件 */
+    void handle_event(int fd, uint32_t events);
+
+    /* 主线程：定时检查等待超时的查询 */
+    void tick();
+
+private:
+    AsyncDB();
+    ~AsyncDB();
+
+    // 一个查询
+    struct Query
+    {
+        string sql;
+        bool need_result;
+        AsyncQueryCallback cb;
+        void *arg;
+    };
+
+    // 一条非阻塞连接的状态机：IDLE -> QUERY -> (STORE) -> IDLE
+    // 连接断开：-> CONNECT -> IDLE，重连失败 -> BROKEN -> (等待重试) -> CONNECT
+    enum CONN_STATE
+    {
+        CONN_IDLE = 0,  // 空闲
+        CONN_QUERY,     // 正在执行 mysql_real_query
+        CONN_STORE,     // 正在读取结果集 mysql_store_result
+        CONN_CONNECT,   // 正在重新连接 mysql_real_connect
+        CONN_BROKEN,    // 重连失败，等待重试
+        CONN_WAKEUP     // 不是数据库连接：提交查询时唤醒主线程的 eventfd
+    };
+
+    struct Conn
+    {
+        MYSQL *mysql;
+        int fd;
+        CONN_STATE state;
+        Query query;
+        int err;
+        MYSQL_RES *result;
+        MYSQL *connected;       // mysql_real_connect 的返回值（重连中）
+        long long deadline_ms;  // 客户端库要求的超时时间，BROKEN 状态下为重试时间（0 表示不需要）
+    };
+
+    void start(Conn *conn);
+    void step(Conn *conn, int status);
+    void wait(Conn *conn, int status);
+    void complete(Conn *conn);
+    void dispatch();
+    void watch(Conn *conn, uint32_t events);
+    void drop(Conn *conn);
+    void reconnect(Conn *conn);
+    void connect_step(Conn *conn, int status);
+
+private:
+    bool m_enabled;
+    int m_epollfd;
+    int m_close_log;
+    int m_wakeup_fd;            // eventfd：工作线程提交查询后唤醒主线程
+    Conn m_wakeup;
+    vector<Conn *> m_conns;     // 所有连接
+    vector<Conn *> m_idle;      // 空闲连接（只在主线程中使用）
+    vector<Conn *> m_fd_conn;   // fd -> 连接
+    MYSQL *m_escape;            // 只用于转义的句柄，不随连接重连而释放（工作线程并发读取）
+
+    string m_url;               // 重连使用的连接参数
+    string m_user;
+    string m_password;
+    string m_databaseName;
+    int m_port;
+
+    MutexLocker m_lock;         // 保护待执行队列
+    list<Query> m_pending;      // 待执行的查询
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "mysql_user_store.h"
+
+MysqlUserStore::MysqlUserStore(ConnectionPool *connPool, int close_log)
+{
+    m_connPool = connPool;
+    m_close_log = close_log;
+}
+
+/* 逐行读取（mysql_use_result 不在客户端缓存整个结果集）user 表，写入用户表 */
+bool MysqlUserStore::load(UserTable *table, uint64_t *position)
+{
+    uint64_t last_id = *position;
+    bool ok = false;
+    for (bool done = false; !done;)
+    {
+        // 先取出1个连接（数据库连接池）
+        MYSQL *mysql = NULL;
+        ConnectionRAII mysqlcon(&mysql, m_connPool);
+        if (mysql == NULL)
+        {
+            // 数据库暂时不可用：稍后重试，期间登录、注册回查数据库
+            LOG_WARN("%s", "load user table: no database connection, retry in 1s");
+            sleep(1);
+            continue;
+        }
+        done = true;
+
+        // user 表有自增 id 列时只读取快照之后的新行，否则读取全表
+        char sql[128];
+        snprintf(sql, sizeof(sql), "SELECT id,username,passwd FROM user WHERE id > %llu ORDER BY id", (unsigned long long)last_id);
+        bool has_id = (0 == mysql_query(mysql, sql));
+        if (!has_id && mysql_query(mysql, "SELECT username,passwd FROM user"))
+        {
+            LOG_ERROR("SELECT Error:%s\n", mysql_error(mysql));
+        }
+        else
+        {
+            MYSQL_RES *result = mysql_use_result(mysql);
+            if (result != NULL)
+            {
+                long long rows = 0;
+                while (MYSQL_ROW row = mysql_fetch_row(result))
+                {
+                    if (has_id)
+                    {
+                        last_id = strtoull(row[0], NULL, 10);
+                        table->insert(row[1] /*username*/, row[2] /*password*/);
+                    }
+                    else
+                    {
+                        table->insert(row[0] /*username*/, row[1] /*password*/);
+                    }
+                    ++rows;
+                }
+                ok = (0 == mysql_errno(mysql));
+                mysql_free_result(result);
+                LOG_INFO("user table loaded: %lld rows from database, %lu users", rows, (unsigned long)table->size());
+            }
+        }
+    }
+    *position = last_id;
+    return ok;
+}
+
+/* 字符串参数绑定 */
+static void bind_string(MYSQL_BIND *bind, const char *str, unsigned long *length)
+{
+    memset(bind, 0, sizeof(*bind));
+    *length = strlen(str);
+    bind->buffer_type = MYSQL_TYPE_STRING;
+    bind->buffer = (void *)str;
+    bind->buffer_length = *length;
+    bind->length = length;
+}
+
+/* 预处理语句按用户名查询 */
+int MysqlUserStore::find(const char *name, char *password, size_t size)
+{
+    MYSQL *mysql = NULL;
+    ConnectionRAII mysqlcon(&mysql, m_connPool);
+    MYSQL_STMT *stmt = mysql ? m_connPool->getStatement(mysql, STMT_SELECT_USER) : NULL;
+    if (stmt == NULL)
+    {
+        return -1;
+    }
+
+    MYSQL_BIND param;
+    unsigned long name_len;
+    bind_string(&param, name, &name_len);
+
+    // 结果绑定到定长缓冲区，超长的列被截断（mysql_stmt_fetch 返回 MYSQL_DATA_TRUNCATED）
+    char row_name[100];
+    unsigned long row_name_len = 0, row_passwd_len = 0;
+    MYSQL_BIND result[2];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = row_name;
+    result[0].buffer_length = sizeof(row_name) - 1;
+    result[0].length = &row_name_len;
+    result[1].buffer_type = MYSQL_TYPE_STRING;
+    result[1].buffer = password;
+    result[1].buffer_length = size - 1;
+    result[1].length = &row_passwd_len;
+
+    if (mysql_stmt_bind_param(stmt, &param) || mysql_stmt_execute(stmt) ||
+        mysql_stmt_bind_result(stmt, result) || mysql_stmt_store_result(stmt))
+    {
+        LOG_ERROR("select user failed: %s", mysql_stmt_error(stmt));
+        m_connPool->resetStatement(mysql, STMT_SELECT_USER);
+        return -1;
+    }
+    bool found = (0 == mysql_stmt_fetch(stmt));
+    mysql_stmt_free_result(stmt);
+    if (found)
+    {
+        password[min(row_passwd_len, (unsigned long)size - 1)] = '\0';
+    }
+    return found ? 1 : 0;
+}
+
+/* 注册：预处理语句插入一个用户，或交给批量提交 */
+int MysqlUserStore::insert(const char *name, const char *password)
+{
+    if (RegisterBatcher::getInstance()->enabled())
+    {
+        return RegisterBatcher::getInstance()->insert(name, password);
+    }
+
+    MYSQL *mysql = NULL;
+    ConnectionRAII mysqlcon(&mysql, m_connPool);
+    MYSQL_STMT *stmt = mysql ? m_connPool->getStatement(mysql, STMT_INSERT_USER) : NULL;
+    if (stmt == NULL)
+    {
+        return -1;
+    }
+
+    MYSQL_BIND params[2];
+    unsigned long name_len, password_len;
+    bind_string(&params[0], name, &name_len);
+    bind_string(&params[1], password, &password_len);
+    if (mysql_stmt_bind_param(stmt, params) || mysql_stmt_execute(stmt))
+    {
+        LOG_ERROR("insert user failed: %s", mysql_stmt_error(stmt));
+        m_connPool->resetStatement(mysql, STMT_INSERT_USER);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef MYSQL_USER_STORE_H
+#define MYSQL_USER_STORE_H
+
+#include "sql_connection_pool.h"
+#include "register_batch.h"
+#include "../http/user_store.h"
+
+/**
+ * MySQL 用户存储：user(username, passwd) 表
+ * 每次查询时才从连接池取出连接，用完立即归还；查询、插入使用连接上缓存的预处理语句，
+ * 启用注册批量提交时插入交给 RegisterBatcher
+ */
+class MysqlUserStore : public UserStore
+{
+public:
+    MysqlUserStore(ConnectionPool *connPool, int close_log);
+
+    const char *name()
+    {
+        return "mysql";
+    }
+
+    /* position：已读取的最后一行 id（user 表有自增 id 列时只读取之后的新行）*/
+    bool load(UserTable *table, uint64_t *position);
+    int find(const char *name, char *password, size_t size);
+    int insert(const char *name, const char *password);
+
+private:
+    ConnectionPool *m_connPool;
+    int m_close_log;
+};
+
+#endif
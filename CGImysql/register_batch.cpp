@@ -0,0 +1,290 @@
+#include <time.h>
+#include <pthread.h>
+#include <mysql/errmsg.h>
+
+#include "register_batch.h"
+
+/* 连接已断开的错误：重连后可以重试 */
+static bool connection_lost(unsigned int err)
+{
+    return CR_SERVER_GONE_ERROR == err || CR_SERVER_LOST == err;
+}
+
+RegisterBatcher::RegisterBatcher()
+{
+    m_enabled = false;
+    m_close_log = 0;
+    m_max_rows = 0;
+    m_max_delay_ms = 0;
+    m_mysql = NULL;
+    m_port = 0;
+}
+
+RegisterBatcher::~RegisterBatcher()
+{
+    for (size_t i = 0; i < m_stmts.size(); ++i)
+    {
+        if (m_stmts[i])
+            mysql_stmt_close(m_stmts[i]);
+    }
+    if (m_mysql)
+    {
+        mysql_close(m_mysql);
+    }
+}
+
+RegisterBatcher *RegisterBatcher::getInstance()
+{
+    static RegisterBatcher batcher;
+    return &batcher;
+}
+
+bool RegisterBatcher::init(string url, string user, string password, string databaseName, int port,
+                           int max_rows, int max_delay_ms, int close_log)
+{
+    m_close_log = close_log;
+    m_max_rows = max_rows;
+    m_max_delay_ms = max_delay_ms;
+    m_url = url;
+    m_user = user;
+    m_password = password;
+    m_databaseName = databaseName;
+    m_port = port;
+
+    if (!connect())
+    {
+        return false;
+    }
+    m_stmts.assign(m_max_rows + 1, NULL);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, worker, this) != 0)
+    {
+        LOG_ERROR("register batch: pthread_create failed");
+        mysql_close(m_mysql);
+        m_mysql = NULL;
+        return false;
+    }
+    pthread_detach(tid);
+
+    m_enabled = true;
+    LOG_INFO("register batch: up to %d rows every %d ms", m_max_rows, m_max_delay_ms);
+    return true;
+}
+
+/* 建立专用连接，失败时 m_mysql 为NULL */
+bool RegisterBatcher::connect()
+{
+    m_mysql = mysql_init(NULL);
+    if (m_mysql == NULL)
+    {
+        LOG_ERROR("register batch: mysql_init failed");
+        return false;
+    }
+    if (mysql_real_connect(m_mysql, m_url.c_str(), m_user.c_str(), m_password.c_str(), m_databaseName.c_str(), m_port, NULL, 0) == NULL)
+    {
+        LOG_ERROR("register batch: mysql_real_connect failed: %s", mysql_error(m_mysql));
+        mysql_close(m_mysql);
+        m_mysql = NULL;
+        return false;
+    }
+    return true;
+}
+
+/* 关闭断开的连接及其上的预处理语句，重新连接；语句在下次使用时重新 prepare */
+void RegisterBatcher::reconnect()
+{
+    for (size_t i = 0; i < m_stmts.size(); ++i)
+    {
+        reset_statement(i);
+    }
+    if (m_mysql)
+    {
+        mysql_close(m_mysql);
+        m_mysql = NULL;
+    }
+    if (connect())
+    {
+        LOG_INFO("register batch: reconnected");
+    }
+}
+
+int RegisterBatcher::insert(const char *name, const char *password)
+{
+    Request req;
+    req.name = name;
+    req.password = password;
+    req.result = -1;
+    req.done = false;
+
+    m_lock.lock();
+    m_queue.push_back(&req);
+    // 第一行入队时唤醒后台线程开始计时，攒够一批时唤醒它立即提交
+    if (1 == m_queue.size() || (int)m_queue.size() >= m_max_rows)
+    {
+        m_queue_cond.signal();
+    }
+    while (!req.done)
+    {
+        m_done_cond.wait(m_lock.get());
+    }
+    m_lock.unlock();
+    return req.result;
+}
+
+void *RegisterBatcher::worker(void *arg)
+{
+    RegisterBatcher *batcher = (RegisterBatcher *)arg;
+    batcher->run();
+    return NULL;
+}
+
+void RegisterBatcher::run()
+{
+    vector<Request *> batch;
+    while (true)
+    {
+        m_lock.lock();
+        while (m_queue.empty())
+        {
+            m_queue_cond.wait(m_lock.get());
+        }
+
+        // 第一行入队后最多等待 m_max_delay_ms 毫秒，期间到达的注册合并到同一批
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)m_max_delay_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while ((int)m_queue.size() < m_max_rows)
+        {
+            if (!m_queue_cond.timewait(m_lock.get(), deadline))
+            {
+                break;  // 超时
+            }
+        }
+
+        int n = min((int)m_queue.size(), m_max_rows);
+        batch.assign(m_queue.begin(), m_queue.begin() + n);
+        m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+        m_lock.unlock();
+
+        // 整批插入，失败时逐行重试，得到每一行各自的结果；连接不可用时逐行重试也不会成功，整批失败
+        int err = execute(&batch[0], n);
+        if (0 == err)
+        {
+            for (int i = 0; i < n; ++i)
+                batch[i]->result = 0;
+        }
+        else if (n > 1 && !connection_lost(err))
+        {
+            for (int i = 0; i < n; ++i)
+                batch[i]->result = execute(&batch[i], 1) ? -1 : 0;
+        }
+
+        m_lock.lock();
+        for (int i = 0; i < n; ++i)
+        {
+            batch[i]->done = true;
+        }
+        m_done_cond.broadcast();
+        m_lock.unlock();
+    }
+}
+
+/* 多行 INSERT 预处理语句，按行数缓存；失败时 err 为错误码 */
+MYSQL_STMT *RegisterBatcher::statement(int rows, unsigned int *err)
+{
+    MYSQL_STMT *&stmt = m_stmts[rows];
+    if (stmt == NULL)
+    {
+        // 上次重连失败，还没有连接
+        if (m_mysql == NULL)
+        {
+            *err = CR_SERVER_GONE_ERROR;
+            return NULL;
+        }
+        string sql = "INSERT INTO user(username, passwd) VALUES(?, ?)";
+        for (int i = 1; i < rows; ++i)
+        {
+            sql += ",(?, ?)";
+        }
+        stmt = mysql_stmt_init(m_mysql);
+        if (stmt == NULL)
+        {
+            LOG_ERROR("register batch: mysql_stmt_init failed: %s", mysql_error(m_mysql));
+            *err = mysql_errno(m_mysql);
+            return NULL;
+        }
+        if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()))
+        {
+            LOG_ERROR("register batch: mysql_stmt_prepare failed: %s", mysql_stmt_error(stmt));
+            *err = mysql_stmt_errno(stmt);
+            mysql_stmt_close(stmt);
+            stmt = NULL;
+        }
+    }
+    return stmt;
+}
+
+void RegisterBatcher::reset_statement(int rows)
+{
+    if (m_stmts[rows])
+    {
+        mysql_stmt_close(m_stmts[rows]);
+        m_stmts[rows] = NULL;
+    }
+}
+
+/**
+ * 插入 n 个用户，成功返回0，失败返回错误码
+ * 连接断开时重连并重试一次；CR_SERVER_LOST 时服务器可能已执行过这条 INSERT，重试会因唯一约束失败
+ */
+int RegisterBatcher::execute(Request **reqs, int n)
+{
+    int err = execute_once(reqs, n);
+    if (connection_lost(err))
+    {
+        LOG_WARN("register batch: connection lost, reconnecting");
+        reconnect();
+        err = execute_once(reqs, n);
+    }
+    return err;
+}
+
+/* 一条多行 INSERT 插入 n 个用户（自动提交模式下即一次提交）*/
+int RegisterBatcher::execute_once(Request **reqs, int n)
+{
+    unsigned int err = 0;
+    MYSQL_STMT *stmt = statement(n, &err);
+    if (stmt == NULL)
+    {
+        return err ? err : -1;
+    }
+
+    vector<MYSQL_BIND> params(2 * n);
+    vector<unsigned long> lengths(2 * n);
+    memset(&params[0], 0, sizeof(MYSQL_BIND) * params.size());
+    for (int i = 0; i < n; ++i)
+    {
+        const char *values[2] = {reqs[i]->name, reqs[i]->password};
+        for (int k = 0; k < 2; ++k)
+        {
+            MYSQL_BIND &bind = params[2 * i + k];
+            lengths[2 * i + k] = strlen(values[k]);
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = (void *)values[k];
+            bind.buffer_length = lengths[2 * i + k];
+            bind.length = &lengths[2 * i + k];
+        }
+    }
+
+    if (mysql_stmt_bind_param(stmt, &params[0]) || mysql_stmt_execute(stmt))
+    {
+        LOG_ERROR("register batch: insert %d rows failed: %s", n, mysql_stmt_error(stmt));
+        err = mysql_stmt_errno(stmt);
+        reset_statement(n);
+        return err ? err : -1;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef REGISTER_BATCH_H
+#define REGISTER_BATCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <mysql/mysql.h>
+#include "../lock/locker.h"
+#include "../log/log.h"
+
+using namespace std;
+
+/**
+ * 注册批量提交（单例模式，group commit）
+ * 工作线程提交的注册先进入队列，后台线程每隔几毫秒或攒够 max_rows 行，
+ * 用一条多行 INSERT（预处理语句，按行数缓存）写入数据库，一次往返、一次提交完成整批注册，
+ * 再逐个唤醒等待的工作线程，各自得到自己那一行的结果
+ * 批量插入失败时（如某行违反唯一约束）逐行重试，只有出错的那一行注册失败
+ * 专用连接断开时（服务器重启、wait_timeout）重新连接，丢弃缓存的预处理语句后把这一批重试一次
+ */
+class RegisterBatcher
+{
+public:
+    static RegisterBatcher *getInstance();
+
+    /* 建立专用的数据库连接，启动后台提交线程 */
+    bool init(string url, string user, string password, string databaseName, int port,
+              int max_rows, int max_delay_ms, int close_log);
+
+    bool enabled()
+    {
+        return m_enabled;
+    }
+
+    /* 插入一个用户，阻塞到所在批次提交完成，成功返回0 */
+    int insert(const char *name, const char *password);
+
+private:
+    RegisterBatcher();
+    ~RegisterBatcher();
+
+    // 一个等待提交的注册，字符串在等待期间由调用者保证有效
+    struct Request
+    {
+        const char *name;
+        const char *password;
+        int result;
+        bool done;
+    };
+
+    static void *worker(void *arg);
+    void run();
+    bool connect();
+    void reconnect();
+    int execute(Request **reqs, int n);
+    int execute_once(Request **reqs, int n);
+    MYSQL_STMT *statement(int rows, unsigned int *err);
+    void reset_statement(int rows);
+
+private:
+    bool m_enabled;
+    int m_close_log;
+    int m_max_rows;           // 每批最多行数
+    int m_max_delay_ms;       // 第一行入队后最多等待的毫秒数
+    MYSQL *m_mysql;           // 后台线程独占的数据库连接（重连失败时为NULL）
+    vector<MYSQL_STMT *> m_stmts; // 下标为行数的多行 INSERT 预处理语句
+
+    string m_url;             // 重连使用的连接参数
+    string m_user;
+    string m_password;
+    string m_databaseName;
+    int m_port;
+
+    MutexLocker m_lock;       // 保护队列
+    Cond m_queue_cond;        // 队列非空 / 攒够一批
+    Cond m_done_cond;         // 一批提交完成
+    vector<Request *> m_queue;
+};
+
+#endif
@@ -1,9 +1,20 @@
 #include "sql_connection_pool.h"
+#include "../timer/clock.h"
+#include "../metrics/probes.h"
 
 ConnectionPool::ConnectionPool()
 {
+    m_maxConn = 0;
+    m_minConn = 0;
     m_curConn = 0;
     m_freeConn = 0;
+    m_connecting = 0;
+    m_acquire_timeout_ms = 0;
+    m_port = 0;
+    m_close_log = 0;
+    m_stop = false;
+    m_checker_started = false;
+    memset(&m_stats, 0, sizeof(m_stats));
 }
 
 ConnectionPool *ConnectionPool::getInstance()
@@ -14,10 +25,12 @@ ConnectionPool *ConnectionPool::getInstance()
 
 
 /**
- * MaxConn ：设置数据库连接池的大小
+ * MaxConn ：设置数据库连接池的大小上限
+ * MinConn ：启动时建立、空闲时保留的连接数（0：等于 MaxConn，连接池大小固定）
  * url : localhost"
 */
-void ConnectionPool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log)
+void ConnectionPool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log,
+                          int MinConn, int acquire_timeout_ms)
 {
     m_url = url;             // 主机地址
     m_port = Port;           // 数据库端口号
@@ -25,56 +38,165 @@ void ConnectionPool::init(string url, string User, string PassWord, string DBNam
     m_password = PassWord;   // 数据库密码
     m_databaseName = DBName; // 数据库名
     m_close_log = close_log; // 日志开关
-    
-    // 创建连接池： MaxConn个 数据库连接
-    for (int i = 0; i < MaxConn; ++i)
+    m_maxConn = MaxConn;
+    m_minConn = (MinConn <= 0 || MinConn > MaxConn) ? MaxConn : MinConn;
+    m_acquire_timeout_ms = acquire_timeout_ms;
+
+    // 创建连接池： MinConn个 数据库连接
+    // 数据库暂时不可用时不退出，由后台检查线程补足
+    long long now = Clock::getInstance()->mono_ms();
+    for (int i = 0; i < m_minConn; ++i)
     {
-        MYSQL *connSql = NULL;
-        connSql = mysql_init(connSql); // 初始化数据库
+        MYSQL *connSql = connect();
         if (connSql == NULL)
         {
-            LOG_ERROR("mysql_init failed!");
-			exit(1);    // 异常退出
-        }
-        
-        // 用户名、密码登录数据库,连接到指定的db（默认端口）
-        connSql = mysql_real_connect(connSql, url.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, NULL, 0);
-        if (connSql == NULL){
-            LOG_ERROR("mysql_real_connect failed!");
-            exit(1);
+            break;
         }
-        
-        
+
+        PooledConn *pc = new PooledConn;
+        pc->mysql = connSql;
+        pc->stmts.assign(STMT_COUNT, NULL);
+        pc->idle_since_ms = now;
+        pc->checked_ms = now;
+        m_conns[connSql] = pc;
         connList.push_back(connSql);    // 添加到Mysql连接池
         ++m_freeConn;
     }
+    if (m_freeConn < m_minConn)
+    {
+        LOG_ERROR("connection pool: only %d of %d connections established", m_freeConn, m_minConn);
+    }
 
-    reserve = Sem(m_freeConn); // 设置信号量初值：m_FreeConn，即最大连接数MaxConn
-    m_maxConn = m_freeConn;    // 最大连接数 = 当前空闲的连接数
+    // 后台线程：ping 空闲连接、重连、补足最小连接数、关闭空闲过久的连接
+    if (pthread_create(&m_checker_tid, NULL, checker, this) == 0)
+    {
+        m_checker_started = true;
+    }
 }
 
-// 从连接池 获取一个连接
-// 当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
-/* 消费者：信号量 */
-MYSQL *ConnectionPool::getConnction()
+/* 建立一条新连接，失败返回NULL */
+MYSQL *ConnectionPool::connect()
 {
-    MYSQL *con = NULL;
+    MYSQL *connSql = mysql_init(NULL); // 初始化数据库
+    if (connSql == NULL)
+    {
+        LOG_ERROR("mysql_init failed!");
+        return NULL;
+    }
 
-    if (connList.size() <= 0)
+    // 用户名、密码登录数据库,连接到指定的db（默认端口）
+    if (mysql_real_connect(connSql, m_url.c_str(), m_user.c_str(), m_password.c_str(), m_databaseName.c_str(), m_port, NULL, 0) == NULL)
+    {
+        LOG_ERROR("mysql_real_connect failed: %s", mysql_error(connSql));
+        mysql_close(connSql);
+        lock.lock();
+        ++m_stats.connect_failures;
+        lock.unlock();
         return NULL;
+    }
+    return connSql;
+}
 
-    reserve.wait(); /* 信号量-1，如果连接池用完，即信号量=0，则阻塞 */
+/* 关闭连接，先关闭其上缓存的预处理语句 */
+void ConnectionPool::close_conn(PooledConn *pc)
+{
+    for (size_t i = 0; i < pc->stmts.size(); ++i)
+    {
+        if (pc->stmts[i])
+            mysql_stmt_close(pc->stmts[i]);
+    }
+    mysql_close(pc->mysql);
+    delete pc;
+}
+
+// 从连接池 获取一个连接
+// 当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
+// 没有空闲连接时：未达上限则新建一条，否则等待归还，最多等待 timeout_ms 毫秒
+MYSQL *ConnectionPool::getConnction(int timeout_ms)
+{
+    if (timeout_ms < 0)
+        timeout_ms = m_acquire_timeout_ms;
+    TWS_PROBE(db__acquire__start);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    long long wait_start = 0;
 
     /* 运行在线程池的工作线程中，各个工作线程访问 单例数据库连接链表，加锁保护*/
     lock.lock();    // 对连接池操作，加锁
+    while (connList.empty())
+    {
+        // 扩容：在锁外建立连接，先占用一个名额
+        if (!m_stop && m_curConn + m_freeConn + m_connecting < m_maxConn)
+        {
+            ++m_connecting;
+            lock.unlock();
+            MYSQL *con = connect();
+            PooledConn *pc = NULL;
+            if (con)
+            {
+                pc = new PooledConn;
+                pc->mysql = con;
+                pc->stmts.assign(STMT_COUNT, NULL);
+                pc->checked_ms = pc->idle_since_ms = Clock::getInstance()->mono_ms();
+            }
+            lock.lock();
+            --m_connecting;
+            if (pc)
+            {
+                m_conns[con] = pc;
+                ++m_curConn;
+                ++m_stats.created;
+                ++m_stats.acquires;
+                if (wait_start)
+                    m_stats.wait_ms += Clock::getInstance()->mono_ms() - wait_start;
+                lock.unlock();
+                held_conns().push_back(HeldConn(con, pc));
+                TWS_PROBE1(db__acquire, con);
+                return con;
+            }
+            // 数据库不可用：不立即重试，等待归还或超时
+        }
+
+        if (0 == wait_start)
+        {
+            wait_start = Clock::getInstance()->mono_ms();
+            ++m_stats.waits;
+        }
+        ++m_stats.waiting;
+        bool signaled = timeout_ms > 0 && m_cond.timewait(lock.get(), deadline);
+        --m_stats.waiting;
+        if (!signaled && connList.empty())
+        {
+            ++m_stats.timeouts;
+            m_stats.wait_ms += Clock::getInstance()->mono_ms() - wait_start;
+            lock.unlock();
+            LOG_WARN("connection pool: no connection within %d ms", timeout_ms);
+            TWS_PROBE1(db__acquire, (MYSQL *)NULL);
+            return NULL;
+        }
+    }
 
-    con = connList.front();    /* 取出连接池中的1个连接 */
+    MYSQL *con = connList.front();    /* 取出连接池中的1个连接 */
     connList.pop_front();
+    PooledConn *pc = m_conns[con];
 
     --m_freeConn;  /* 空闲的连接数 -1 */
     ++m_curConn;   /* 已连接数 +1 */
+    ++m_stats.acquires;
+    if (wait_start)
+        m_stats.wait_ms += Clock::getInstance()->mono_ms() - wait_start;
 
     lock.unlock();
+    held_conns().push_back(HeldConn(con, pc));
+    TWS_PROBE1(db__acquire, con);
     return con;
 }
 
@@ -83,40 +205,274 @@ bool ConnectionPool::releaseConnection(MYSQL *conn)
 {
     if (NULL == conn)
         return false;
+    TWS_PROBE1(db__release, conn);
+
+    vector<HeldConn> &hc = held_conns();
+    for (size_t i = 0; i < hc.size(); ++i)
+    {
+        if (hc[i].first == conn)
+        {
+            hc.erase(hc.begin() + i);
+            break;
+        }
+    }
 
     /*多个工作线程访问代码，加锁保护*/
     lock.lock();
 
-    // mysql_close(conn);
+    map<MYSQL *, PooledConn *>::iterator it = m_conns.find(conn);
+    if (it == m_conns.end())
+    {
+        lock.unlock();
+        return false;
+    }
+    // 连接池已销毁：归还的连接直接关闭
+    if (m_stop)
+    {
+        close_conn(it->second);
+        m_conns.erase(it);
+        --m_curConn;
+        lock.unlock();
+        return true;
+    }
+    it->second->idle_since_ms = Clock::getInstance()->mono_ms();
 
-    connList.push_back(conn); // 重新添加到 连接池(list容器push_back)
+    // 最近归还的放在前面先被取出，长时间空闲的连接集中在尾部，便于收缩
+    connList.push_front(conn); // 重新添加到 连接池
     ++m_freeConn;
     --m_curConn;
 
     lock.unlock();
 
-    reserve.post(); /* 信号量+1，唤醒阻塞线程 */
+    m_cond.signal(); /* 唤醒一个等待连接的线程 */
     return true;
 }
 
-/* 销毁所有连接 */
-void ConnectionPool::destoryPool()
+/* ping 连接，断开时就地重连（预处理语句随旧连接关闭，之后按需重新 prepare）*/
+bool ConnectionPool::check(PooledConn *pc)
+{
+    if (0 == mysql_ping(pc->mysql))
+    {
+        pc->checked_ms = Clock::getInstance()->mono_ms();
+        return true;
+    }
+    LOG_WARN("connection pool: ping failed: %s, reconnecting", mysql_error(pc->mysql));
+
+    MYSQL *con = connect();
+    if (con == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < pc->stmts.size(); ++i)
+    {
+        if (pc->stmts[i])
+            mysql_stmt_close(pc->stmts[i]);
+        pc->stmts[i] = NULL;
+    }
+    mysql_close(pc->mysql);
+    pc->mysql = con;
+    pc->checked_ms = Clock::getInstance()->mono_ms();
+    return true;
+}
+
+void *ConnectionPool::checker(void *arg)
+{
+    ConnectionPool *pool = (ConnectionPool *)arg;
+    pool->run_checker();
+    return NULL;
+}
+
+/* 后台检查线程：每 POOL_CHECK_INTERVAL_MS 检查一轮 */
+void ConnectionPool::run_checker()
 {
     lock.lock();
-    if (connList.size() > 0)
+    while (!m_stop)
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += POOL_CHECK_INTERVAL_MS / 1000;
+        m_stop_cond.timewait(lock.get(), t);
+        if (m_stop)
+            break;
+
+        long long now = Clock::getInstance()->mono_ms();
+
+        // 1. 取出需要检查的空闲连接，在锁外 ping / 重连 / 关闭，不阻塞取连接的线程
+        //    检查期间这些连接计入 m_connecting，取连接时的扩容不会超过上限
+        vector<PooledConn *> due;
+        vector<bool> shrink;
+        int total = m_curConn + m_freeConn;
+        for (list<MYSQL *>::iterator it = connList.begin(); it != connList.end();)
+        {
+            PooledConn *pc = m_conns[*it];
+            bool idle = (total > m_minConn && now - pc->idle_since_ms >= POOL_IDLE_TIMEOUT_MS);
+            // 最近半个检查周期内确认过可用（刚建立或刚 ping 过）的连接跳过
+            if (!idle && now - pc->checked_ms < POOL_CHECK_INTERVAL_MS / 2)
+            {
+                ++it;
+                continue;
+            }
+            if (idle)
+                --total;
+            due.push_back(pc);
+            shrink.push_back(idle);
+            m_conns.erase(*it);
+            it = connList.erase(it);
+            --m_freeConn;
+            ++m_connecting;
+        }
+        lock.unlock();
+
+        vector<bool> ok(due.size(), false);
+        int reconnects = 0;
+        for (size_t i = 0; i < due.size(); ++i)
+        {
+            if (!shrink[i])
+            {
+                MYSQL *old = due[i]->mysql;
+                ok[i] = check(due[i]);
+                if (ok[i] && due[i]->mysql != old)
+                    ++reconnects;
+            }
+            if (!ok[i])
+                close_conn(due[i]);
+        }
+
+        lock.lock();
+        for (size_t i = 0; i < due.size(); ++i)
+        {
+            --m_connecting;
+            if (ok[i])
+            {
+                m_conns[due[i]->mysql] = due[i];
+                connList.push_back(due[i]->mysql);
+                ++m_freeConn;
+                m_cond.signal();
+            }
+            else if (shrink[i])
+            {
+                ++m_stats.shrunk;
+            }
+        }
+        m_stats.reconnects += reconnects;
+        if (!due.empty())
+        {
+            LOG_DEBUG("connection pool: checked %d idle connections, %d total, %d free",
+                      (int)due.size(), m_curConn + m_freeConn, m_freeConn);
+        }
+
+        // 2. 补足最小连接数（启动时或重连失败后数据库恢复）
+        while (!m_stop && m_curConn + m_freeConn + m_connecting < m_minConn)
+        {
+            ++m_connecting;
+            lock.unlock();
+            MYSQL *con = connect();
+            lock.lock();
+            --m_connecting;
+            if (con == NULL)
+                break;
+
+            PooledConn *pc = new PooledConn;
+            pc->mysql = con;
+            pc->stmts.assign(STMT_COUNT, NULL);
+            pc->checked_ms = pc->idle_since_ms = Clock::getInstance()->mono_ms();
+            m_conns[con] = pc;
+            connList.push_back(con);
+            ++m_freeConn;
+            ++m_stats.created;
+            m_cond.signal();
+        }
+    }
+    lock.unlock();
+}
+
+/* 预处理语句的SQL，下标为 SQL_STMT */
+static const char *stmt_sql[STMT_COUNT] = {
+    "SELECT username,passwd FROM user WHERE username=? LIMIT 1",
+    "INSERT INTO user(username, passwd) VALUES(?, ?)",
+};
+
+vector<ConnectionPool::HeldConn> &ConnectionPool::held_conns()
+{
+    static thread_local vector<HeldConn> t_held;
+    return t_held;
+}
+
+/* 连接由调用线程持有期间，其 PooledConn 不会被其他线程修改或释放 */
+ConnectionPool::PooledConn *ConnectionPool::held(MYSQL *conn)
+{
+    vector<HeldConn> &hc = held_conns();
+    for (size_t i = 0; i < hc.size(); ++i)
+    {
+        if (hc[i].first == conn)
+            return hc[i].second;
+    }
+    return NULL;
+}
+
+/* 取出连接上缓存的预处理语句，第一次使用时 prepare；只查当前线程持有的连接，不加连接池的锁 */
+MYSQL_STMT *ConnectionPool::getStatement(MYSQL *conn, SQL_STMT id)
+{
+    PooledConn *pc = held(conn);
+    if (pc == NULL)
+        return NULL;
+
+    MYSQL_STMT *&stmt = pc->stmts[id];
+    if (stmt == NULL)
     {
-        list<MYSQL *>::iterator it;
-        // 迭代器遍历数据库连接池链表，关闭所有连接的数据库
-        for (it = connList.begin(); it != connList.end(); ++it)
+        stmt = mysql_stmt_init(conn);
+        if (stmt == NULL)
+        {
+            LOG_ERROR("mysql_stmt_init failed: %s", mysql_error(conn));
+            return NULL;
+        }
+        if (mysql_stmt_prepare(stmt, stmt_sql[id], strlen(stmt_sql[id])))
         {
-            mysql_close(*it);
+            LOG_ERROR("mysql_stmt_prepare failed: %s", mysql_stmt_error(stmt));
+            mysql_stmt_close(stmt);
+            stmt = NULL;
         }
+    }
+    return stmt;
+}
+
+/* 关闭出错的预处理语句；连接已断开时标记为需要检查，下次后台检查时重连 */
+void ConnectionPool::resetStatement(MYSQL *conn, SQL_STMT id)
+{
+    // 连接归还时加锁，checked_ms 的修改随之对后台检查线程可见
+    PooledConn *pc = held(conn);
+    if (pc)
+        pc->checked_ms = 0;
+    if (pc && pc->stmts[id] != NULL)
+    {
+        mysql_stmt_close(pc->stmts[id]);
+        pc->stmts[id] = NULL;
+    }
+}
+
+/* 销毁所有连接 */
+void ConnectionPool::destoryPool()
+{
+    lock.lock();
+    m_stop = true;
+    m_stop_cond.signal();
+    lock.unlock();
+    if (m_checker_started)
+    {
+        pthread_join(m_checker_tid, NULL);
+        m_checker_started = false;
+    }
 
-        // 再释放线程池资源
-        connList.clear();
-        m_freeConn = 0; /* 空闲连接数清零 */
-        m_curConn = 0;  /* 已连接数清零 */
+    lock.lock();
+    // 只关闭空闲连接：仍被取出的连接可能正在执行语句，留在 m_conns 中，
+    // 由 releaseConnection 在归还时关闭（m_stop 已置位）
+    for (list<MYSQL *>::iterator it = connList.begin(); it != connList.end(); ++it)
+    {
+        close_conn(m_conns[*it]);
+        m_conns.erase(*it);
     }
+    connList.clear();
+    m_freeConn = 0; /* 空闲连接数清零 */
     lock.unlock();
 }
 
@@ -126,6 +482,15 @@ int ConnectionPool::getFreeConn()
     return m_freeConn;
 }
 
+void ConnectionPool::stats(PoolStats *out)
+{
+    lock.lock();
+    *out = m_stats;
+    out->total = m_curConn + m_freeConn;
+    out->free = m_freeConn;
+    lock.unlock();
+}
+
 ConnectionPool::~ConnectionPool()
 {
     destoryPool();
@@ -154,4 +519,4 @@ ConnectionRAII::ConnectionRAII(MYSQL **con, ConnectionPool *connPool)
 ConnectionRAII::~ConnectionRAII()
 {
     poolRAII->releaseConnection(conRAII);
-}
\ No newline at end of file
+}
@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <list>
+#include <map>
+#include <vector>
 #include <mysql/mysql.h>
 #include <error.h>
 #include <string.h>
@@ -13,19 +15,56 @@
 
 using namespace std;
 
+/**
+ * 预处理语句：每条连接第一次执行时 prepare 并缓存，之后只以二进制协议传参数执行
+ * 服务器不必每次重新解析SQL，参数不拼接进SQL，也就不存在注入和拼接缓冲区溢出
+ */
+enum SQL_STMT
+{
+    STMT_SELECT_USER = 0, // SELECT username,passwd FROM user WHERE username=?
+    STMT_INSERT_USER,     // INSERT INTO user(username, passwd) VALUES(?, ?)
+    STMT_COUNT
+};
+
+/* 连接池运行统计 */
+struct PoolStats
+{
+    int total;                        // 当前连接数（空闲 + 使用中）
+    int free;                         // 空闲连接数
+    int waiting;                      // 正在等待连接的线程数
+    unsigned long long acquires;      // 成功取出连接的次数
+    unsigned long long waits;         // 取连接时需要等待的次数
+    unsigned long long timeouts;      // 等待超时的次数
+    unsigned long long wait_ms;       // 累计等待时间（毫秒）
+    unsigned long long created;       // 新建的连接数（含扩容、补足最小连接数）
+    unsigned long long connect_failures; // 建立连接失败的次数
+    unsigned long long reconnects;    // 检查失败后重连成功的次数
+    unsigned long long shrunk;        // 空闲过久被关闭的连接数
+};
+
 /**
  * 数据库连接池（单例模式）
+ * 连接数在 [minConn, maxConn] 之间伸缩：没有空闲连接时新建（不超过 maxConn），
+ * 空闲超过 POOL_IDLE_TIMEOUT_MS 且多于 minConn 时关闭；
+ * 后台线程定期 ping 空闲连接，断开的连接透明重连，数据库暂时不可用时取连接最多等待 acquire_timeout_ms
 */
 class ConnectionPool
 {
 public:
-    MYSQL *getConnction();               // 获取数据库连接
-    bool releaseConnection(MYSQL *conn); // 释放连接
-    int getFreeConn();                   // 获取连接
-    void destoryPool();                  // 销毁所有连接
+    MYSQL *getConnction(int timeout_ms = -1); // 获取数据库连接（-1：使用初始化时的等待超时），超时返回NULL
+    bool releaseConnection(MYSQL *conn);      // 释放连接
+    int getFreeConn();                        // 获取连接
+    void destoryPool();                       // 销毁所有连接
+    void stats(PoolStats *out);               // 运行统计
+
+    /* 取出连接上缓存的预处理语句（只由当前持有该连接的线程调用）*/
+    MYSQL_STMT *getStatement(MYSQL *conn, SQL_STMT id);
+    /* 语句执行出错（如连接断开）后关闭，下次使用时重新 prepare */
+    void resetStatement(MYSQL *conn, SQL_STMT id);
 
     /*初始化*/
-    void init(string url, string user, string password, string databaseName, int port, int maxConn, int closeLog);
+    void init(string url, string user, string password, string databaseName, int port, int maxConn, int closeLog,
+              int minConn = 0, int acquire_timeout_ms = 1000);
 
     // 单例模式
     static ConnectionPool *getInstance();
@@ -34,23 +73,54 @@ private:
     ConnectionPool();  /* 单例模式：私有构造函数，无法创建对象 */
     ~ConnectionPool();
 
+    // 池中的一条连接
+    struct PooledConn
+    {
+        MYSQL *mysql;
+        vector<MYSQL_STMT *> stmts; // 预处理语句缓存（下标为 SQL_STMT）
+        long long idle_since_ms;    // 放回连接池的时间
+        long long checked_ms;       // 上次确认连接可用的时间
+    };
+
+    // 当前线程持有的连接及其 PooledConn：取出时登记、归还时移除，只由本线程访问
+    typedef pair<MYSQL *, PooledConn *> HeldConn;
+    static vector<HeldConn> &held_conns();
+    PooledConn *held(MYSQL *conn);      // 查找当前线程持有的连接（不加锁）
+
+    MYSQL *connect();                   // 建立一条新连接（不加锁）
+    void close_conn(PooledConn *pc);    // 关闭连接及其预处理语句（不加锁）
+    bool check(PooledConn *pc);         // ping，断开时重连，返回连接是否可用
+    static void *checker(void *arg);    // 后台检查线程
+    void run_checker();
+
     int m_maxConn;          // 最大连接数
+    int m_minConn;          // 最小连接数
     int m_curConn;          // 当前已使用的连接数
     int m_freeConn;         // 当前空闲的连接数
+    int m_connecting;       // 正在建立的连接数（已计入上限，尚未加入连接池）
+    int m_acquire_timeout_ms; // 取连接的等待超时
     MutexLocker lock;       // 互斥锁（访问公共资源）
-    list<MYSQL *> connList; // 连接池链表
-    Sem reserve;            // 信号量
+    Cond m_cond;            // 有连接归还，或可以新建连接
+    list<MYSQL *> connList; // 连接池链表（空闲连接，最近归还的在前）
+    map<MYSQL *, PooledConn *> m_conns; // 所有连接（空闲 + 使用中）
+    PoolStats m_stats;
+
+    bool m_stop;            // 销毁连接池，后台检查线程退出
+    bool m_checker_started;
+    pthread_t m_checker_tid;
+    Cond m_stop_cond;
 
 public:
     string m_url;          // 主机地址（字符名）
-    string m_port;         // 数据库端口号
+    int m_port;            // 数据库端口号
     string m_user;         // 登录数据库用户名
     string m_password;     // 数据库密码
     string m_databaseName; // 数据库名
     int m_close_log;       // 日志开关
 };
 
-
+const int POOL_CHECK_INTERVAL_MS = 5000;   // 后台 ping 空闲连接的间隔
+const int POOL_IDLE_TIMEOUT_MS = 60000;    // 多于最小连接数时，空闲超过该时间的连接被关闭
 
 /**
  * RAII(Resource Acquisition Is Initialization “资源获取初始化”)
@@ -68,4 +138,4 @@ private:
 
 
 
-#endif // !CONNECTION_POOL
\ No newline at end of file
+#endif // !CONNECTION_POOL
@@ -0,0 +1,27 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+#include <benchmark/benchmark.h>
+
+/**
+ * 内部组件微基准（Google Benchmark）
+ * 每个 bench_*.cpp 用 BENCHMARK 静态注册自己的用例，需要运行参数的用例在 main 中动态注册
+ */
+
+// 运行参数（bench_main.cpp 解析）
+struct BenchOptions
+{
+    std::string corpus_dir;     // 请求样本目录
+    std::string log_mode;       // Log 的工作模式：sync | async | ring | binary（日志单例只能初始化一次，每次运行测一种）
+};
+
+extern BenchOptions g_bench_options;
+
+/* 读取 corpus_dir 下的请求样本，按样本注册 http 解析用例 */
+void register_http_benchmarks();
+
+/* 按 log_mode 初始化日志 */
+bool init_bench_log();
+
+#endif
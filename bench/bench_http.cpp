@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "bench.h"
+#include "../http/http_conn.h"
+
+/**
+ * http 请求解析
+ *   BM_ParseLine    : 从状态机，只切分行（每次迭代重新复制请求，parse_line 会把 \r\n 改写为 \0\0）
+ *   BM_ParseRequest : 主状态机解析请求行、首部、消息体，到得到完整请求为止，不映射文件
+ *   BM_ProcessRead  : 完整的 process_read，包括 do_request 中的 stat/open/mmap（之后 unmap）
+ * bench/corpus 下的每个 .http 样本各注册一组
+ */
+
+// 样本
+struct HttpSample
+{
+    std::string name;
+    std::string data;
+};
+
+static std::vector<HttpSample> g_samples;
+
+/* 友元：访问 http_conn 的私有解析函数 */
+class HttpConnBench
+{
+public:
+    static void prepare(http_conn &c, char *root)
+    {
+        c.doc_root = root;
+        c.m_close_log = 1;
+        c.m_TRIGMode = 0;
+    }
+
+    /* 与 init 之后 read_once 读入一个请求相同 */
+    static void load(http_conn &c, const std::string &req)
+    {
+        c.init();
+        memcpy(c.m_read_buf, req.data(), req.size());
+        c.m_read_idx = req.size();
+    }
+
+    static int scan_lines(http_conn &c, const std::string &req)
+    {
+        memcpy(c.m_read_buf, req.data(), req.size());
+        c.m_read_idx = req.size();
+        c.m_checked_idx = 0;
+        int lines = 0;
+        while (c.parse_line() == http_conn::LINE_OK)
+            ++lines;
+        return lines;
+    }
+
+    /* process_read 的循环，得到完整请求时返回 GET_REQUEST 而不调用 do_request */
+    static http_conn::HTTP_CODE parse(http_conn &c)
+    {
+        http_conn::LINE_STATUS line_status = http_conn::LINE_OK;
+        http_conn::HTTP_CODE ret = http_conn::NO_REQUEST;
+        while ((c.m_check_state == http_conn::CHECK_STATE_CONTENT && line_status == http_conn::LINE_OK) ||
+               (line_status = c.parse_line()) == http_conn::LINE_OK)
+        {
+            char *text = c.get_line();
+            c.m_start_line = c.m_checked_idx;
+            switch (c.m_check_state)
+            {
+            case http_conn::CHECK_STATE_REQUESTLINE:
+                ret = c.parse_request_line(text);
+                if (ret == http_conn::BAD_REQUEST)
+                    return ret;
+                break;
+            case http_conn::CHECK_STATE_HEADER:
+                ret = c.parse_headers(text);
+                if (ret != http_conn::NO_REQUEST)
+                    return ret;
+                break;
+            case http_conn::CHECK_STATE_CONTENT:
+                ret = c.parse_content(text);
+                if (ret == http_conn::GET_REQUEST)
+                    return ret;
+                line_status = http_conn::LINE_OPEN;
+                break;
+            }
+        }
+        return http_conn::NO_REQUEST;
+    }
+
+    static http_conn::HTTP_CODE process_read(http_conn &c)
+    {
+        return c.process_read();
+    }
+
+    static void unmap(http_conn &c)
+    {
+        c.unmap();
+    }
+};
+
+static char g_doc_root[256];
+
+static void BM_ParseLine(benchmark::State &state, const HttpSample *s)
+{
+    http_conn *c = new http_conn;
+    HttpConnBench::prepare(*c, g_doc_root);
+    HttpConnBench::load(*c, s->data);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(HttpConnBench::scan_lines(*c, s->data));
+    state.SetBytesProcessed(state.iterations() * s->data.size());
+    delete c;
+}
+
+static void BM_ParseRequest(benchmark::State &state, const HttpSample *s)
+{
+    http_conn *c = new http_conn;
+    HttpConnBench::prepare(*c, g_doc_root);
+    for (auto _ : state)
+    {
+        HttpConnBench::load(*c, s->data);
+        if (HttpConnBench::parse(*c) != http_conn::GET_REQUEST)
+        {
+            state.SkipWithError("incomplete request");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * s->data.size());
+    delete c;
+}
+
+static void BM_ProcessRead(benchmark::State &state, const HttpSample *s)
+{
+    http_conn *c = new http_conn;
+    HttpConnBench::prepare(*c, g_doc_root);
+    for (auto _ : state)
+    {
+        HttpConnBench::load(*c, s->data);
+        benchmark::DoNotOptimize(HttpConnBench::process_read(*c));
+        HttpConnBench::unmap(*c);
+    }
+    state.SetBytesProcessed(state.iterations() * s->data.size());
+    delete c;
+}
+
+void register_http_benchmarks()
+{
+    const std::string &dir = g_bench_options.corpus_dir;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+    {
+        fprintf(stderr, "microbench: cannot open corpus dir %s, http benchmarks skipped\n", dir.c_str());
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        std::string name = ent->d_name;
+        if (name.size() < 6 || name.compare(name.size() - 5, 5, ".http") != 0)
+            continue;
+        FILE *fp = fopen((dir + "/" + name).c_str(), "rb");
+        if (fp == NULL)
+            continue;
+        HttpSample s;
+        s.name = name.substr(0, name.size() - 5);
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+            s.data.append(buf, n);
+        fclose(fp);
+        if (s.data.size() < (size_t)http_conn::READ_BUFFER_SIZE)
+            g_samples.push_back(s);
+        else
+            fprintf(stderr, "microbench: %s larger than the read buffer, skipped\n", name.c_str());
+    }
+    closedir(d);
+    std::sort(g_samples.begin(), g_samples.end(), [](const HttpSample &a, const HttpSample &b) { return a.name < b.name; });
+
+    // do_request 映射网站根目录下的文件；登录请求需要用户表（纯内存后端，加载立即完成）
+    if (getcwd(g_doc_root, sizeof(g_doc_root) - 8) != NULL)
+        strcat(g_doc_root, "/root");
+    http_conn loader;
+    loader.init_user_store(new MemoryUserStore, 1);
+    while (!UserTable::getInstance()->ready())
+        usleep(1000);
+
+    for (size_t i = 0; i < g_samples.size(); ++i)
+    {
+        const HttpSample *s = &g_samples[i];
+        benchmark::RegisterBenchmark(("BM_ParseLine/" + s->name).c_str(), BM_ParseLine, s);
+        benchmark::RegisterBenchmark(("BM_ParseRequest/" + s->name).c_str(), BM_ParseRequest, s);
+        benchmark::RegisterBenchmark(("BM_ProcessRead/" + s->name).c_str(), BM_ProcessRead, s);
+    }
+}
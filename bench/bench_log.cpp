@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "../log/log.h"
+
+/**
+ * 日志（模式由 --log_mode 指定，日志写入 /tmp/<日期>_BenchLog）
+ *   BM_LogWriteLog : 直接调用 Log::write_log（文本格式化路径）
+ *   BM_LogMacro    : LOG_INFO 宏（二进制模式下只编码格式ID和参数）
+ * 1 ~ 8 个线程同时写，与工作线程并发写日志的情况相同
+ */
+
+bool init_bench_log()
+{
+    const std::string &mode = g_bench_options.log_mode;
+    Log *log = Log::getInstance();
+    if (mode == "sync")
+        return log->init("/tmp/BenchLog", 0, 2000, 800000, 0);
+    if (mode == "async")
+        return log->init("/tmp/BenchLog", 0, 2000, 800000, 800);
+    if (mode == "ring")
+        return log->init("/tmp/BenchLog", 0, 2000, 800000, 0, 1 << 20);
+    if (mode == "binary")
+        return log->init("/tmp/BenchLog.bin", 0, 2000, 800000, 0, 1 << 20, true);
+    return false;
+}
+
+static void BM_LogWriteLog(benchmark::State &state)
+{
+    long i = 0;
+    for (auto _ : state)
+        Log::getInstance()->write_log(1, "client(%s) %s %s, %d bytes, %ld", "192.168.1.10", "GET", "/log.html", 746, i++);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(g_bench_options.log_mode);
+}
+BENCHMARK(BM_LogWriteLog)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LogMacro(benchmark::State &state)
+{
+    int m_close_log = 0;
+    long i = 0;
+    for (auto _ : state)
+        LOG_INFO("client(%s) %s %s, %d bytes, %ld", "192.168.1.10", "GET", "/log.html", 746, i++);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(g_bench_options.log_mode);
+}
+BENCHMARK(BM_LogMacro)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,59 @@
+/*******************************************************
+ * microbench : 解析器、定时器、阻塞队列、线程池、日志的微基准
+ * 用法：./microbench [--corpus_dir=bench/corpus] [--log_mode=sync|async|ring|binary] [Google Benchmark 参数]
+ *   --benchmark_out=bench.json --benchmark_out_format=json : 结果写入 JSON，用于跨版本对比
+ *   --benchmark_filter=正则 : 只运行名称匹配的用例
+ * 被测代码中的 printf 调试输出重定向到 /dev/null，结果表输出到 stderr
+ ********************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+#include "bench.h"
+
+BenchOptions g_bench_options;
+
+/* 取出本工具自己的参数，其余交给 benchmark::Initialize */
+static void parse_args(int *argc, char **argv)
+{
+    g_bench_options.corpus_dir = "bench/corpus";
+    g_bench_options.log_mode = "sync";
+
+    int n = 1;
+    for (int i = 1; i < *argc; ++i)
+    {
+        if (strncmp(argv[i], "--corpus_dir=", 13) == 0)
+            g_bench_options.corpus_dir = argv[i] + 13;
+        else if (strncmp(argv[i], "--log_mode=", 11) == 0)
+            g_bench_options.log_mode = argv[i] + 11;
+        else
+            argv[n++] = argv[i];
+    }
+    *argc = n;
+    argv[n] = NULL;
+}
+
+int main(int argc, char **argv)
+{
+    parse_args(&argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    if (!init_bench_log())
+    {
+        fprintf(stderr, "microbench: bad --log_mode=%s (sync|async|ring|binary)\n", g_bench_options.log_mode.c_str());
+        return 1;
+    }
+    register_http_benchmarks();
+
+    if (freopen("/dev/null", "w", stdout) == NULL)
+        return 1;
+    benchmark::ConsoleReporter display;
+    display.SetOutputStream(&std::cerr);
+    display.SetErrorStream(&std::cerr);
+    benchmark::RunSpecifiedBenchmarks(&display);
+    benchmark::Shutdown();
+    return 0;
+}
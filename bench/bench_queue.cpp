@@ -0,0 +1,116 @@
+#include <string>
+#include <atomic>
+#include <sched.h>
+
+#include "bench.h"
+#include "../log/block_queue.h"
+#include "../threadpool/threadpool.h"
+
+/**
+ * 阻塞队列与线程池
+ *   BM_BlockQueuePushPop  : 单线程 push + pop（无竞争时锁和条件变量的开销）
+ *   BM_BlockQueueContended: 一半线程生产、一半线程消费，元素为一行日志大小的 string
+ *   BM_ThreadPoolAppend   : 主线程 append，N 个工作线程取出并执行（空任务），测量持续的派发吞吐
+ */
+
+static const std::string g_log_line(120, 'x');
+
+static void BM_BlockQueuePushPop(benchmark::State &state)
+{
+    BlockQueue<std::string> q(1000);
+    std::string item;
+    for (auto _ : state)
+    {
+        q.push(g_log_line);
+        q.pop(item);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BlockQueuePushPop);
+
+static BlockQueue<std::string> *g_contended_queue = NULL;
+
+static void BM_BlockQueueContended(benchmark::State &state)
+{
+    if (state.thread_index() == 0)
+        g_contended_queue = new BlockQueue<std::string>(1000);
+
+    // 偶数线程生产，奇数线程消费；各线程迭代次数相同，生产和消费的数量相等
+    bool producer = state.thread_index() % 2 == 0;
+    std::string item;
+    for (auto _ : state)
+    {
+        if (producer)
+        {
+            while (!g_contended_queue->push(g_log_line))
+                sched_yield();  // 队列满
+        }
+        else
+        {
+            while (!g_contended_queue->pop(item, 100))
+                ;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0)
+    {
+        // 所有线程结束后才进入下一组，此时队列已空
+        delete g_contended_queue;
+        g_contended_queue = NULL;
+    }
+}
+BENCHMARK(BM_BlockQueueContended)->ThreadRange(2, 8)->UseRealTime();
+
+// 线程池任务：只计数
+struct BenchRequest
+{
+    int m_state;
+    int improv;
+    int timer_flag;
+    std::atomic<long> *done;
+
+    bool read_once() { return true; }
+    void save_read_progress() {}
+    bool write() { return true; }
+    void process() { done->fetch_add(1, std::memory_order_relaxed); }
+    void shed() {}
+    void trace_mark(int, uint64_t = 0) {}
+};
+
+static void BM_ThreadPoolAppend(benchmark::State &state)
+{
+    // 线程池的工作线程不会退出，每种线程数只创建一个，进程结束前不销毁
+    static ThreadPool<BenchRequest> *pools[65] = {NULL};
+    static std::atomic<long> done[65];
+    int threads = state.range(0);
+    if (pools[threads] == NULL)
+        pools[threads] = new ThreadPool<BenchRequest>(2, threads, 10000);
+    ThreadPool<BenchRequest> *pool = pools[threads];
+
+    // 同一个请求对象可以重复入队（任务只做计数）
+    BenchRequest req;
+    req.m_state = 0;
+    req.improv = 0;
+    req.timer_flag = 0;
+    req.done = &done[threads];
+    long start = done[threads].load();
+    long appended = 0;
+    long rejected = 0;
+    for (auto _ : state)
+    {
+        while (!pool->append_p(&req))
+        {
+            ++rejected;     // 队列满
+            sched_yield();
+        }
+        ++appended;
+    }
+    // 等待所有任务执行完，计入测量时间
+    while (done[threads].load() - start < appended)
+        sched_yield();
+
+    state.SetItemsProcessed(appended);
+    state.counters["queue_full"] = benchmark::Counter(rejected, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ThreadPoolAppend)->Arg(1)->Arg(4)->Arg(8)->UseRealTime();
@@ -0,0 +1,109 @@
+#include <vector>
+
+#include "bench.h"
+#include "../timer/lst_timer.h"
+
+/**
+ * 升序定时器链表 sort_timer_list，N 个定时器（10k ~ 1M，即同时在线的连接数）
+ *   BM_TimerAdjust : 随机一个连接有读写，超时时间顺延到最晚（与 WebServer::adjust_timer 相同），链表向后查找插入位置
+ *   BM_TimerAddDel : 新连接加入定时器（超时时间最晚，插入到表尾）后删除
+ *   BM_TimerTick   : N 个定时器全部到期，一次 tick 全部处理（每个定时器的开销）
+ * 建表按超时时间从大到小插入，每次插在表头，不计入测量
+ */
+
+static void noop_cb(client_data *)
+{
+}
+
+static util_timer *new_timer(client_data *data, time_t expire)
+{
+    util_timer *t = new util_timer;
+    t->user_data = data;
+    t->cb_func = noop_cb;
+    t->expire = expire;
+    return t;
+}
+
+/* 建立 n 个超时时间为 base, base+1, ... 的定时器 */
+static void build_list(sort_timer_list &lst, std::vector<util_timer *> &timers, std::vector<client_data> &users, time_t base)
+{
+    for (size_t i = timers.size(); i-- > 0;)
+    {
+        timers[i] = new_timer(&users[i], base + (time_t)i);
+        users[i].timer = timers[i];
+        lst.add_timer(timers[i]);
+    }
+}
+
+static uint64_t next_rand(uint64_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+static void BM_TimerAdjust(benchmark::State &state)
+{
+    size_t n = state.range(0);
+    sort_timer_list lst;
+    std::vector<util_timer *> timers(n);
+    std::vector<client_data> users(n);
+    time_t base = Clock::getInstance()->mono_sec() + 3600;
+    build_list(lst, timers, users, base);
+
+    time_t latest = base + (time_t)n;
+    uint64_t rng = 88172645463325252ULL;
+    for (auto _ : state)
+    {
+        util_timer *t = timers[next_rand(rng) % n];
+        t->expire = latest++;
+        lst.adjust_timer(t);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerAdjust)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+static void BM_TimerAddDel(benchmark::State &state)
+{
+    size_t n = state.range(0);
+    sort_timer_list lst;
+    std::vector<util_timer *> timers(n);
+    std::vector<client_data> users(n);
+    time_t base = Clock::getInstance()->mono_sec() + 3600;
+    build_list(lst, timers, users, base);
+
+    client_data user;
+    time_t latest = base + (time_t)n;
+    for (auto _ : state)
+    {
+        util_timer *t = new_timer(&user, latest++);
+        lst.add_timer(t);
+        lst.del_timer(t);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerAddDel)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+static void BM_TimerTick(benchmark::State &state)
+{
+    size_t n = state.range(0);
+    std::vector<util_timer *> timers(n);
+    std::vector<client_data> users(n);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        sort_timer_list *lst = new sort_timer_list;
+        Clock::getInstance()->update();
+        build_list(*lst, timers, users, Clock::getInstance()->mono_sec() - (time_t)n);
+        state.ResumeTiming();
+
+        lst->tick();
+
+        state.PauseTiming();
+        delete lst;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_TimerTick)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
@@ -3,7 +3,7 @@
 Config::Config()
 {
     Port = 9006;        // server默认监听端口号：9006
-    LogWrite = 0;       // 日志写入方式，默认同步
+    LogWrite = 0;       // 日志写入方式，默认同步（0:同步 1:异步 2:每线程环形缓冲区 3:二进制）
     TrigMode = 0;       // 触发组合模式,默认listenfd LT + connfd LT
     ListenTrigMode = 0; // listenfd触发模式，默认LT
     ConnTrigMode = 0;   // connfd触发模式，默认LT
@@ -12,12 +12,27 @@ Config::Config()
     thread_num = 8;     // 线程池内的线程数量,默认8
     close_log = 0;      // 关闭日志,默认不关闭
     actor_model = 0;    // 并发模型,默认是proactor
+    log_level = 0;      // 运行时日志级别,默认DEBUG（全部记录）
+    log_compress = 0;   // 压缩切分后的日志文件,默认不压缩
+    user_snapshot = 0;  // 用户表快照文件,默认不使用
+    async_db = 0;       // 非阻塞数据库连接数量,默认0（同步查询）
+    register_batch = 0; // 注册批量提交的最大行数,默认0（逐条插入）
+    user_store = 0;     // 用户存储后端,默认MySQL
+    metrics_port = 0;   // 指标抓取端口,默认0（不启用）
+    trace_slow_ms = 0;  // 阶段耗时追踪,默认0（不追踪）
+    shm_stats_ms = 0;   // 共享内存统计段,默认0（不发布）
+    codel_target_ms = 0; // 排队时间目标值,默认0（不按排队时间丢弃）
+    ip_max_conns = 0;   // 单IP并发连接数上限,默认0（不限制）
+    ip_rate = 0;        // 单IP每秒请求数,默认0（不限制）
+    accept_budget = 64; // 每轮事件循环最多接受的连接数,默认64
+    listen_backlog = 1024; // 全连接队列长度,默认1024
+    defer_accept = 0;   // 延迟接受,默认0（不使用）
 }
 
 
 /** argc、argv 从 main() 传递而来
 ./server [-p port] [-l LOGWrite] [-m TRIGMode] [-o OPT_LINGER] [-s sql_num] 
-            [-t thread_num] [-c close_log] [-a actor_model]
+            [-t thread_num] [-c close_log] [-a actor_model] [-L log_level]
             
 ./server -p 9007 -l 1 -m 0 -o 1 -s 10 -t 10 -c 1 -a 1
 
@@ -25,7 +40,7 @@ Config::Config()
 void Config::parse_arg(int argc, char *argv[])
 {
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:L:z:u:q:b:d:M:T:S:C:I:R:A:B:D:";
     // 一个冒号表示p选项后必须有参数，没有参数就会报错。例如 -p argstr, 如果只有-p, 没有选项参数，报错
 
     // optarg：如果某个选项有参数，这包含当前选项的参数字符串
@@ -74,6 +89,81 @@ void Config::parse_arg(int argc, char *argv[])
             actor_model = atoi(optarg);  // 并发模型
             break;
         }
+        case 'L':
+        {
+            log_level = atoi(optarg);   // 运行时日志级别
+            break;
+        }
+        case 'z':
+        {
+            log_compress = atoi(optarg);    // 压缩切分后的日志文件
+            break;
+        }
+        case 'u':
+        {
+            user_snapshot = atoi(optarg);   // 用户表快照文件
+            break;
+        }
+        case 'q':
+        {
+            async_db = atoi(optarg);    // 非阻塞数据库连接数量
+            break;
+        }
+        case 'b':
+        {
+            register_batch = atoi(optarg);  // 注册批量提交的最大行数
+            break;
+        }
+        case 'd':
+        {
+            user_store = atoi(optarg);  // 用户存储后端
+            break;
+        }
+        case 'M':
+        {
+            metrics_port = atoi(optarg);    // 指标抓取端口
+            break;
+        }
+        case 'T':
+        {
+            trace_slow_ms = atoi(optarg);   // 阶段耗时追踪，慢请求日志阈值
+            break;
+        }
+        case 'S':
+        {
+            shm_stats_ms = atoi(optarg);    // 共享内存统计段的发布间隔
+            break;
+        }
+        case 'C':
+        {
+            codel_target_ms = atoi(optarg); // 排队时间目标值（CoDel）
+            break;
+        }
+        case 'I':
+        {
+            ip_max_conns = atoi(optarg);    // 单IP并发连接数上限
+            break;
+        }
+        case 'R':
+        {
+            ip_rate = atoi(optarg);         // 单IP每秒请求数
+            break;
+        }
+        case 'A':
+        {
+            accept_budget = atoi(optarg);   // 每轮事件循环最多接受的连接数
+            break;
+        }
+        case 'B':
+        {
+            listen_backlog = atoi(optarg);  // 全连接队列长度
+            break;
+        }
+        case 'D':
+        {
+            defer_accept = atoi(optarg);    // 延迟接受的最长等待
+            break;
+        }
         default:
             break;
         }
@@ -13,7 +13,7 @@ public:
 
     void parse_arg(int argc, char *argv[]); 
     int Port;           // 端口号
-    int LogWrite;       // 日志写入方式（同步异步）
+    int LogWrite;       // 日志写入方式（同步、异步、每线程环形缓冲区）
     int TrigMode;       // 触发模式
     int ListenTrigMode; // listenfd触发模式
     int ConnTrigMode;   // connfd触发模式
@@ -22,6 +22,21 @@ public:
     int thread_num;     // 线程池数量
     int close_log;      // 是否关闭日志
     int actor_model;    // 并发模型
+    int log_level;      // 运行时日志级别
+    int log_compress;   // 是否压缩切分后的日志文件
+    int user_snapshot;  // 是否使用用户表快照文件
+    int async_db;       // 非阻塞数据库连接数量
+    int register_batch; // 注册批量提交的最大行数
+    int user_store;     // 用户存储后端
+    int metrics_port;   // 指标抓取端口（0：不启用）
+    int trace_slow_ms;  // 阶段耗时追踪，慢请求日志阈值（毫秒，0：不追踪）
+    int shm_stats_ms;   // 共享内存统计段的发布间隔（毫秒，0：不发布）
+    int codel_target_ms; // 排队时间目标值，持续超过时回复 503（毫秒，0：不按排队时间丢弃）
+    int ip_max_conns;   // 单IP并发连接数上限（0：不限制）
+    int ip_rate;        // 单IP每秒请求数，超过时回复 429（0：不限制）
+    int accept_budget;  // 每轮事件循环最多接受的连接数
+    int listen_backlog; // listen 的全连接队列长度
+    int defer_accept;   // 延迟接受：客户端发来数据才通知 accept（秒，0：不使用）
 };
 
 #endif // ! CONFIG_H
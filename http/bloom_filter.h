@@ -0,0 +1,96 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * 分块布隆过滤器（blocked Bloom filter）：用户名是否“一定不存在”
+ * 每个键的 BLOOM_HASHES 个位都落在同一个64字节块（一个缓存行）内，查询只访问一次内存
+ * 置位用原子 fetch_or，多个线程可以同时添加、查询，不加锁
+ * 每个键约 BLOOM_BITS_PER_KEY 位，容量以内误判率约 1%；超过容量后误判率升高但不会漏判
+ */
+class BloomFilter
+{
+public:
+    static const int BLOOM_BITS_PER_KEY = 10;
+    static const int BLOOM_HASHES = 7;
+
+    explicit BloomFilter(size_t capacity)
+    {
+        // 块数取2的幂，下标用 & 代替取模
+        size_t bits = capacity * BLOOM_BITS_PER_KEY;
+        size_t blocks = 1;
+        while (blocks * 512 < bits)
+        {
+            blocks <<= 1;
+        }
+        m_mask = blocks - 1;
+        m_capacity = blocks * 512 / BLOOM_BITS_PER_KEY;
+        m_blocks = new Block[blocks];
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            for (int j = 0; j < 8; ++j)
+            {
+                m_blocks[i].word[j].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ~BloomFilter()
+    {
+        delete[] m_blocks;
+    }
+
+    /* 能容纳的键数（误判率仍在设计值以内）*/
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    /* 添加一个键（h 为键的64位哈希值）*/
+    void add(uint64_t h)
+    {
+        Block &b = m_blocks[(h >> 32) & m_mask];
+        uint64_t bits = remix(h);
+        for (int i = 0; i < BLOOM_HASHES; ++i, bits >>= 9)
+        {
+            b.word[(bits >> 6) & 7].fetch_or(1ULL << (bits & 63), std::memory_order_relaxed);
+        }
+    }
+
+    /* false：一定不存在；true：可能存在 */
+    bool might_contain(uint64_t h) const
+    {
+        const Block &b = m_blocks[(h >> 32) & m_mask];
+        uint64_t bits = remix(h);
+        for (int i = 0; i < BLOOM_HASHES; ++i, bits >>= 9)
+        {
+            if (!(b.word[(bits >> 6) & 7].load(std::memory_order_relaxed) & (1ULL << (bits & 63))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // 块内位置用另一组哈希位，与选块的位无关
+    static uint64_t remix(uint64_t h)
+    {
+        h *= 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+    }
+
+    struct alignas(64) Block
+    {
+        std::atomic<uint64_t> word[8];  // 512位
+    };
+
+    Block *m_blocks;
+    size_t m_mask;
+    size_t m_capacity;
+};
+
+#endif // !BLOOM_FILTER_H
@@ -3,6 +3,8 @@
 #include <mysql/mysql.h>
 #include <fstream>
 
+#include "../metrics/probes.h"
+
 /* 定义HTTP响应的一些状态信息 */
 const char *ok_200_title = "OK";
 /* */
@@ -14,57 +16,129 @@ const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the requested file.\n";
+const char *error_503_title = "Service Unavailable";
+const char *error_503_form = "The server is overloaded, please try again later.\n";
+const char *error_429_title = "Too Many Requests";
+const char *error_429_form = "Too many requests from your address, please slow down.\n";
+const int retry_after_sec = 1;  /* 503、429 响应建议客户端重试的间隔（秒）*/
+
+/* 拒绝请求的完整响应报文：启动时生成一次，回复时只复制到写缓冲区，不格式化、不取时间 */
+static int build_reject_response(char *buf, int size, int status, const char *title, const char *form)
+{
+    return snprintf(buf, size, "HTTP/1.1 %d %s\r\nContent-length: %d\r\nRetry-After: %d\r\nConnection: close\r\n\r\n%s",
+                    status, title, (int)strlen(form), retry_after_sec, form);
+}
+static char overload_response[256];
+static const int overload_response_len =
+    build_reject_response(overload_response, sizeof(overload_response), 503, error_503_title, error_503_form);
+static char rate_limit_response[256];
+static const int rate_limit_response_len =
+    build_reject_response(rate_limit_response, sizeof(rate_limit_response), 429, error_429_title, error_429_form);
 
-/* 全局变量 */
-MutexLocker m_lock;
-map<string, string> users_map;  /* 保存所有用户名和密码 */
+/* 保存所有用户名和密码：分片并发哈希表，登录查找不加锁 */
+static UserTable *users_table = UserTable::getInstance();
 
 // /* 网站的根目录 */
 // const char *doc_root = "/var/www/html";
 
 
-/* 初始化数据库读取表 */
-void http_conn::initmysql_result(ConnectionPool *connPool)
+/* 用户存储后端（MySQL、日志文件或纯内存）*/
+static UserStore *user_store = NULL;
+
+/* 后台加载线程的参数 */
+struct UserLoadArg
 {
-    // 先取出1个连接（数据库连接池）
-    MYSQL *mysql = NULL;
-    ConnectionRAII mysqlcon(&mysql, connPool);
+    string snapshot;        // 快照文件路径（空表示不使用快照）
+    uint64_t position;      // 快照对应的存储后端位置
+    int close_log;
+};
 
-    // 在数据库的user表中，检索username, passwd数据，浏览器端输入
-    if (mysql_query(mysql, "SELECT username,passwd FROM user"))
-    {   
-        LOG_ERROR("SELECT Error:%s\n", mysql_error(mysql));
+/* 后台线程：从存储后端读取全部用户，写入用户表 */
+static void *load_users_thread(void *arg)
+{
+    UserLoadArg *load = (UserLoadArg *)arg;
+    int m_close_log = load->close_log;
+    uint64_t position = load->position;
+    bool ok = user_store->load(users_table, &position);
+
+    // 加载完成后不再需要回查存储后端
+    users_table->set_ready();
+
+    if (ok && !load->snapshot.empty() && !users_table->save_snapshot(load->snapshot.c_str(), position))
+    {
+        LOG_ERROR("save user snapshot %s failed", load->snapshot.c_str());
     }
-    // 从表中检索 完整的结果集
-    MYSQL_RES* result = mysql_store_result(mysql);
+    delete load;
+    return NULL;
+}
 
-    // 返回结果集中的列数(字段数)
-    int num_fields = mysql_num_fields(result);
+/* 初始化用户表：先映射快照（可选），再由后台线程从存储后端加载，服务器无需等待加载完成即可开始监听 */
+void http_conn::init_user_store(UserStore *store, int close_log, const char *snapshot)
+{
+    user_store = store;
 
-    // 返回所有字段结构的数组
-    MYSQL_FIELD *fields = mysql_fetch_fields(result);
+    UserLoadArg *load = new UserLoadArg;
+    load->snapshot = snapshot ? snapshot : "";
+    load->position = 0;
+    load->close_log = close_log;
+    int m_close_log = close_log;    // 调用时连接对象尚未 init
 
-    // 从结果集中获取下一行，将所有用户对应的用户名和密码，存入users_map中
-    while (MYSQL_ROW row = mysql_fetch_row(result))
+    if (snapshot && users_table->attach_snapshot(snapshot, &load->position))
     {
-        string temp1(row[0]);   /*username*/
-        string temp2(row[1]);   /*password*/
-        users_map[temp1] = temp2;
+        LOG_INFO("user snapshot %s: %lu users, position %llu", snapshot, (unsigned long)users_table->size(), (unsigned long long)load->position);
     }
-    
+    LOG_INFO("user store: %s", store->name());
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, load_users_thread, load) != 0)
+    {
+        load_users_thread(load);    // 创建线程失败时同步加载
+        return;
+    }
+    pthread_detach(tid);
+}
+
+/* 加载完成前用户表中查不到的用户，回查存储后端（查到后写入用户表）*/
+static bool query_user(const char *name)
+{
+    char password[100];
+    if (user_store->find(name, password, sizeof(password)) != 1)
+    {
+        return false;
+    }
+    users_table->insert(name, password);
+    return true;
+}
+
+/* 非阻塞查询的SQL（非阻塞连接上不使用预处理语句，参数经转义后拼接）*/
+static void select_user_sql(char *sql, size_t size, const char *name)
+{
+    char esc_name[2 * 100];
+    AsyncDB::getInstance()->escape(esc_name, name);
+    snprintf(sql, size, "SELECT username,passwd FROM user WHERE username='%s' LIMIT 1", esc_name);
 }
 
-/* 将文件描述符设置成 非阻塞 */
-int setNonBlocking(int fd)
+static void insert_user_sql(char *sql, size_t size, const char *name, const char *password)
 {
-    int old_option = fcntl(fd, F_GETFL);
-    int new_option = old_option | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_option);
-    return old_option;
+    char esc_name[2 * 100], esc_password[2 * 100];
+    AsyncDB::getInstance()->escape(esc_name, name);
+    AsyncDB::getInstance()->escape(esc_password, password);
+    snprintf(sql, size, "INSERT INTO user(username, passwd) VALUES('%s', '%s')", esc_name, esc_password);
 }
 
+/* 查询结果中的用户写入用户表，返回是否查到 */
+static bool insert_user_row(MYSQL_RES *result)
+{
+    MYSQL_ROW row = result ? mysql_fetch_row(result) : NULL;
+    if (row)
+    {
+        users_table->insert(row[0], row[1]);
+    }
+    return row != NULL;
+}
 
-/** 将内核事件表epollfd 注册 fd， 监听 可读 | TCP连接被对方关闭 事件，将 fd 设为非阻塞
+/** 将内核事件表epollfd 注册 fd， 监听 可读 | TCP连接被对方关闭 事件
+ * fd 由 accept4(SOCK_NONBLOCK) 创建，已经是非阻塞的，不需要再调用 fcntl
  * TRIGMode ：1 ET ； 0 LT
  * one_shot ：1 EPOLLONESHOT ； 0： 
  *      fd最多触发1次注册的事件(直到重置epoll_ctl重新注册EPOLLONESHOT事件)
@@ -84,7 +158,6 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
         event.events |= EPOLLONESHOT;
 
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setNonBlocking(fd); 
 }
  
 
@@ -117,7 +190,8 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
 
 
 /*类静态数据成员，必须在类外部定义和初始化*/
-int http_conn::m_user_count = 0; /* 统计用户数量 */
+std::atomic<int> http_conn::m_user_count(0); /* 统计用户数量 */
+int http_conn::m_trace_slow_ms = 0;
 int http_conn::m_epollfd = -1;
 
 
@@ -128,6 +202,7 @@ void http_conn::close_conn(bool real_close)
     {
         printf("close %d\n", m_sockfd);
         removefd(m_epollfd, m_sockfd);
+        TWS_PROBE1(conn__close, m_sockfd);
         m_sockfd = -1;      /* connfd = accept() */
         m_user_count--;     /* 关闭一个连接时，将客户数总量-1 */
     }
@@ -143,12 +218,14 @@ void http_conn::init(int connfd, const sockaddr_in &client_address, char *root,
 {
     m_sockfd = connfd;  /* 发起连接的客户端socket */
     m_address = client_address;
+    m_conn_gen++;
+    TWS_PROBE2(conn__init, connfd, m_conn_gen);
 
     /* 地址复用，避免TIME_WAIT状态，仅用于调试，实际使用时应该去掉 */
     // int reuse = 1;
     // setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
-    /* 注册fd， 监听 可读 + 对方关闭TCP连接 事件，设为非阻塞 + EPOLLONESHOT */
+    /* 注册fd， 监听 可读 + 对方关闭TCP连接 事件 + EPOLLONESHOT（accept4 已设为非阻塞）*/
     addfd(m_epollfd, connfd, true, m_TRIGMode);
     m_user_count++;
 
@@ -167,7 +244,6 @@ void http_conn::init(int connfd, const sockaddr_in &client_address, char *root,
 /* 初始化连接 */
 void http_conn::init()
 {
-    mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
 
@@ -186,6 +262,14 @@ void http_conn::init()
 
     cgi = 0;
     m_state = 0;
+    m_route = R_OTHER;
+    m_status = 0;
+    m_start_us = 0;
+    m_body_start_us = 0;
+    m_saved_start_us = 0;
+    m_saved_body_start_us = 0;
+    m_saved_bytes = 0;
+    memset(m_trace, 0, sizeof(m_trace));
     timer_flag = 0;  /* 0：定时器已删除，解绑客户端连接 1:定时器正绑定客户端连接*/
     improv = 0;
 
@@ -272,10 +356,15 @@ bool http_conn::read_once()
         {
             return false;
         }
+        if (0 == m_start_us)
+            m_start_us = metrics_now_us();
+        Metrics::getInstance()->inc(M_BYTES_IN, bytes_read);
+        trace_mark(TRACE_READ);
         return true;
     }
     else // ET模式（循环读取数据，以确保socket读缓存中的所有数据读出）
     {
+        long start_idx = m_read_idx;
         while (true)
         {
             bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
@@ -293,6 +382,13 @@ bool http_conn::read_once()
             }
             m_read_idx += bytes_read;
         }
+        if (m_read_idx > start_idx)
+        {
+            if (0 == m_start_us)
+                m_start_us = metrics_now_us();
+            Metrics::getInstance()->inc(M_BYTES_IN, m_read_idx - start_idx);
+            trace_mark(TRACE_READ);
+        }
         return true;
     } 
 }
@@ -367,6 +463,17 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     //当url为/时，显示判断界面
     if (strlen(m_url) == 1)
         strcat(m_url, "judge.html");
+
+    // 运行指标的路由：与 do_request、do_file_request 的分支对应
+    char flag = *(strrchr(m_url, '/') + 1);
+    if (cgi == 1 && flag == '2')
+        m_route = R_LOGIN;
+    else if (cgi == 1 && flag == '3')
+        m_route = R_REGISTER;
+    else if (flag == '0' || flag == '1' || flag == '5' || flag == '6' || flag == '7')
+        m_route = R_PAGE;
+    else
+        m_route = R_STATIC;
         
     /* HTTP请求行处理完毕，状态转移到头部字段分析 */
     m_check_state = CHECK_STATE_HEADER;
@@ -383,13 +490,14 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
         if (m_content_length != 0)
         {
             m_check_state = CHECK_STATE_CONTENT;
+            m_body_start_us = metrics_now_us();
             return NO_REQUEST;
         }
         /* 否则：已经得到了一个完整的HTTP请求 */
         return GET_REQUEST;
     }
     /* Connection */
-    else if (strncasecmp(text, "Connetction:", 11) == 0)
+    else if (strncasecmp(text, "Connection:", 11) == 0)
     {
         text += 11;
         text += strspn(text, " \t");
@@ -479,7 +587,7 @@ http_conn::HTTP_CODE http_conn::process_read()
                 return BAD_REQUEST;
             else if (ret == GET_REQUEST)
             {
-                return do_request();
+                return request_complete();
             }
             break;
         /* 分析请求数据 */
@@ -487,7 +595,7 @@ http_conn::HTTP_CODE http_conn::process_read()
             ret = parse_content(text);
             if (ret == GET_REQUEST)
             {
-                return do_request();
+                return request_complete();
             }
             line_status = LINE_OPEN;
             break;
@@ -499,11 +607,23 @@ http_conn::HTTP_CODE http_conn::process_read()
 }
 
 
+/* 解析出完整的请求，执行 do_request（USDT 探针标记解析完成、do_request 开始和结束）*/
+http_conn::HTTP_CODE http_conn::request_complete()
+{
+    TWS_PROBE4(request__parsed, m_sockfd, (int)m_method, m_url, m_content_length);
+    TWS_PROBE2(do_request__start, m_sockfd, m_url);
+    HTTP_CODE ret = do_request();
+    TWS_PROBE3(do_request__end, m_sockfd, (int)ret, m_url);
+    return ret;
+}
+
 /** 当得到一个完整、正确的HTTP请求时，就分析目标文件的属性。
  * 如果目标文件存在、对所有用户可读，且不是目录，则是用mmap将其映射到内存地址m_file_address处，并告诉调用者获取文件成功
  */
 http_conn::HTTP_CODE http_conn::do_request()
 {
+    trace_mark(TRACE_PARSED);
+
     // const char *doc_root = "/var/www/html";     /* 网站的根目录 */
     // char *m_url;                    /* 客户请求的目标文件的文件名 */
     // char m_real_file[FILENAME_LEN]; /* 客户请求的目标文件的完整路径，其内容等于doc_root + m_url, */
@@ -515,9 +635,6 @@ http_conn::HTTP_CODE http_conn::do_request()
     //处理cgi (启用POST)
     if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
     {
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
         char *m_url_real = (char *)malloc(sizeof(char) * 200);
         strcpy(m_url_real, "/");
         strcat(m_url_real, m_url + 2);
@@ -526,17 +643,57 @@ http_conn::HTTP_CODE http_conn::do_request()
 
         //将用户名和密码提取出来
         //user=123&passwd=123
+        //超出缓冲区的部分截断，缺少字段时为空串
         char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
+        int i, j = 0;
+        for (i = 5; i < m_content_length && m_string[i] != '&' && m_string[i] != '\0'; ++i)
+            if (j < (int)sizeof(name) - 1)
+                name[j++] = m_string[i];
+        name[j] = '\0';
+
+        j = 0;
+        for (i = i + 10; i < m_content_length && m_string[i] != '\0'; ++i)
+            if (j < (int)sizeof(password) - 1)
+                password[j++] = m_string[i];
         password[j] = '\0';
 
+        // 非阻塞数据库：需要查询时提交后立即返回，工作线程不等待数据库往返
+        if (AsyncDB::getInstance()->enabled())
+        {
+            strcpy(m_user_name, name);
+            strcpy(m_user_password, password);
+            char sql[512];
+
+            if (*(p + 1) == '3')
+            {
+                // 用户表尚未加载完成且表中没有该用户名时，先查询数据库是否重名
+                if (!users_table->ready() && !users_table->contains(name))
+                {
+                    select_user_sql(sql, sizeof(sql), name);
+                    return submit_query(sql, true, on_register_select);
+                }
+                if (users_table->insert(name, password, true))
+                {
+                    insert_user_sql(sql, sizeof(sql), name, password);
+                    return submit_query(sql, false, on_register_insert);
+                }
+                strcpy(m_url, "/registerError.html");
+            }
+            else
+            {
+                if (users_table->check(name, password))
+                    strcpy(m_url, "/welcome.html");
+                else if (!users_table->ready())
+                {
+                    select_user_sql(sql, sizeof(sql), name);
+                    return submit_query(sql, true, on_login_select);
+                }
+                else
+                    strcpy(m_url, "/logError.html");
+            }
+            return do_file_request();
+        }
+
         // 注册
         // /3  CGISQL.cgi
         //  POST请求，进行注册校验
@@ -546,49 +703,57 @@ http_conn::HTTP_CODE http_conn::do_request()
         {
             //如果是注册，先检测数据库中是否有重名的
             //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            // "INSERT INTO user(username, passwd) VALUES(‘name’, ‘password')
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            // 未发现重名用户
-            if (users_map.find(name) == users_map.end())
+            // 未发现重名用户：插入用户表（只锁所在分片），同名的并发注册只有一个成功
+            // 用户表尚未加载完成时，先回查存储后端是否重名；表中已有（快照或已加载部分）时不必回查
+            // 加载完成后用户表是完整的：布隆过滤器判定一定不存在的新用户名直接插入，不探测槽位，随后写入存储后端（可批量）
+            // 写入存储后端之前用户是待确认的，不写入快照；写入失败时从用户表删除
+            if ((users_table->ready() || users_table->contains(name) || !query_user(name)) && users_table->insert(name, password, true))
             {
-                m_lock.lock();
-                // 向数据库中添加 用户名、密码
-                int res = mysql_query(mysql, sql_insert);
-                users_map.insert(pair<string, string>(name, password));
-                m_lock.unlock();
+                // 向存储后端添加 用户名、密码
+                int res = user_store->insert(name, password);
 
                 // 成功：返回0  错误：返回非0值
                 if (!res)
+                {
+                    users_table->commit(name);
                     strcpy(m_url, "/log.html"); // 登录界面
+                }
                 else
+                {
+                    users_table->erase(name);
                     strcpy(m_url, "/registerError.html"); // 注册错误
+                }
             }
             // 已有重名用户
             else
                 strcpy(m_url, "/registerError.html");
         }
         // 登录，直接判断
-        // 若浏览器端输入的用户名和密码在users_map中可以查找到，返回1，否则返回0
+        // 若浏览器端输入的用户名和密码在用户表中可以查找到，返回1，否则返回0
         // ●/2  CGISQL.cgi
         //  POST请求，进行登录校验
         //  验证成功跳转到welcome.html，即资源请求成功页面
         //  验证失败跳转到logError.html，即登录失败页面
         else if (*(p + 1) == '2')
         {
-            if (users_map.find(name) != users_map.end() && users_map[name] == password)
+            if (users_table->check(name, password) ||
+                (!users_table->ready() && query_user(name) && users_table->check(name, password)))
                 strcpy(m_url, "/welcome.html");
             else
                 strcpy(m_url, "/logError.html");
         }
     }
 
+    return do_file_request();
+}
+
+/* 按 m_url 映射目标文件（登录、注册的结果页面在数据库查询完成后确定）*/
+http_conn::HTTP_CODE http_conn::do_file_request()
+{
+    strcpy(m_real_file, doc_root);
+    int len = strlen(doc_root);
+    const char *p = strrchr(m_url, '/');
+
     // /0 : POST请求，跳转到 register.html , 注册页面
     if (*(p + 1) == '0')
     {
@@ -657,7 +822,7 @@ http_conn::HTTP_CODE http_conn::do_request()
         // 打开文件失败
         printf("open error---------------------------\n");
     }
-    printf("open success: %s\n", *m_real_file);
+    printf("open success: %s\n", m_real_file);
 
     // PROT_READ ： 映射区的保护要求，只读打开
     // MAP_PRIVATE ： 私有映射，对存储区的修改只会修改文件副本，不影响源文件
@@ -716,6 +881,7 @@ bool http_conn::write()
 
         bytes_have_send += temp;
         bytes_to_send -= temp;
+        Metrics::getInstance()->inc(M_BYTES_OUT, temp);
 
         if (bytes_have_send >= m_iv[0].iov_len)
         {
@@ -733,6 +899,10 @@ bool http_conn::write()
         if (bytes_to_send <= 0)
         {
             /* 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接 */
+            Metrics::getInstance()->request(m_route, Metrics::status_index(m_status),
+                                            m_start_us ? metrics_now_us() - m_start_us : 0);
+            trace_finish();
+            TWS_PROBE3(write__done, m_sockfd, bytes_have_send, (int)m_linger);
             unmap();
             modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
 
@@ -784,6 +954,7 @@ bool http_conn::add_response(const char *format, ...)
 // 添加状态行
 bool http_conn::add_status_line(int status, const char *title)
 {
+    m_status = status;
     return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
 }
 
@@ -791,7 +962,7 @@ bool http_conn::add_status_line(int status, const char *title)
 // 添加消息报头，具体的添加文本长度、连接状态和空行
 bool http_conn::add_headers(int content_len)
 {
-    return add_content_length(content_len) && add_linger() && add_blank_line();
+    return add_content_length(content_len) && add_date() && add_linger() && add_blank_line();
 }
 
 
@@ -801,6 +972,14 @@ bool http_conn::add_content_length(int content_len)
     return add_response("Content-length: %d\r\n", content_len);
 }
 
+// 添加Date，取自时间缓存中预先格式化的 GMT 时间
+bool http_conn::add_date()
+{
+    ClockSnapshot now;
+    Clock::getInstance()->read(&now);
+    return add_response("Date: %s\r\n", now.http_date);
+}
+
 // 添加文本类型，这里是html
 bool http_conn::add_content_type()
 {
@@ -904,6 +1083,76 @@ bool http_conn::process_write(HTTP_CODE ret)
 }
 
 
+/**
+ * 按时间先后排列经过的时间点，相邻两点之差计入后一点对应阶段的直方图
+ * 总耗时（第一个时间点到响应写完）不少于 m_trace_slow_ms 时写一条 WARN 日志，列出全部阶段
+ */
+void http_conn::trace_finish()
+{
+    if (m_trace_slow_ms <= 0)
+        return;
+    trace_mark(TRACE_SENT);
+
+    int order[TRACE_MARK_NUM];
+    int n = 0;
+    for (int i = 0; i < TRACE_MARK_NUM; ++i)
+    {
+        if (0 == m_trace[i])
+            continue;
+        int j = n++;
+        while (j > 0 && m_trace[order[j - 1]] > m_trace[i])
+        {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+    if (n < 2)
+        return;
+
+    for (int k = 1; k < n; ++k)
+        Metrics::getInstance()->stage(order[k], m_trace[order[k]] - m_trace[order[k - 1]]);
+
+    uint64_t total = m_trace[order[n - 1]] - m_trace[order[0]];
+    if (total < (uint64_t)m_trace_slow_ms * 1000000)
+        return;
+    char stages[256];
+    int len = 0;
+    for (int k = 1; k < n && len < (int)sizeof(stages); ++k)
+        len += snprintf(stages + len, sizeof(stages) - len, " %s=%.3f", TRACE_STAGE_NAMES[order[k]],
+                        (m_trace[order[k]] - m_trace[order[k - 1]]) / 1e6);
+    LOG_WARN("slow request: fd %d %s %s total=%.3fms:%s", m_sockfd, POST == m_method ? "POST" : "GET",
+             m_url ? m_url : "-", total / 1e6, stages);
+}
+
+/**
+ * 拒绝请求，由主线程或工作线程调用：
+ *   503：过载保护，线程池队列已满，或排队时间持续超过目标值
+ *   429：客户端IP的请求速率超限
+ * 不解析请求，复制预先生成的响应并注册写事件，发送完成后关闭连接（Connection: close）
+ */
+void http_conn::shed(int status)
+{
+    if (429 == status)
+    {
+        memcpy(m_write_buf, rate_limit_response, rate_limit_response_len);
+        m_write_idx = rate_limit_response_len;
+    }
+    else
+    {
+        memcpy(m_write_buf, overload_response, overload_response_len);
+        m_write_idx = overload_response_len;
+        status = 503;
+    }
+    m_linger = false;
+    m_status = status;
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv_count = 1;
+    bytes_to_send = m_write_idx;
+    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+}
+
 /* 由线程池中的 工作线程调用，这是处理HTTP请求的入口函数 */
 void http_conn::process()
 {
@@ -914,6 +1163,13 @@ void http_conn::process()
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         return;
     }
+    // 等待非阻塞数据库查询，响应由主线程在查询完成后生成
+    if (read_ret == ASYNC_REQUEST)
+    {
+        return;
+    }
+
+    trace_mark(TRACE_HANDLED);
 
     // 返回给客户端
     bool write_ret = process_write(read_ret);
@@ -921,5 +1177,96 @@ void http_conn::process()
     {
         close_conn();
     }
+    trace_mark(TRACE_RESPONSE);
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
 }
+
+/* 非阻塞查询的回调参数：连接 + 提交时的连接代数 + 用户名（连接关闭后注册的插入结果仍需确认）*/
+struct AsyncArg
+{
+    http_conn *conn;
+    unsigned int gen;
+    char user_name[100];
+};
+
+/* 提交非阻塞查询，提交后工作线程不能再访问连接对象（回调可能已在主线程中执行）*/
+http_conn::HTTP_CODE http_conn::submit_query(const char *sql, bool need_result, AsyncQueryCallback cb)
+{
+    AsyncArg *arg = new AsyncArg;
+    arg->conn = this;
+    arg->gen = m_conn_gen;
+    strcpy(arg->user_name, m_user_name);
+    AsyncDB::getInstance()->submit(sql, need_result, cb, arg);
+    return ASYNC_REQUEST;
+}
+
+/* 回调中取出发起查询的连接，连接已关闭（或fd已被新连接复用）时返回NULL */
+http_conn *http_conn::async_target(void *arg)
+{
+    AsyncArg *async = (AsyncArg *)arg;
+    http_conn *conn = async->conn;
+    bool alive = (async->gen == conn->m_conn_gen && conn->m_sockfd != -1);
+    delete async;
+    return alive ? conn : NULL;
+}
+
+/* 主线程：查询完成，按结果页面生成响应并注册写事件 */
+void http_conn::finish_async(const char *url)
+{
+    strcpy(m_url, url);
+    HTTP_CODE ret = do_file_request();
+    trace_mark(TRACE_HANDLED);
+    if (!process_write(ret))
+    {
+        close_conn();
+        return;
+    }
+    trace_mark(TRACE_RESPONSE);
+    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+}
+
+/* 注册（用户表未加载完成）：数据库中没有重名用户才插入 */
+void http_conn::on_register_select(void *arg, int err, MYSQL_RES *result)
+{
+    http_conn *conn = async_target(arg);
+    bool found = insert_user_row(result);
+    if (conn == NULL)
+    {
+        return;
+    }
+    if (err || found || !users_table->insert(conn->m_user_name, conn->m_user_password, true))
+    {
+        conn->finish_async("/registerError.html");
+        return;
+    }
+    char sql_insert[512];
+    insert_user_sql(sql_insert, sizeof(sql_insert), conn->m_user_name, conn->m_user_password);
+    conn->submit_query(sql_insert, false, on_register_insert);
+}
+
+/* 注册：插入完成 */
+void http_conn::on_register_insert(void *arg, int err, MYSQL_RES * /*result*/)
+{
+    // 插入成功才确认用户（之后才会写入快照），失败时从用户表删除
+    const char *name = ((AsyncArg *)arg)->user_name;
+    if (err)
+        users_table->erase(name);
+    else
+        users_table->commit(name);
+    http_conn *conn = async_target(arg);
+    if (conn != NULL)
+    {
+        conn->finish_async(err ? "/registerError.html" : "/log.html");
+    }
+}
+
+/* 登录（用户表未加载完成）：数据库中查到的用户写入用户表后再校验 */
+void http_conn::on_login_select(void *arg, int /*err*/, MYSQL_RES *result)
+{
+    http_conn *conn = async_target(arg);
+    insert_user_row(result);
+    if (conn != NULL)
+    {
+        conn->finish_async(users_table->check(conn->m_user_name, conn->m_user_password) ? "/welcome.html" : "/logError.html");
+    }
+}
@@ -21,14 +21,21 @@
 #include <sys/wait.h>
 #include <sys/uio.h>
 #include <map>
+#include <atomic>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "../CGImysql/async_db.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "user_table.h"
+#include "user_store.h"
+#include "../metrics/metrics.h"
 
 class http_conn
 {
+    friend class HttpConnBench;     // bench/bench_http.cpp 直接驱动解析状态机
+
 public:
     static const int FILENAME_LEN = 200;       /* 文件名的最大长度 */
     static const int READ_BUFFER_SIZE = 2048;  /* 读缓冲区的大小 */
@@ -74,11 +81,12 @@ public:
         FORBIDDEN_REQUEST, // 客户对资源没有足够的访问权限
         FILE_REQUEST,      // 文件请求
         INTERNAL_ERROR,    // 服务器内部错误
-        CLOSED_CONNECTION  // 客户端已经关闭连接
+        CLOSED_CONNECTION, // 客户端已经关闭连接
+        ASYNC_REQUEST      // 已提交非阻塞数据库查询，查询完成后由主线程生成响应
     };
 
 public:
-    http_conn() {}
+    http_conn() : m_conn_gen(0) {}
     ~http_conn() {}
 
     /* 初始化 新接受的连接 */
@@ -87,6 +95,7 @@ public:
     void process();                          /* 处理客户请求 */
     bool read_once();                        /* 读取浏览器发来的全部数据，非阻塞读 */
     bool write();                            /* 响应报文写入，非阻塞写 */
+    void shed(int status = 503);             /* 拒绝请求：回复预先生成的 503（过载）或 429（限流），发送后关闭连接 */
 
     /* 获取此http连接的对方socket地址 */
     sockaddr_in *get_address()
@@ -94,7 +103,47 @@ public:
         return &m_address;
     }
 
-    void initmysql_result(ConnectionPool *connPool);
+    /* 当前请求是否已读入数据（false：下一个读事件是新请求的开始）*/
+    bool request_started()
+    {
+        return m_read_idx > 0;
+    }
+
+    /**
+     * 读取进度（慢速攻击防护）：当前请求第一个字节的时间、请求头解析完成的时间（微秒，0：仍在读请求头），
+     * 以及当前阶段已收到的字节数（请求头阶段为全部字节，消息体阶段为消息体字节）
+     */
+    void read_progress(uint64_t *start_us, uint64_t *body_start_us, long *bytes)
+    {
+        *start_us = m_start_us;
+        *body_start_us = CHECK_STATE_CONTENT == m_check_state ? m_body_start_us : 0;
+        *bytes = *body_start_us ? m_read_idx - m_checked_idx : m_read_idx;
+    }
+
+    /**
+     * 保存读取进度，主线程按保存的进度设置期限：reactor 模式下工作线程读完数据、置 improv 之前保存，
+     * 之后 process() 修改解析状态时主线程不再读取它们
+     */
+    void save_read_progress()
+    {
+        read_progress(&m_saved_start_us, &m_saved_body_start_us, &m_saved_bytes);
+    }
+    void saved_read_progress(uint64_t *start_us, uint64_t *body_start_us, long *bytes)
+    {
+        *start_us = m_saved_start_us;
+        *body_start_us = m_saved_body_start_us;
+        *bytes = m_saved_bytes;
+    }
+
+    /* 阶段耗时追踪：记录时间点 mark（每个请求只记录第一次），ns 为 0 时取当前时间 */
+    void trace_mark(int mark, uint64_t ns = 0)
+    {
+        if (m_trace_slow_ms > 0 && 0 == m_trace[mark])
+            m_trace[mark] = ns ? ns : metrics_now_ns();
+    }
+
+    /* 设置用户存储后端，后台加载用户表（可选快照文件）*/
+    void init_user_store(UserStore *store, int close_log, const char *snapshot = NULL);
 
     /**
      * 每个http连接有两个标志位：improv和timer_flag，初始时其值为0，它们只在Reactor模式下发挥作用。
@@ -103,7 +152,9 @@ public:
      * time_flag: 标识子线程读写任务是否成功。
      */
     int timer_flag; /* 置1: reactor模式下，工作线程读写错误，然后WebServer::dealwithread中断开用户的连接, 从链表中删除对应timer*/
-    int improv;     /* 置1: 标志着http连接的读写任务已完成（请求已处理完毕）*/
+    /* 置1: 标志着http连接的读写任务已完成（请求已处理完毕）；
+       原子变量，工作线程必须最后写它：先写 timer_flag、保存读取进度，再置1，看到1的主线程才能读到它们 */
+    std::atomic<int> improv;
 
 private:
     /* 初始化连接 */
@@ -119,7 +170,15 @@ private:
     HTTP_CODE parse_request_line(char *text);
     HTTP_CODE parse_headers(char *text);
     HTTP_CODE parse_content(char *text);
+    HTTP_CODE request_complete();
     HTTP_CODE do_request();
+    HTTP_CODE do_file_request();
+    HTTP_CODE submit_query(const char *sql, bool need_result, AsyncQueryCallback cb);
+    void finish_async(const char *url);
+    static http_conn *async_target(void *arg);
+    static void on_register_select(void *arg, int err, MYSQL_RES *result);
+    static void on_register_insert(void *arg, int err, MYSQL_RES *result);
+    static void on_login_select(void *arg, int err, MYSQL_RES *result);
     char *get_line() { return m_read_buf + m_start_line; };
     LINE_STATUS parse_line();
 
@@ -131,14 +190,17 @@ private:
     bool add_headers(int content_length);
     bool add_content_type();
     bool add_content_length(int content_length);
+    bool add_date();
     bool add_linger();
     bool add_blank_line(); // 添加空白线
 
+    void trace_finish();   /* 响应发送完成：阶段耗时计入直方图，超过阈值写慢请求日志 */
+
 public:
     /*类静态数据成员，必须在类外部定义和初始化*/
     static int m_epollfd;    /* 所有socket上的事件都被注册到同一个epoll内核事件表中 */
-    static int m_user_count; /* 统计用户数量 */
-    MYSQL *mysql;
+    static std::atomic<int> m_user_count; /* 统计用户数量（主线程、工作线程都会关闭连接）*/
+    static int m_trace_slow_ms; /* 阶段耗时追踪：0 不追踪；N 追踪，总耗时不少于 N 毫秒的请求写入慢请求日志 */
     int m_state;            /* 0：读， 1：写 */
 
 private:
@@ -181,6 +243,19 @@ private:
     char sql_user[100];
     char sql_passwd[100];
     char sql_name[100];
+
+    char m_user_name[100];     /* 非阻塞查询期间保存登录、注册的用户名和密码（m_read_buf 中的数据不再使用）*/
+    char m_user_password[100];
+    unsigned int m_conn_gen;   /* 连接代数：每接受一个新连接加1，丢弃属于已关闭连接的查询结果 */
+
+    int m_route;               /* 运行指标：请求路由 METRIC_ROUTE */
+    int m_status;              /* 运行指标：响应状态码 */
+    uint64_t m_start_us;       /* 运行指标：读到请求第一个字节的时间（微秒）*/
+    uint64_t m_body_start_us;  /* 请求头解析完成、开始读消息体的时间（微秒），用于消息体读取期限 */
+    uint64_t m_saved_start_us; /* save_read_progress 保存的读取进度 */
+    uint64_t m_saved_body_start_us;
+    long m_saved_bytes;
+    uint64_t m_trace[TRACE_MARK_NUM]; /* 阶段耗时追踪：各时间点（纳秒，0 表示未经过）*/
 };
 
 #endif // !HTTPCONNECTION_H
\ No newline at end of file
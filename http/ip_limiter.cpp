@@ -0,0 +1,170 @@
+#include "ip_limiter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const uint32_t TOKEN = 1000;    // 一个令牌（千分之一令牌为单位）
+
+IpLimiter::IpLimiter() : m_slots(NULL), m_mask(0), m_shift(32), m_count(0), m_max_conns(0), m_rate(0), m_capacity(0)
+{
+}
+
+IpLimiter::~IpLimiter()
+{
+    free(m_slots);
+}
+
+bool IpLimiter::init(int max_conns, int rate, int burst, size_t slots)
+{
+    size_t n = 1024;
+    int bits = 10;
+    while (n < slots && bits < 31)
+    {
+        n <<= 1;
+        ++bits;
+    }
+    m_slots = (IpBucket *)calloc(n, sizeof(IpBucket));
+    if (m_slots == NULL)
+        return false;
+    m_mask = n - 1;
+    m_shift = 32 - bits;
+    m_count = 0;
+
+    m_max_conns = max_conns > 0 ? max_conns : 0;
+    m_rate = rate > 0 ? rate : 0;
+    if (burst < 1)
+        burst = 1;
+    m_capacity = (uint32_t)burst * TOKEN;
+    return true;
+}
+
+/* 按距上次访问的时间补充令牌，不超过桶容量 */
+void IpLimiter::refill(IpBucket *b, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - b->last_ms;
+    b->last_ms = now_ms;
+    uint64_t tokens = b->tokens + (uint64_t)elapsed * m_rate;
+    b->tokens = tokens < m_capacity ? (uint32_t)tokens : m_capacity;
+}
+
+IpBucket *IpLimiter::find(uint32_t ip)
+{
+    for (size_t i = index(ip);; i = (i + 1) & m_mask)
+    {
+        if (m_slots[i].ip == ip)
+            return &m_slots[i];
+        if (m_slots[i].ip == 0)
+            return NULL;
+    }
+}
+
+/* 把记录放到 slots 中它的探测序列上的第一个空槽位 */
+IpBucket *IpLimiter::place(IpBucket *slots, const IpBucket &b)
+{
+    size_t i = index(b.ip);
+    while (slots[i].ip != 0)
+        i = (i + 1) & m_mask;
+    slots[i] = b;
+    return &slots[i];
+}
+
+IpBucket *IpLimiter::find_or_insert(uint32_t ip, uint32_t now_ms)
+{
+    IpBucket *b = find(ip);
+    if (b)
+    {
+        refill(b, now_ms);
+        return b;
+    }
+
+    if (m_count + 1 > (m_mask + 1) / 4 * 3)
+    {
+        sweep(now_ms);
+        // 清理失败（分配内存失败）且表已接近满：不再登记新IP，放行
+        if (m_count + 1 > (m_mask + 1) / 8 * 7)
+            return NULL;
+    }
+
+    IpBucket fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.ip = ip;
+    fresh.tokens = m_capacity;
+    fresh.last_ms = now_ms;
+    ++m_count;
+    return place(m_slots, fresh);
+}
+
+/**
+ * 整表清理：保留的记录重新放入一张新表（线性探测删除需要移动后续记录，重建最简单）
+ * 空闲的IP（没有连接、令牌已补满）总是删除；令牌未补满的IP只在保留后不超过一半槽位时保留
+ */
+void IpLimiter::sweep(uint32_t now_ms)
+{
+    size_t n = m_mask + 1;
+    IpBucket *slots = (IpBucket *)calloc(n, sizeof(IpBucket));
+    if (slots == NULL)
+        return;
+
+    size_t keep = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        IpBucket &b = m_slots[i];
+        if (b.ip == 0)
+            continue;
+        if (b.conns == 0)
+            refill(&b, now_ms);
+        if (b.conns > 0 || b.tokens < m_capacity)
+            ++keep;
+    }
+    bool keep_limited = keep <= n / 2;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        IpBucket &b = m_slots[i];
+        if (b.ip == 0)
+            continue;
+        if (b.conns == 0 && (b.tokens >= m_capacity || !keep_limited))
+            continue;
+        place(slots, b);
+        ++kept;
+    }
+    free(m_slots);
+    m_slots = slots;
+    m_count = kept;
+}
+
+bool IpLimiter::acquire(uint32_t ip, uint32_t now_ms)
+{
+    IpBucket *b = find_or_insert(ip, now_ms);
+    if (b == NULL)
+        return true;
+    if (m_max_conns > 0 && b->conns >= m_max_conns)
+        return false;
+    // 令牌已耗尽的IP，新连接也不接受（它的请求反正会被拒绝）
+    if (m_rate > 0 && b->tokens < TOKEN)
+        return false;
+    if (b->conns < UINT16_MAX)
+        ++b->conns;
+    return true;
+}
+
+void IpLimiter::release(uint32_t ip)
+{
+    IpBucket *b = find(ip);
+    if (b && b->conns > 0)
+        --b->conns;
+}
+
+bool IpLimiter::allow_request(uint32_t ip, uint32_t now_ms)
+{
+    if (0 == m_rate)
+        return true;
+    IpBucket *b = find_or_insert(ip, now_ms);
+    if (b == NULL)
+        return true;
+    if (b->tokens < TOKEN)
+        return false;
+    b->tokens -= TOKEN;
+    return true;
+}
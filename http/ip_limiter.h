@@ -0,0 +1,88 @@
+#ifndef IP_LIMITER_H
+#define IP_LIMITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 按客户端IP的限流（单例模式）：并发连接数上限 + 令牌桶请求速率
+ * 每个IP一条 16 字节的记录，存放在一张开放寻址（线性探测）哈希表中，槽位数为2的幂：
+ *   查找：IP 乘以黄金分割常数取高位定位，通常一次缓存行访问；0.0.0.0 不会是客户端地址，表示空槽位
+ *   令牌桶：不需要定时补充，访问时按距上次访问的时间惰性补充（千分之一令牌为单位的定点数）
+ *   回收：记录数超过槽位的 3/4 时整表清理——没有连接且令牌已补满的IP与从未出现过等价，直接删除；
+ *        仍然过多时删除所有没有连接的IP（放弃其速率状态）。有连接的IP不超过连接数上限（远小于槽位数），清理后一定放得下
+ * 只在主线程中使用（accept、读事件、定时器回调都在主线程），不加锁
+ */
+
+// 一个IP的状态
+struct IpBucket
+{
+    uint32_t ip;        // 网络字节序IPv4地址，0 表示空槽位
+    uint16_t conns;     // 当前连接数
+    uint16_t reserved;
+    uint32_t tokens;    // 剩余令牌（千分之一令牌）
+    uint32_t last_ms;   // 上次补充令牌的时间（单调时间，毫秒，截断为32位）
+};
+
+class IpLimiter
+{
+public:
+    static IpLimiter *getInstance()
+    {
+        static IpLimiter instance;
+        return &instance;
+    }
+
+    /**
+     * max_conns：每个IP的并发连接数上限，0 不限制
+     * rate：每个IP每秒的请求数，0 不限制；桶容量 burst 个请求（短时间内的突发，如页面同时加载多个资源）
+     * slots：哈希表槽位数（向上取2的幂）
+     */
+    bool init(int max_conns, int rate, int burst, size_t slots);
+
+    bool enabled()
+    {
+        return m_slots != NULL;
+    }
+
+    /* accept 后调用：连接数未达上限、令牌未耗尽则登记该连接并返回 true */
+    bool acquire(uint32_t ip, uint32_t now_ms);
+
+    /* 连接关闭 */
+    void release(uint32_t ip);
+
+    /* 新请求的第一个读事件：扣除一个令牌，令牌不足返回 false */
+    bool allow_request(uint32_t ip, uint32_t now_ms);
+
+    /* 当前记录的IP数 */
+    size_t size()
+    {
+        return m_count;
+    }
+
+private:
+    IpLimiter();
+    ~IpLimiter();
+
+    size_t index(uint32_t ip)
+    {
+        return (size_t)((uint32_t)(ip * 2654435769u) >> m_shift) & m_mask;
+    }
+
+    IpBucket *find(uint32_t ip);
+    IpBucket *find_or_insert(uint32_t ip, uint32_t now_ms);
+    void refill(IpBucket *b, uint32_t now_ms);
+    void sweep(uint32_t now_ms);
+    IpBucket *place(IpBucket *slots, const IpBucket &b);
+
+    IpBucket *m_slots;
+    size_t m_mask;          // 槽位数 - 1
+    int m_shift;            // 32 - log2(槽位数)
+    size_t m_count;         // 已占用的槽位数
+
+    int m_max_conns;
+    uint32_t m_rate;        // 每毫秒补充的千分之一令牌数（即每秒的请求数）
+    uint32_t m_capacity;    // 桶容量（千分之一令牌）
+};
+
+#endif
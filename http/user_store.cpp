@@ -0,0 +1,186 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "user_store.h"
+
+/* CRC32（IEEE 802.3），表在第一次使用时生成 */
+static uint32_t crc32(const void *data, size_t len)
+{
+    static uint32_t table[256];
+    static bool init = false;
+    if (!init)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        init = true;
+    }
+
+    uint32_t crc = 0xFFFFFFFFU;
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFU;
+}
+
+FileUserStore::FileUserStore(int close_log)
+{
+    m_fd = -1;
+    m_size = 0;
+    m_close_log = close_log;
+    crc32("", 0);   // 单线程时生成CRC表
+}
+
+FileUserStore::~FileUserStore()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+bool FileUserStore::open(const char *path)
+{
+    m_path = path;
+    m_fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+    {
+        LOG_ERROR("user store: open %s failed", path);
+        return false;
+    }
+
+    off_t file_size = lseek(m_fd, 0, SEEK_END);
+    m_size = scan(0, (uint64_t)file_size, [](const char *, const char *) {});
+    if (m_size < (uint64_t)file_size)
+    {
+        LOG_WARN("user store: %s: drop %lld bytes of incomplete record", path, (long long)(file_size - m_size));
+        if (ftruncate(m_fd, m_size) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Fn>
+uint64_t FileUserStore::scan(uint64_t offset, uint64_t end, Fn fn)
+{
+    // 按块顺序读取，记录可能跨越块边界
+    vector<char> buf(1 << 20);
+    size_t have = 0;        // buf 中的有效字节数
+    uint64_t buf_pos = offset;  // buf[0] 对应的文件位置
+    while (true)
+    {
+        size_t want = (size_t)min<uint64_t>(buf.size() - have, end - (buf_pos + have));
+        ssize_t n = want ? pread(m_fd, &buf[have], want, buf_pos + have) : 0;
+        if (n < 0)
+            return buf_pos;
+        have += n;
+
+        size_t pos = 0;
+        while (have - pos >= sizeof(UserLogRecord))
+        {
+            UserLogRecord rec;
+            memcpy(&rec, &buf[pos], sizeof(rec));
+            size_t len = sizeof(rec) + rec.name_len + rec.password_len;
+            if (len > buf.size())
+                return buf_pos + pos;   // 长度字段损坏
+            if (have - pos < len)
+                break;
+            if (crc32(&buf[pos] + sizeof(rec.crc), len - sizeof(rec.crc)) != rec.crc)
+                return buf_pos + pos;   // 内容损坏
+
+            string name(&buf[pos] + sizeof(rec), rec.name_len);
+            string password(&buf[pos] + sizeof(rec) + rec.name_len, rec.password_len);
+            fn(name.c_str(), password.c_str());
+            pos += len;
+        }
+
+        // 未处理的半条记录移到缓冲区开头
+        memmove(&buf[0], &buf[pos], have - pos);
+        have -= pos;
+        buf_pos += pos;
+        if (0 == n)
+            return buf_pos;
+    }
+}
+
+bool FileUserStore::load(UserTable *table, uint64_t *position)
+{
+    m_lock.lock();
+    uint64_t end = m_size;
+    m_lock.unlock();
+
+    if (*position > end)
+    {
+        *position = 0;  // 快照与日志文件不匹配，全量重放
+    }
+    long long rows = 0;
+    *position = scan(*position, end, [&](const char *name, const char *password) {
+        table->insert(name, password);
+        ++rows;
+    });
+    LOG_INFO("user store %s: %lld records replayed", m_path.c_str(), rows);
+    return true;
+}
+
+/* 加载完成前回查：顺序扫描整个日志，取最后一条同名记录 */
+int FileUserStore::find(const char *name, char *password, size_t size)
+{
+    m_lock.lock();
+    uint64_t end = m_size;
+    m_lock.unlock();
+
+    bool found = false;
+    scan(0, end, [&](const char *n, const char *p) {
+        if (strcmp(n, name) == 0)
+        {
+            snprintf(password, size, "%s", p);
+            found = true;
+        }
+    });
+    return found ? 1 : 0;
+}
+
+/* 追加一条记录并落盘 */
+int FileUserStore::insert(const char *name, const char *password)
+{
+    size_t name_len = strlen(name), password_len = strlen(password);
+    if (name_len > 0xffff || password_len > 0xffff)
+    {
+        return -1;
+    }
+
+    vector<char> rec(sizeof(UserLogRecord) + name_len + password_len);
+    UserLogRecord hdr;
+    hdr.name_len = (uint16_t)name_len;
+    hdr.password_len = (uint16_t)password_len;
+    memcpy(&rec[0], &hdr, sizeof(hdr));
+    memcpy(&rec[sizeof(hdr)], name, name_len);
+    memcpy(&rec[sizeof(hdr) + name_len], password, password_len);
+    hdr.crc = crc32(&rec[sizeof(hdr.crc)], rec.size() - sizeof(hdr.crc));
+    memcpy(&rec[0], &hdr.crc, sizeof(hdr.crc));
+
+    m_lock.lock();
+    ssize_t n = pwrite(m_fd, &rec[0], rec.size(), m_size);
+    bool ok = (n == (ssize_t)rec.size() && 0 == fdatasync(m_fd));
+    if (ok)
+    {
+        m_size += rec.size();
+    }
+    m_lock.unlock();
+
+    if (!ok)
+    {
+        LOG_ERROR("user store: append to %s failed", m_path.c_str());
+        return -1;
+    }
+    return 0;
+}
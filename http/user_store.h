@@ -0,0 +1,104 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "../lock/locker.h"
+#include "../log/log.h"
+#include "user_table.h"
+
+using namespace std;
+
+/**
+ * 用户存储后端：登录、注册背后的持久化接口
+ * 用户表（UserTable）是内存中的缓存，启动时由后台线程调用 load 填充；
+ * 加载完成前用户表中查不到的用户用 find 回查后端，注册成功的用户用 insert 写入后端
+ *   MysqlUserStore  : MySQL 数据库（CGImysql/mysql_user_store.h）
+ *   FileUserStore   : 嵌入式日志结构文件，单机部署不需要数据库服务器
+ *   MemoryUserStore : 纯内存，不持久化，用于不依赖数据库地压测 HTTP 处理本身
+ */
+class UserStore
+{
+public:
+    virtual ~UserStore() {}
+
+    /* 后端名称（日志） */
+    virtual const char *name() = 0;
+
+    /* 读取 position 之后的全部用户写入 table，position 返回读到的位置（快照据此增量加载），失败返回 false */
+    virtual bool load(UserTable *table, uint64_t *position) = 0;
+
+    /* 按用户名查询：1 查到（密码写入 password），0 不存在，-1 出错 */
+    virtual int find(const char *name, char *password, size_t size) = 0;
+
+    /* 新增用户，成功返回0 */
+    virtual int insert(const char *name, const char *password) = 0;
+};
+
+/* 纯内存：用户只保存在用户表中，重启后丢失 */
+class MemoryUserStore : public UserStore
+{
+public:
+    const char *name()
+    {
+        return "memory";
+    }
+    bool load(UserTable * /*table*/, uint64_t * /*position*/)
+    {
+        return true;
+    }
+    int find(const char * /*name*/, char * /*password*/, size_t /*size*/)
+    {
+        return 0;
+    }
+    int insert(const char * /*name*/, const char * /*password*/)
+    {
+        return 0;
+    }
+};
+
+/**
+ * 嵌入式日志结构存储：所有注册按顺序追加到一个文件，启动时顺序重放
+ * 记录格式：UserLogRecord + 用户名 + 密码，crc 校验长度和内容，
+ * 打开时截掉末尾写了一半的记录（进程崩溃或掉电）
+ * position 为已读取的文件字节数，配合用户表快照只重放快照之后追加的记录
+ */
+struct UserLogRecord
+{
+    uint32_t crc;          // 对 name_len 之后的全部字节计算的 CRC32
+    uint16_t name_len;
+    uint16_t password_len;
+};
+
+class FileUserStore : public UserStore
+{
+public:
+    FileUserStore(int close_log);
+    ~FileUserStore();
+
+    /* 打开（不存在时创建）日志文件，校验并截掉不完整的尾部 */
+    bool open(const char *path);
+
+    const char *name()
+    {
+        return "file";
+    }
+    bool load(UserTable *table, uint64_t *position);
+    int find(const char *name, char *password, size_t size);
+    int insert(const char *name, const char *password);
+
+private:
+    /* 从 offset 开始顺序读取记录，对每条记录调用 fn，返回最后一条完整记录的结束位置 */
+    template <typename Fn>
+    uint64_t scan(uint64_t offset, uint64_t end, Fn fn);
+
+private:
+    int m_fd;
+    string m_path;
+    MutexLocker m_lock;   // 串行化追加
+    uint64_t m_size;      // 已写入的完整记录的总字节数（受 m_lock 保护）
+    int m_close_log;
+};
+
+#endif
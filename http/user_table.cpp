@@ -0,0 +1,477 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "user_table.h"
+
+UserTable::Entry UserTable::s_tombstone = {0, UINT32_MAX, 0, {0}};
+
+UserTable::UserTable()
+{
+    m_ready.store(false);
+    m_map_base = NULL;
+    m_map_len = 0;
+    m_filter.store(new BloomFilter(USER_FILTER_INIT_KEYS));
+    m_building.store(NULL);
+    for (int i = 0; i < USER_TABLE_SHARDS; ++i)
+    {
+        m_shards[i].slots.store(new_slots(USER_TABLE_INIT_SLOTS));
+        m_shards[i].count = 0;
+        m_shards[i].tombstones = 0;
+    }
+}
+
+UserTable::~UserTable()
+{
+    for (int i = 0; i < USER_TABLE_SHARDS; ++i)
+    {
+        Slots *s = m_shards[i].slots.load();
+        for (size_t j = 0; j <= s->mask; ++j)
+        {
+            char *e = (char *)s->slot[j].load();
+            if (e != (char *)&s_tombstone && (e < m_map_base || e >= m_map_base + m_map_len))
+            {
+                free(e);
+            }
+        }
+        for (size_t j = 0; j < m_shards[i].erased.size(); ++j)
+        {
+            char *e = (char *)m_shards[i].erased[j];
+            if (e < m_map_base || e >= m_map_base + m_map_len)
+            {
+                free(e);
+            }
+        }
+        m_shards[i].retired.push_back(s);
+        for (size_t j = 0; j < m_shards[i].retired.size(); ++j)
+        {
+            delete[] m_shards[i].retired[j]->slot;
+            delete m_shards[i].retired[j];
+        }
+    }
+    if (m_map_base)
+    {
+        munmap(m_map_base, m_map_len);
+    }
+    delete m_filter.load();
+    for (size_t i = 0; i < m_retired_filters.size(); ++i)
+    {
+        delete m_retired_filters[i];
+    }
+}
+
+/* FNV-1a，再做一次 64 位混合，高6位选分片，低位选槽位 */
+uint64_t UserTable::hash(const char *name, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+UserTable::Slots *UserTable::new_slots(size_t capacity)
+{
+    Slots *s = new Slots;
+    s->mask = capacity - 1;
+    s->slot = new std::atomic<Entry *>[capacity];
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        s->slot[i].store(NULL, std::memory_order_relaxed);
+    }
+    return s;
+}
+
+/* 不加锁的查找：槽位数组和记录都以 acquire 读取，读到的记录内容已完整发布 */
+UserTable::Entry *UserTable::lookup(const char *name)
+{
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    if (!m_filter.load(std::memory_order_acquire)->might_contain(h))
+    {
+        return NULL;    // 一定不存在，不访问分片
+    }
+    Shard &shard = m_shards[h >> 58];
+    Slots *s = shard.slots.load(std::memory_order_acquire);
+
+    for (size_t i = h & s->mask;; i = (i + 1) & s->mask)
+    {
+        Entry *e = s->slot[i].load(std::memory_order_acquire);
+        if (e == NULL)
+        {
+            return NULL;
+        }
+        if (e->hash == h && e->name_len == len && memcmp(e->name(), name, len) == 0)
+        {
+            return e;
+        }
+    }
+}
+
+/* 扩容（调用前需持有分片锁）：新数组填好后再发布，旧数组延迟释放 */
+void UserTable::grow(Shard &shard, size_t capacity)
+{
+    Slots *old_slots = shard.slots.load(std::memory_order_relaxed);
+    Slots *s = new_slots(capacity);
+    for (size_t i = 0; i <= old_slots->mask; ++i)
+    {
+        Entry *e = old_slots->slot[i].load(std::memory_order_relaxed);
+        if (e == NULL || e == &s_tombstone)
+        {
+            continue;   // 墓碑不复制
+        }
+        size_t j = e->hash & s->mask;
+        while (s->slot[j].load(std::memory_order_relaxed) != NULL)
+        {
+            j = (j + 1) & s->mask;
+        }
+        s->slot[j].store(e, std::memory_order_relaxed);
+    }
+    shard.slots.store(s, std::memory_order_release);
+    shard.retired.push_back(old_slots);
+    shard.tombstones = 0;
+}
+
+/*
+ * 按新容量重建过滤器：先公开 m_building，使之后的插入同时登记到新过滤器，
+ * 再逐个分片（持有分片锁）登记已有的用户，全部登记后替换当前过滤器。
+ * 替换前旧过滤器一直完整，替换后新过滤器也是完整的，查找不会漏判
+ */
+void UserTable::rebuild_filter(size_t capacity)
+{
+    m_filter_lock.lock();
+    BloomFilter *old_filter = m_filter.load(std::memory_order_relaxed);
+    if (old_filter->capacity() >= capacity)
+    {
+        m_filter_lock.unlock();
+        return;
+    }
+    BloomFilter *filter = new BloomFilter(capacity);
+    m_building.store(filter);
+    for (int i = 0; i < USER_TABLE_SHARDS; ++i)
+    {
+        m_shards[i].lock.lock();
+        Slots *s = m_shards[i].slots.load(std::memory_order_relaxed);
+        for (size_t j = 0; j <= s->mask; ++j)
+        {
+            Entry *e = s->slot[j].load(std::memory_order_relaxed);
+            if (e && e != &s_tombstone)
+            {
+                filter->add(e->hash);
+            }
+        }
+        m_shards[i].lock.unlock();
+    }
+    m_filter.store(filter);
+    m_building.store(NULL);
+    // 正在查找的线程可能仍在读旧过滤器，延迟到析构时释放
+    m_retired_filters.push_back(old_filter);
+    m_filter_lock.unlock();
+}
+
+void UserTable::reserve(size_t users)
+{
+    rebuild_filter(users * 2);
+
+    // 每个分片按 0.5 的装载因子预留
+    size_t per_shard = users / USER_TABLE_SHARDS + 1;
+    size_t capacity = USER_TABLE_INIT_SLOTS;
+    while (capacity < per_shard * 2)
+    {
+        capacity <<= 1;
+    }
+    for (int i = 0; i < USER_TABLE_SHARDS; ++i)
+    {
+        m_shards[i].lock.lock();
+        if (m_shards[i].slots.load(std::memory_order_relaxed)->mask + 1 < capacity)
+        {
+            grow(m_shards[i], capacity);
+        }
+        m_shards[i].lock.unlock();
+    }
+}
+
+/* 记录占用的字节数（按8字节对齐，快照文件中的记录与内存中相同）*/
+size_t UserTable::entry_size(const Entry *e)
+{
+    size_t n = offsetof(Entry, data) + e->name_len + e->password_size() + 2;
+    return (n + 7) & ~(size_t)7;
+}
+
+bool UserTable::insert(const char *name, const char *password, bool pending)
+{
+    size_t name_len = strlen(name);
+    size_t password_len = strlen(password);
+
+    Entry *e = (Entry *)malloc(offsetof(Entry, data) + name_len + password_len + 2);
+    e->hash = hash(name, name_len);
+    e->name_len = (uint32_t)name_len;
+    e->password_len = (uint32_t)password_len;
+    memcpy(e->data, name, name_len + 1);
+    memcpy(e->data + name_len + 1, password, password_len + 1);
+    if (pending)
+    {
+        e->password_len |= ENTRY_PENDING;
+    }
+
+    if (!insert_entry(e))
+    {
+        free(e);
+        return false;
+    }
+    return true;
+}
+
+/* 登记一条完整的记录，用户名已存在时返回 false */
+bool UserTable::insert_entry(Entry *e)
+{
+    uint64_t h = e->hash;
+    Shard &shard = m_shards[h >> 58];
+
+    shard.lock.lock();
+    // 同一分片的登记都在分片锁内，过滤器判定不存在时只需找空槽，不比较用户名
+    // 先读 m_building 再读 m_filter（顺序一致）：读到重建结束后的 NULL 时一定也读到新过滤器
+    BloomFilter *building = m_building.load();
+    BloomFilter *filter = m_filter.load();
+    bool fresh = !filter->might_contain(h);
+    Slots *s = shard.slots.load(std::memory_order_relaxed);
+    size_t i = h & s->mask;
+    for (;; i = (i + 1) & s->mask)
+    {
+        Entry *cur = s->slot[i].load(std::memory_order_relaxed);
+        if (cur == NULL)
+        {
+            break;
+        }
+        if (!fresh && cur->hash == h && cur->name_len == e->name_len && memcmp(cur->name(), e->name(), e->name_len) == 0)
+        {
+            shard.lock.unlock();
+            return false;   // 重名
+        }
+    }
+
+    // 先登记到过滤器再发布记录，查到记录的线程一定也能在过滤器中查到
+    filter->add(h);
+    if (building && building != filter)
+    {
+        building->add(h);
+    }
+    s->slot[i].store(e, std::memory_order_release);    // 发布记录
+
+    // 装载因子（含墓碑）超过 0.7 时扩容为2倍
+    if ((++shard.count + shard.tombstones) * 10 > (s->mask + 1) * 7)
+    {
+        grow(shard, (s->mask + 1) * 2);
+    }
+    shard.lock.unlock();
+    return true;
+}
+
+/* 在分片锁内查找用户名所在的槽位，不存在返回 NULL */
+std::atomic<UserTable::Entry *> *UserTable::find_slot(Slots *s, uint64_t h, const char *name, size_t len)
+{
+    for (size_t i = h & s->mask;; i = (i + 1) & s->mask)
+    {
+        Entry *e = s->slot[i].load(std::memory_order_relaxed);
+        if (e == NULL)
+        {
+            return NULL;
+        }
+        if (e->hash == h && e->name_len == len && memcmp(e->name(), name, len) == 0)
+        {
+            return &s->slot[i];
+        }
+    }
+}
+
+void UserTable::commit(const char *name)
+{
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    Shard &shard = m_shards[h >> 58];
+
+    shard.lock.lock();
+    std::atomic<Entry *> *slot = find_slot(shard.slots.load(std::memory_order_relaxed), h, name, len);
+    if (slot)
+    {
+        slot->load(std::memory_order_relaxed)->password_len &= ~ENTRY_PENDING;
+    }
+    shard.lock.unlock();
+}
+
+/* 删除：槽位换成墓碑，后面的记录仍可探测到；过滤器不删除（只会多一次误判）*/
+void UserTable::erase(const char *name)
+{
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    Shard &shard = m_shards[h >> 58];
+
+    shard.lock.lock();
+    std::atomic<Entry *> *slot = find_slot(shard.slots.load(std::memory_order_relaxed), h, name, len);
+    if (slot)
+    {
+        shard.erased.push_back(slot->load(std::memory_order_relaxed));
+        slot->store(&s_tombstone, std::memory_order_release);
+        --shard.count;
+        ++shard.tombstones;
+    }
+    shard.lock.unlock();
+}
+
+bool UserTable::contains(const char *name)
+{
+    return lookup(name) != NULL;
+}
+
+bool UserTable::check(const char *name, const char *password)
+{
+    Entry *e = lookup(name);
+    return e != NULL && strcmp(e->password(), password) == 0;
+}
+
+/* 加载完成：用户数超出过滤器容量时按实际用户数重建，保持误判率 */
+void UserTable::set_ready()
+{
+    size_t n = size();
+    if (n > m_filter.load(std::memory_order_relaxed)->capacity())
+    {
+        rebuild_filter(n * 2);
+    }
+    m_ready.store(true, std::memory_order_release);
+}
+
+size_t UserTable::size()
+{
+    size_t n = 0;
+    for (int i = 0; i < USER_TABLE_SHARDS; ++i)
+    {
+        m_shards[i].lock.lock();
+        n += m_shards[i].count;
+        m_shards[i].lock.unlock();
+    }
+    return n;
+}
+
+bool UserTable::attach_snapshot(const char *path, uint64_t *last_id)
+{
+    *last_id = 0;
+    if (m_map_base)
+    {
+        return false;   // 只能映射一次
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(UserSnapshotHeader))
+    {
+        close(fd);
+        return false;
+    }
+    // 私有映射：记录只读，按需分页，不需要读入整个文件
+    char *base = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    UserSnapshotHeader hdr;
+    memcpy(&hdr, base, sizeof(hdr));
+    if (memcmp(hdr.magic, USER_SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != USER_SNAPSHOT_VERSION)
+    {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    // 先校验所有记录都在文件范围内，再登记
+    char *end = base + st.st_size;
+    char *p = base + sizeof(hdr);
+    for (uint64_t i = 0; i < hdr.count; ++i)
+    {
+        Entry *e = (Entry *)p;
+        if (end - p < (long)offsetof(Entry, data) || end - p < (long)entry_size(e))
+        {
+            munmap(base, st.st_size);
+            return false;
+        }
+        p += entry_size(e);
+    }
+
+    m_map_base = base;
+    m_map_len = st.st_size;
+    reserve(hdr.count);
+    p = base + sizeof(hdr);
+    for (uint64_t i = 0; i < hdr.count; ++i)
+    {
+        Entry *e = (Entry *)p;
+        insert_entry(e);
+        p += entry_size(e);
+    }
+    *last_id = hdr.last_id;
+    return true;
+}
+
+bool UserTable::save_snapshot(const char *path, uint64_t last_id)
+{
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    UserSnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, USER_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = USER_SNAPSHOT_VERSION;
+    hdr.last_id = last_id;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    // 逐个分片写出（持有分片锁期间该分片的注册会等待）
+    static const char pad[8] = {0};
+    for (int i = 0; i < USER_TABLE_SHARDS; ++i)
+    {
+        m_shards[i].lock.lock();
+        Slots *s = m_shards[i].slots.load(std::memory_order_relaxed);
+        for (size_t j = 0; j <= s->mask; ++j)
+        {
+            Entry *e = s->slot[j].load(std::memory_order_relaxed);
+            // 待确认的用户尚未写入存储后端，不写入快照
+            if (e == NULL || e == &s_tombstone || e->pending())
+            {
+                continue;
+            }
+            size_t n = offsetof(Entry, data) + e->name_len + e->password_size() + 2;
+            fwrite(e, n, 1, fp);
+            fwrite(pad, entry_size(e) - n, 1, fp);
+            ++hdr.count;
+        }
+        m_shards[i].lock.unlock();
+    }
+
+    // 最后回填用户数
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    bool ok = (0 == fflush(fp)) && (0 == fsync(fileno(fp)));
+    ok = (0 == fclose(fp)) && ok;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
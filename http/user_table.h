@@ -0,0 +1,149 @@
+#ifndef USER_TABLE_H
+#define USER_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include "../lock/locker.h"
+#include "bloom_filter.h"
+
+using namespace std;
+
+/**
+ * 并发用户表（用户名 -> 密码），替代全局 map<string, string> users_map
+ * 按用户名哈希分成 USER_TABLE_SHARDS 个分片，每个分片是一张开放寻址（线性探测）哈希表：
+ *   查找（登录）：不加锁，原子读取槽位中的记录指针，记录一经发布不再修改
+ *   插入（注册）：只锁住所在分片，和其他分片的注册互不影响
+ *   扩容：在分片锁内建新槽位数组后原子替换，旧数组留到析构时释放，正在查找的线程仍可安全读取
+ * 注册时先以“待确认”状态插入（同名的并发注册只有一个成功），写入存储后端成功后 commit，失败后 erase：
+ *   待确认的用户可以登录，但不写入快照；erase 把槽位换成墓碑（查找时跳过），记录延迟到析构时释放
+ *
+ * 布隆过滤器：每个插入的用户名同时登记到过滤器（在分片锁内、发布记录之前），
+ * 过滤器判定“一定不存在”的用户名不再探测槽位（登录失败、注册新用户名的常见情况）；
+ * 加载完成时按实际用户数重建过滤器，过滤器只增不删，与用户表保持一致
+ *
+ * 快照文件：记录按内存中的格式（含哈希值）顺序写出，重启时 mmap 后槽位直接指向映射区，
+ * 不逐条分配内存、不重新计算哈希；文件头记录快照对应的数据库最后一行ID，只需补读更新的行
+ */
+
+#define USER_SNAPSHOT_MAGIC "TWSUSER1"
+#define USER_SNAPSHOT_VERSION 1
+
+// 快照文件头，之后是 count 条记录（每条按8字节对齐）
+struct UserSnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t count;     // 用户数
+    uint64_t last_id;   // 快照对应的存储后端位置（MySQL：最后一行ID，user 表没有 id 列时为0；日志文件：已重放的字节数）
+};
+
+class UserTable
+{
+public:
+    static UserTable *getInstance()
+    {
+        static UserTable instance;
+        return &instance;
+    }
+
+    /* 预先按用户数分配槽位，避免加载时反复扩容 */
+    void reserve(size_t users);
+
+    /* 插入用户，用户名已存在时返回 false；pending 为 true 时用户尚未写入存储后端，需随后 commit 或 erase */
+    bool insert(const char *name, const char *password, bool pending = false);
+
+    /* 待确认的用户已写入存储后端 */
+    void commit(const char *name);
+
+    /* 删除用户（写入存储后端失败的注册）*/
+    void erase(const char *name);
+
+    /* 用户名是否存在 */
+    bool contains(const char *name);
+
+    /* 用户名存在且密码一致 */
+    bool check(const char *name, const char *password);
+
+    /* 用户总数 */
+    size_t size();
+
+    /* 数据库中的用户是否已全部加载；加载完成前查找失败需要回查数据库 */
+    bool ready()
+    {
+        return m_ready.load(std::memory_order_acquire);
+    }
+    void set_ready();
+
+    /* 映射快照文件并登记其中的用户，last_id 返回快照对应的数据库最后一行ID */
+    bool attach_snapshot(const char *path, uint64_t *last_id);
+
+    /* 把当前所有用户写入快照文件（先写临时文件再 rename，不影响正在映射旧快照的进程）*/
+    bool save_snapshot(const char *path, uint64_t last_id);
+
+private:
+    UserTable();
+    ~UserTable();
+
+    static const uint32_t ENTRY_PENDING = 1u << 31;    // password_len 的最高位：待确认
+
+    // 一个用户的记录，一次分配：用户名和密码紧跟在结构体之后（均以'\0'结尾）
+    struct Entry
+    {
+        uint64_t hash;
+        uint32_t name_len;
+        uint32_t password_len;  // 最高位 ENTRY_PENDING 只在分片锁内修改，快照中不会出现
+        char data[1];
+
+        const char *name() const { return data; }
+        const char *password() const { return data + name_len + 1; }
+        uint32_t password_size() const { return password_len & ~ENTRY_PENDING; }
+        bool pending() const { return (password_len & ENTRY_PENDING) != 0; }
+    };
+    static Entry s_tombstone;   // 删除后的槽位，name_len 不会与任何用户名相等
+
+    // 槽位数组，容量为2的幂
+    struct Slots
+    {
+        size_t mask;
+        std::atomic<Entry *> *slot;
+    };
+
+    // 分片：独占缓存行，避免不同分片的写者之间伪共享
+    struct alignas(64) Shard
+    {
+        MutexLocker lock;               // 只有插入（注册）加锁
+        std::atomic<Slots *> slots;     // 当前槽位数组
+        size_t count;                   // 分片中的用户数（受 lock 保护）
+        size_t tombstones;              // 墓碑数，计入装载因子，扩容时清除
+        vector<Slots *> retired;        // 扩容后替换下来的数组，析构时释放
+        vector<Entry *> erased;         // 删除的记录，查找中的线程可能仍在读，析构时释放
+    };
+
+    static uint64_t hash(const char *name, size_t len);
+    static Slots *new_slots(size_t capacity);
+    static size_t entry_size(const Entry *e);
+    Entry *lookup(const char *name);
+    std::atomic<Entry *> *find_slot(Slots *s, uint64_t h, const char *name, size_t len);
+    bool insert_entry(Entry *e);
+    void grow(Shard &shard, size_t capacity);
+    void rebuild_filter(size_t capacity);
+
+private:
+    static const int USER_TABLE_SHARDS = 64;        // 分片数（2的幂）
+    static const size_t USER_TABLE_INIT_SLOTS = 64; // 每个分片的初始槽位数
+    static const size_t USER_FILTER_INIT_KEYS = 1 << 20;    // 布隆过滤器的初始容量（用户数）
+
+    Shard m_shards[USER_TABLE_SHARDS];
+    std::atomic<bool> m_ready;      // 数据库加载完成
+    char *m_map_base;               // 快照映射区（其中的记录不能 free）
+    size_t m_map_len;
+    std::atomic<BloomFilter *> m_filter;    // 当前过滤器
+    std::atomic<BloomFilter *> m_building;  // 重建中的过滤器，插入时同时登记
+    MutexLocker m_filter_lock;              // 串行化重建
+    vector<BloomFilter *> m_retired_filters;    // 替换下来的过滤器，析构时释放（受 m_filter_lock 保护）
+};
+
+#endif
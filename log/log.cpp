@@ -1,46 +1,167 @@
 #include <time.h>
 #include <sys/time.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ctype.h>
 
 #include "log.h"
 
+extern char **environ;
+
+static const int RING_DRAIN_IDLE_US = 1000; // 所有环都为空时，刷盘线程的休眠时间(微秒)
+static const int RING_MAX_IOV = 1024;       // 一次 writev 最多合并的内存段数（IOV_MAX）
+static const int LOG_BG_TICK_SEC = 1;       // 后台线程回收压缩子进程的周期(秒)
+
+/* 线程私有的环形缓冲区和格式化缓冲区的持有者，线程退出时释放格式化缓冲区、通知刷盘线程回收环 */
+struct LogRingOwner
+{
+    LogRing *ring;
+    char *buf;
+    LogRingOwner() : ring(NULL), buf(NULL) {}
+    ~LogRingOwner()
+    {
+        if (ring)
+        {
+            ring->mClosed.store(true, std::memory_order_release);
+        }
+        delete[] buf;
+    }
+};
+static thread_local LogRingOwner t_ring_owner;
+
+/* 下一个本地时间零点，按天切分日志文件时只需比较秒数 */
+static time_t next_midnight(time_t now)
+{
+    struct tm my_tm;
+    localtime_r(&now, &my_tm);
+    my_tm.tm_hour = 0;
+    my_tm.tm_min = 0;
+    my_tm.tm_sec = 0;
+    my_tm.tm_mday += 1;
+    my_tm.tm_isdst = -1;
+    return mktime(&my_tm);
+}
+
+/* 把 len 字节完整写入 fd（处理部分写入和信号中断）*/
+static void write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t ret = ::write(fd, buf, len);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
+
 // 单例模式类
 // 构造函数：
 Log::Log()
 {
     m_count = 0;            // 日志行数记录
+    m_file_bytes = 0;
+    m_file_seq = 0;
+    m_next_rotate_sec = 0;
+    m_max_bytes = 0;        // 默认不按字节数切分
+    m_compress = false;     // 默认不压缩切分后的文件
+    m_rotate_pending.store(false);
+    m_bg_stop = false;
+    m_bg_started = false;
+    Clock::getInstance();   // 时间缓存先于日志构造，保证日志析构（写出剩余日志）时仍可用
     m_is_async = false;     // 是否异步标志位（默认同步）
+    m_is_ring = false;      // 是否每线程环形缓冲区（默认否）
+    m_rings.store(NULL);
+    m_ring_stop.store(false);
+    m_is_binary = false;    // 是否二进制日志（默认文本）
+    m_formats_written = 0;
+    m_level.store(0);       // 运行时日志级别（默认全部记录）
+    m_flush_interval_ms = 1000; // 默认每秒至少刷新一次
+    m_flush_bytes = 64 * 1024;  // 或累计64KB刷新一次
+    m_unflushed = 0;
+    m_last_flush_ms = 0;
+    m_async_stop = false;
+    m_front_buf = NULL;
+    m_back_buf = NULL;
+    m_front_len = 0;
+    m_back_len = 0;
+    m_async_lines = 0;
+    m_async_dropped = 0;
+    m_flush_request = false;
 }
 
 
 Log::~Log()
 {
+    if (m_is_async)
+    {
+        // 通知写线程把两块缓冲区写完后退出
+        m_async_mutex.lock();
+        m_async_stop = true;
+        m_async_cond.signal();
+        m_async_mutex.unlock();
+        pthread_join(m_async_tid, NULL);
+    }
+    if (m_is_ring)
+    {
+        // 通知刷盘线程把所有环写空后退出
+        m_ring_stop.store(true);
+        pthread_join(m_ring_tid, NULL);
+    }
+    if (m_bg_started)
+    {
+        m_bg_mutex.lock();
+        m_bg_stop = true;
+        m_bg_cond.signal();
+        m_bg_mutex.unlock();
+        pthread_join(m_bg_tid, NULL);
+    }
     if (m_fp != NULL)
     {
         fclose(m_fp);    // 关闭文件
     }
 }
 
-/* 异步日志： 将所写的日志内容先存入阻塞队列，写线程从阻塞队列中取出内容，写入日志 */
-// 异步需要设置阻塞队列的长度，同步不需要设置
-bool Log::init(const char *file_name, int close_log, int log_buf_size, int split_lines, int max_queue_size)
+/* 异步日志： 将所写的日志内容先追加到内存缓冲区，写满或定时交换缓冲区，由写线程一次写入文件 */
+// 异步需要设置缓冲区容量（max_queue_size 条 * log_buf_size 字节），同步不需要设置
+bool Log::init(const char *file_name, int close_log, int log_buf_size, int split_lines, int max_queue_size, int ring_size, bool binary)
 {
+    // 如果设置了 ring_size, 则每个线程写自己的无锁环，由刷盘线程批量写入
+    if (ring_size >= 1)
+    {
+        m_is_ring = true;
+        m_ring_size = ring_size;
+
+        // 二进制日志依赖刷盘线程写出文件头和格式字典
+        if (binary)
+        {
+            m_is_binary = true;
+            m_text_fmt_id = register_format(1, __FILE__, __LINE__, "%s");
+            m_drop_fmt_id = register_format(2, __FILE__, __LINE__, "log ring full, %lu lines dropped");
+        }
+    }
     // 如果设置了 max_queue_size, 则为异步日志（在另一个线程中，执行日志写入）
-    if (max_queue_size >= 1)
+    else if (max_queue_size >= 1)
     {
         m_is_async =true;
-        // 创建阻塞队列对象，大小为max_queue_size，m_log_queue指向该对象
-        m_log_queue = new BlockQueue<string>(max_queue_size);
-        pthread_t tid;
-
-        // 创建线程 回调函数 flush_log_thread，异步写日志
-        pthread_create(&tid, NULL, flush_log_thread, NULL);
+        // 前后台两块缓冲区，每块可容纳 max_queue_size 条最长日志
+        m_async_buf_size = (size_t)max_queue_size * log_buf_size;
+        m_front_buf = new char[m_async_buf_size];
+        m_back_buf = new char[m_async_buf_size];
     }
 
     m_close_log = close_log;
     m_log_buf_size = log_buf_size;      
-    m_buf = new char[m_log_buf_size];   // 日志缓冲区，char数组
-    memset(m_buf, '\0', m_log_buf_size);    // 将buf中的每个字节设置为空字符
     m_split_lines = split_lines;
 
     time_t t = time(NULL);
@@ -52,11 +173,11 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size, int split
     // Log文件的全路径名
     char log_full_name[256] = {0};
 
-    // 不存在字符'/'
+    // 不存在字符'/'：日志文件在当前目录
     if (p == NULL)
     {
-        // 将以 年-月-日-文件名 格式，以'\0'结尾的字符串，存储到 log_full_name缓冲区中
-        snprintf(log_full_name, 255, "%d_%02d_%02d_%s", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, file_name);
+        dir_name[0] = '\0';
+        snprintf(log_name, sizeof(log_name), "%s", file_name);
     }
     else
     {
@@ -65,12 +186,18 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size, int split
 
         // 取出目录名 ：将file_name开头到‘/’为止的字符，拷贝到dir_name中
         strncpy(dir_name, file_name, p - file_name + 1);    
-
-        // 目录名-年-月-日-log_name 格式，存储到 log_full_name缓冲区中
-        snprintf(log_full_name, 255, "%s%d_%02d_%02d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, log_name);
+        dir_name[p - file_name + 1] = '\0';
     }
 
+    // 目录名-年-月-日-log_name 格式；同一天重启时接着已有文件的序号，不覆盖之前切分（压缩）的文件
+    char tail[16] = {0};
+    snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
+    m_file_seq = resume_file_seq(tail);
+    day_file_name(log_full_name, tail, m_file_seq);
+
     m_today = my_tm.tm_mday;
+    m_next_rotate_sec = next_midnight(t);  // 每行日志只需与该时间比较，不必每次 localtime
+    strcpy(m_file_name, log_full_name);
 
     // 追加方式，打开文件，如果文件不存在，则创建文件
     m_fp = fopen(log_full_name, "a");
@@ -78,118 +205,697 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size, int split
     {
         return false;
     }
+    // stdio 缓冲区与刷新字节数一致，写满之前不会产生 write 系统调用
+    setvbuf(m_fp, NULL, _IOFBF, m_flush_bytes);
+
+    // 后台线程：同步日志的文件切分、切分后文件的压缩
+    m_bg_started = (0 == pthread_create(&m_bg_tid, NULL, log_bg_thread, NULL));
+
+    // 日志文件打开后再启动刷盘线程
+    if (m_is_ring)
+    {
+        pthread_create(&m_ring_tid, NULL, ring_drain_thread, NULL);
+    }
+    // 创建线程 回调函数 flush_log_thread，异步写日志
+    else if (m_is_async)
+    {
+        pthread_create(&m_async_tid, NULL, flush_log_thread, NULL);
+    }
 
     return true;
 }
 
+/* 按日期/行数/字节数切分日志文件（只由写线程或后台线程调用，不需要持有 m_mutex）
+   新文件在锁外打开，锁内只交换文件指针，旧文件在锁外关闭，写日志的线程不会等待 fopen/fclose */
+void Log::rotate(time_t now)
+{
+    struct tm my_tm;
+    localtime_r(&now, &my_tm);
 
-/* 同步写日志*/
-void Log::write_log(int level, const char *format, ...)
+    char new_log_full_name[256] = {0};    // 新的日志名
+    char tail[16] = {0};
+    snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
+
+    // 如果当前的天数变化，新建日志名（新的一天通常没有文件，序号为0）
+    // 如果日志行数/字节数超过上限，同一天内按序号命名
+    int seq = m_today != my_tm.tm_mday ? resume_file_seq(tail) : m_file_seq + 1;
+    day_file_name(new_log_full_name, tail, seq);
+
+    FILE *fp = fopen(new_log_full_name, "a");
+    if (fp == NULL)
+    {
+        // 打开失败继续写旧文件，一秒后再试
+        m_mutex.lock();
+        m_next_rotate_sec = now + 1;
+        m_mutex.unlock();
+        return;
+    }
+    setvbuf(fp, NULL, _IOFBF, m_flush_bytes);
+
+    m_mutex.lock();
+    FILE *old_fp = m_fp;
+    m_fp = fp;
+    m_count = 0;
+    m_file_bytes = 0;
+    m_unflushed = 0;
+    m_file_seq = seq;
+    m_today = my_tm.tm_mday;
+    m_next_rotate_sec = next_midnight(now);
+    m_mutex.unlock();
+
+    fclose(old_fp);   // 关闭旧的日志文件（刷新缓冲区）
+
+    if (m_compress)
+    {
+        m_bg_mutex.lock();
+        m_compress_files.push_back(m_file_name);
+        m_bg_cond.signal();
+        m_bg_mutex.unlock();
+    }
+    strcpy(m_file_name, new_log_full_name);
+}
+
+/* 同一天的第 seq 个日志文件名：seq 为0时是 目录/年_月_日_文件名，之后依次加 .1 .2 ... */
+void Log::day_file_name(char *buf, const char *tail, int seq)
 {
-    // 重新获取一下当前写日志的时间
-    struct timeval now = {0, 0};
-    gettimeofday(&now, NULL);   
-    time_t t = now.tv_sec;
+    if (0 == seq)
+        snprintf(buf, 255, "%s%s%s", dir_name, tail, log_name);
+    else
+        snprintf(buf, 255, "%s%s%s.%d", dir_name, tail, log_name, seq);
+}
 
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+/**
+ * 同一天应当写入的文件序号：找出已有文件（含压缩后的 .gz）中序号最大的一个，
+ * 未压缩时继续追加写入它，已压缩时使用下一个序号，新文件不会与之前的文件或压缩包重名
+ */
+int Log::resume_file_seq(const char *tail)
+{
+    char prefix[256];
+    snprintf(prefix, sizeof(prefix), "%s%s", tail, log_name);
+    size_t prefix_len = strlen(prefix);
+
+    DIR *dir = opendir(dir_name[0] ? dir_name : ".");
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    int max_seq = -1;
+    bool plain = false;     // 序号最大的文件未压缩
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (strncmp(ent->d_name, prefix, prefix_len) != 0)
+            continue;
+        const char *rest = ent->d_name + prefix_len;
+        int seq = 0;
+        if ('.' == rest[0] && isdigit((unsigned char)rest[1]))
+        {
+            char *end;
+            seq = (int)strtol(rest + 1, &end, 10);
+            rest = end;
+        }
+        bool gz = 0 == strcmp(rest, ".gz");
+        if (!gz && rest[0] != '\0')
+            continue;   // 同前缀的其他文件（如 ServerLog.bin）
+        if (seq > max_seq)
+        {
+            max_seq = seq;
+            plain = !gz;
+        }
+        else if (seq == max_seq && !gz)
+        {
+            plain = true;
+        }
+    }
+    closedir(dir);
+
+    if (max_seq < 0)
+        return 0;
+    return plain ? max_seq : max_seq + 1;
+}
+
+/* 同步日志：工作线程发现需要切分时只通知后台线程，自己继续写旧文件 */
+void Log::request_rotate()
+{
+    if (!m_rotate_pending.exchange(true))
+    {
+        m_bg_mutex.lock();
+        m_bg_cond.signal();
+        m_bg_mutex.unlock();
+    }
+}
+
+/* 用 gzip 子进程压缩切分后的日志文件，不阻塞任何线程
+   不加 -f：同名的 .gz 已存在时 gzip 保留原文件，不覆盖之前的压缩包；
+   标准输入重定向到 /dev/null，gzip 不会在终端上询问是否覆盖 */
+void Log::compress_file(const string &file_name)
+{
+    char *argv[] = {(char *)"gzip", (char *)file_name.c_str(), NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    pid_t pid;
+    if (0 == posix_spawnp(&pid, "gzip", &actions, NULL, argv, environ))
+    {
+        m_compress_pids.push_back(pid);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+}
 
-    char s_level[16] = {0};
-    switch (level)
-    {
-    case 0:
-        strcpy(s_level, "[DEBUG]:");
-        break;
-    case 1:
-        strcpy(s_level, "[INFO]:");
-        break;
-    case 2:
-        strcpy(s_level, "[WARN]:");
-        break;
-    case 3:
-        strcpy(s_level, "[ERROR]:");
-        break;
-    default:
-        strcpy(s_level, "[INFO]:");
-        break;
-    }
-
-    // 写入一个log，对m_count++, m_split_lines最大行数
+/* 后台线程：执行同步日志的文件切分，压缩切分后的文件，回收压缩子进程 */
+void Log::bg_work()
+{
+    while (true)
+    {
+        m_bg_mutex.lock();
+        if (!m_bg_stop && !m_rotate_pending.load() && m_compress_files.empty())
+        {
+            struct timespec t;
+            clock_gettime(CLOCK_REALTIME, &t);
+            t.tv_sec += LOG_BG_TICK_SEC;
+            m_bg_cond.timewait(m_bg_mutex.get(), t);
+        }
+        bool stop = m_bg_stop;
+        vector<string> files;
+        files.swap(m_compress_files);
+        m_bg_mutex.unlock();
+
+        if (m_rotate_pending.load())
+        {
+            rotate(time(NULL));
+            m_rotate_pending.store(false);
+        }
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            compress_file(files[i]);
+        }
+
+        // 回收已结束的压缩子进程
+        for (size_t i = 0; i < m_compress_pids.size();)
+        {
+            if (waitpid(m_compress_pids[i], NULL, WNOHANG) != 0)
+            {
+                m_compress_pids[i] = m_compress_pids.back();
+                m_compress_pids.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        if (stop)
+        {
+            break;
+        }
+    }
+}
+
+/* 当前线程第一次写日志时，创建并登记它独占的环形缓冲区 */
+LogRing *Log::thread_ring()
+{
+    if (t_ring_owner.ring)
+    {
+        return t_ring_owner.ring;
+    }
+
+    LogRing *ring = new LogRing(m_ring_size);
+    thread_buf();
+
+    // 只有登记时加锁（每个线程一次），之后写日志不再加锁
     m_mutex.lock();
-    m_count++;      // 所有记录日志的行数
+    ring->mNext = m_rings.load(std::memory_order_relaxed);
+    m_rings.store(ring, std::memory_order_release);
+    m_mutex.unlock();
+
+    t_ring_owner.ring = ring;
+    return ring;
+}
 
-    // everyday log
-    // m_today != my_tm.tm_mday : 
-    // m_count % m_split_lines == 0 : 
-    if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0)
+/* 当前线程的格式化/编码缓冲区，第一次使用时创建 */
+char *Log::thread_buf()
+{
+    if (!t_ring_owner.buf)
+    {
+        t_ring_owner.buf = new char[m_log_buf_size];
+    }
+    return t_ring_owner.buf;
+}
+
+/* 把一行日志（时间 级别 内容\n）格式化到 buf，返回字节数；时间取自时间缓存，不做系统调用和时区转换 */
+int Log::format_line(char *buf, int level, const char *format, va_list valst)
+{
+    static const char *s_levels[] = {"[DEBUG]:", "[INFO]:", "[WARN]:", "[ERROR]:"};
+    const char *s_level = (level >= 0 && level <= 3) ? s_levels[level] : "[INFO]:";
+
+    ClockSnapshot now;
+    Clock::getInstance()->read(&now);
+
+    int n = snprintf(buf, 48, "%s.%06ld %s ", now.log_date, now.wall_usec, s_level);
+    int m = vsnprintf(buf + n, m_log_buf_size - n - 1, format, valst);
+    if (m < 0)
+    {
+        m = 0;
+    }
+    else if (m > m_log_buf_size - n - 2)
+    {
+        m = m_log_buf_size - n - 2;   // 超长日志截断
+    }
+    buf[n + m] = '\n';
+    return n + m + 1;
+}
+
+/* 异步日志：格式化到线程私有缓冲区，再在锁内追加到前台缓冲区（只有一次 memcpy）*/
+void Log::write_async_log(int level, const char *format, va_list valst)
+{
+    char *buf = thread_buf();
+    int len = format_line(buf, level, format, valst);
+
+    m_async_mutex.lock();
+    // 前台缓冲区写满：若后台缓冲区已写完则交换，并唤醒写线程（每块缓冲区只唤醒一次）
+    if (m_front_len + len > m_async_buf_size && 0 == m_back_len)
+    {
+        char *tmp = m_back_buf;
+        m_back_buf = m_front_buf;
+        m_back_len = m_front_len;
+        m_front_buf = tmp;
+        m_front_len = 0;
+        m_async_cond.signal();
+    }
+    if (m_front_len + len <= m_async_buf_size)
+    {
+        memcpy(m_front_buf + m_front_len, buf, len);
+        m_front_len += len;
+        ++m_async_lines;
+    }
+    else
     {
-        char new_log_full_name[256] = {0};    // 新的日志名
-        fflush(m_fp);   // 刷新缓冲区
-        fclose(m_fp);   // 关闭旧的日志文件
+        ++m_async_dropped;  // 两块缓冲区都满（写线程跟不上），丢弃而不阻塞工作线程
+    }
+    m_async_mutex.unlock();
+}
 
-        char tail[16] = {0};
-        snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
+/* 异步写线程：等待缓冲区写满、刷新间隔到期或 ERROR 日志，交换缓冲区后一次 write 写入文件 */
+void Log::async_write_log()
+{
+    unsigned long dropped = 0;
+    while (true)
+    {
+        m_async_mutex.lock();
+        if (0 == m_back_len && !m_flush_request && !m_async_stop)
+        {
+            struct timespec t;
+            clock_gettime(CLOCK_REALTIME, &t);
+            t.tv_sec += m_flush_interval_ms / 1000;
+            t.tv_nsec += (long)(m_flush_interval_ms % 1000) * 1000000;
+            if (t.tv_nsec >= 1000000000)
+            {
+                t.tv_sec += 1;
+                t.tv_nsec -= 1000000000;
+            }
+            m_async_cond.timewait(m_async_mutex.get(), t);
+        }
 
-        // 如果当前的天数变化，新建日志名
-        if (m_today != my_tm.tm_mday)
+        // 定时到期或请求刷新时，前台缓冲区即使没写满也交换出来
+        if (0 == m_back_len && m_front_len > 0)
         {
-            snprintf(new_log_full_name, 255, "%s%s%s", dir_name, tail, log_name);
-            m_today = my_tm.tm_mday;
-            m_count = 0;    // 重置新一天的日志记录行数
+            char *tmp = m_back_buf;
+            m_back_buf = m_front_buf;
+            m_back_len = m_front_len;
+            m_front_buf = tmp;
+            m_front_len = 0;
         }
-        // 如果日志最大行数超过m_split_lines
-        else    
+        char *out = m_back_buf;
+        size_t len = m_back_len;
+        long long lines = m_async_lines;
+        unsigned long total_dropped = m_async_dropped;
+        bool stop = m_async_stop && 0 == m_front_len;
+        m_async_lines = 0;
+        m_flush_request = false;
+        m_async_mutex.unlock();
+
+        if (len > 0)
         {
-            snprintf(new_log_full_name, 255, "%s%s%s.%lld", dir_name, tail, log_name, m_count / m_split_lines);
+            // 按日期/行数/字节数切分日志文件：只有写线程使用日志文件，在写线程中完成
+            time_t now = Clock::getInstance()->now();
+            if (need_rotate(now))
+            {
+                rotate(now);
+            }
+            m_count += lines;
+            m_file_bytes += len;
+            int fd = fileno(m_fp);
+
+            write_all(fd, out, len);    // 整块缓冲区一次写入
+
+            if (total_dropped != dropped)
+            {
+                char warn[96];
+                int n = snprintf(warn, sizeof(warn), "[WARN]: log buffer full, %lu lines dropped\n", total_dropped - dropped);
+                write_all(fd, warn, n);
+                dropped = total_dropped;
+            }
+
+            m_async_mutex.lock();
+            m_back_len = 0;     // 后台缓冲区空闲，可再次交换
+            m_async_mutex.unlock();
         }
 
-        m_fp = fopen(new_log_full_name, "a");
+        if (stop && 0 == len)
+        {
+            break;
+        }
     }
+}
+
+/* 登记一个调用点的格式串，返回格式ID（下标+1，0 保留）*/
+int Log::register_format(int level, const char *file, int line, const char *format)
+{
+    BinLogFormat f;
+    f.level = level;
+    f.file = file;
+    f.line = line;
+    f.format = format;
+
+    m_mutex.lock();
+    m_formats.push_back(f);
+    int id = (int)m_formats.size();
     m_mutex.unlock();
+    return id;
+}
 
-    // 
-    va_list valst;
-    va_start(valst, format);
+/* 二进制日志：把尚未写出的格式字典写入当前文件，new_file 时先写文件头并重写全部字典 */
+void Log::write_binary_formats(int fd, bool new_file)
+{
+    string out;
+    if (new_file)
+    {
+        BinLogFileHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, BINLOG_MAGIC, sizeof(hdr.magic));
+        hdr.version = BINLOG_VERSION;
+        hdr.wall_ns = binlog_now_ns(CLOCK_REALTIME);
+        hdr.mono_ns = binlog_now_ns(CLOCK_MONOTONIC);
+        out.append((const char *)&hdr, sizeof(hdr));
+        m_formats_written = 0;
+    }
 
-    string log_str;
     m_mutex.lock();
+    for (; m_formats_written < m_formats.size(); ++m_formats_written)
+    {
+        const BinLogFormat &f = m_formats[m_formats_written];
+        uint16_t file_len = (uint16_t)strlen(f.file);
+        uint16_t fmt_len = (uint16_t)strlen(f.format);
+
+        BinLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.length = sizeof(rec) + 2 * sizeof(uint16_t) + file_len + fmt_len;
+        rec.type = BINLOG_FORMAT;
+        rec.level = (uint8_t)f.level;
+        rec.fmt_id = (uint32_t)(m_formats_written + 1);
+        rec.line = (uint32_t)f.line;
+
+        out.append((const char *)&rec, sizeof(rec));
+        out.append((const char *)&file_len, sizeof(file_len));
+        out.append(f.file, file_len);
+        out.append((const char *)&fmt_len, sizeof(fmt_len));
+        out.append(f.format, fmt_len);
+    }
+    m_mutex.unlock();
+
+    if (!out.empty())
+    {
+        ::write(fd, out.data(), out.size());
+    }
+}
+
+/* 当前线程格式化一条日志写入自己的环，不加锁、不进行系统调用 */
+void Log::write_ring_log(int level, const char *format, va_list valst)
+{
+    // 二进制日志中，不经过 LOG_* 宏的调用没有调用点格式ID，格式化后按 "%s" 记录
+    if (m_is_binary)
+    {
+        LogRing *ring = thread_ring();
+        char msg[1024];
+        vsnprintf(msg, sizeof(msg), format, valst);
+        BinLogEncoder enc(t_ring_owner.buf, m_log_buf_size);
+        enc.arg(msg);
+        ring->push(t_ring_owner.buf, enc.finish(m_text_fmt_id, level, Clock::getInstance()->mono_ns()));
+        return;
+    }
 
-    // 写入的具体时间内容格式
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s_level);
+    LogRing *ring = thread_ring();
+    int len = format_line(t_ring_owner.buf, level, format, valst);
 
-    // 向一个字符串缓冲区打印格式化字符串，且可以限定打印的格式化字符串的最大长度
-    // 向m_buf + n后的位置，写入m_log_buf_size - n - 1个字符，最后一个字符保留为NULL空字符
-    int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
-    m_buf[n + m] = '\n';
-    m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
+    // 环满直接丢弃（计入 mDropped），工作线程永不阻塞
+    ring->push(t_ring_owner.buf, len);
+}
 
-    m_mutex.unlock();
+/* 后台线程：轮询所有环，用一次 writev 批量写入日志文件 */
+void Log::ring_drain()
+{
+    struct iovec iov[RING_MAX_IOV];
+    LogRing *owners[RING_MAX_IOV];
+    size_t lens[RING_MAX_IOV];
+    unsigned long dropped = 0;
+    bool new_file = true;   // 二进制日志：新文件需要先写文件头和完整的格式字典
 
-    // 阻塞队列没有满 && 异步日志
-    if (m_is_async && !m_log_queue->full())
+    while (true)
     {
-        m_log_queue->push(log_str); // 将日志放入阻塞队列
+        bool stop = m_ring_stop.load();
+        int iovcnt = 0;
+        int nrings = 0;
+        unsigned long lines = 0;
+        unsigned long total_dropped = 0;
+        LogRing *prev = NULL;
+        LogRing *ring = m_rings.load(std::memory_order_acquire);
+
+        // 1. 收集所有环中的可读数据（每个环最多2段）
+        while (ring)
+        {
+            LogRing *next = ring->mNext;
+            total_dropped += ring->mDropped.load(std::memory_order_relaxed);
+
+            // 所属线程已退出且读空，回收该环（只有本线程摘链，登记线程只在表头插入）
+            if (ring->mClosed.load(std::memory_order_acquire) && ring->empty())
+            {
+                m_mutex.lock();
+                if (prev)
+                {
+                    prev->mNext = next;
+                }
+                else if (!m_rings.compare_exchange_strong(ring, next))
+                {
+                    // 表头已被新登记的环替换，重新找到前驱
+                    LogRing *p = m_rings.load();
+                    while (p->mNext != ring)
+                    {
+                        p = p->mNext;
+                    }
+                    p->mNext = next;
+                }
+                m_mutex.unlock();
+                dropped -= ring->mDropped.load(std::memory_order_relaxed);
+                total_dropped -= ring->mDropped.load(std::memory_order_relaxed);
+                delete ring;
+                ring = next;
+                continue;
+            }
+
+            if (iovcnt + 2 <= RING_MAX_IOV)
+            {
+                int cnt = 0;
+                size_t len = ring->peek(iov + iovcnt, &cnt);
+                if (len > 0)
+                {
+                    lines += ring->mLines.exchange(0, std::memory_order_relaxed);
+                    owners[nrings] = ring;
+                    lens[nrings] = len;
+                    ++nrings;
+                    iovcnt += cnt;
+                }
+            }
+            prev = ring;
+            ring = next;
+        }
+
+        if (0 == iovcnt)
+        {
+            if (stop)
+            {
+                break;
+            }
+            usleep(RING_DRAIN_IDLE_US);
+            continue;
+        }
+
+        // 2. 按日期/行数/字节数切分日志文件：在刷盘线程中完成，不影响工作线程
+        time_t now = Clock::getInstance()->now();
+        if (need_rotate(now))
+        {
+            rotate(now);
+            new_file = true;
+        }
+        m_count += lines;
+        for (int i = 0; i < nrings; ++i)
+        {
+            m_file_bytes += lens[i];
+        }
+        int fd = fileno(m_fp);
+
+        // 本批记录用到的格式在 push 之前已登记，先写出字典再写数据，保证解码时格式已知
+        if (m_is_binary)
+        {
+            write_binary_formats(fd, new_file);
+            new_file = false;
+        }
+
+        // 3. 一次系统调用写入所有数据（处理部分写入）
+        struct iovec *cur = iov;
+        int left = iovcnt;
+        while (left > 0)
+        {
+            ssize_t ret = writev(fd, cur, left);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            while (left > 0 && (size_t)ret >= cur->iov_len)
+            {
+                ret -= cur->iov_len;
+                ++cur;
+                --left;
+            }
+            if (left > 0)
+            {
+                cur->iov_base = (char *)cur->iov_base + ret;
+                cur->iov_len -= ret;
+            }
+        }
+
+        for (int i = 0; i < nrings; ++i)
+        {
+            owners[i]->consume(lens[i]);
+        }
+
+        // 4. 有日志因环满被丢弃时，记录一条告警
+        if (total_dropped != dropped)
+        {
+            char warn[96];
+            int n = 0;
+            if (m_is_binary)
+            {
+                BinLogEncoder enc(warn, sizeof(warn));
+                enc.arg(total_dropped - dropped);
+                n = enc.finish(m_drop_fmt_id, 2, Clock::getInstance()->mono_ns());
+            }
+            else
+            {
+                n = snprintf(warn, sizeof(warn), "[WARN]: log ring full, %lu lines dropped\n", total_dropped - dropped);
+            }
+            ::write(fd, warn, n);
+            dropped = total_dropped;
+        }
     }
-    // 同步模式 或者 异步日志的阻塞队列已经满，则直接将日志写入文件
-    else
+}
+
+
+/* 同步写日志*/
+void Log::write_log(int level, const char *format, ...)
+{
+    // 每线程环形缓冲区：不加锁，直接写入当前线程的环
+    if (m_is_ring)
     {
-        m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
-        m_mutex.unlock();
+        va_list valst;
+        va_start(valst, format);
+        write_ring_log(level, format, valst);
+        va_end(valst);
+        return;
+    }
+    // 异步日志：追加到前台缓冲区，不进行文件操作
+    if (m_is_async)
+    {
+        va_list valst;
+        va_start(valst, format);
+        write_async_log(level, format, valst);
+        va_end(valst);
+        return;
     }
 
+    // 在锁外格式化到线程私有缓冲区（时间前缀按秒缓存）
+    va_list valst;
+    va_start(valst, format);
+    char *buf = thread_buf();
+    int len = format_line(buf, level, format, valst);
     va_end(valst);
+
+    // 同步模式，直接将日志写入文件
+    m_mutex.lock();
+    fwrite(buf, 1, len, m_fp);
+    m_count++;      // 当前文件的日志行数
+    m_file_bytes += len;
+    flush_by_policy(len);
+    // 每行只比较 预先计算的下次切分时间 和 行数/字节数上限；切分交给后台线程
+    bool rotate = need_rotate(Clock::getInstance()->now());
+    m_mutex.unlock();
+
+    if (rotate)
+    {
+        request_rotate();
+    }
 }
 
 void Log::flush(void)
 {
+    // 每线程环形缓冲区由刷盘线程持续写入文件，无需强制刷新
+    if (m_is_ring)
+    {
+        return;
+    }
+    // 异步日志：只唤醒写线程立即写出前台缓冲区，不等待
+    if (m_is_async)
+    {
+        m_async_mutex.lock();
+        m_flush_request = true;
+        m_async_cond.signal();
+        m_async_mutex.unlock();
+        return;
+    }
     m_mutex.lock();
     // 强制刷新， 写入流缓冲区
     fflush(m_fp);
+    m_unflushed = 0;
     m_mutex.unlock();
 }
 
+void Log::set_flush_policy(int interval_ms, int bytes)
+{
+    m_flush_interval_ms = interval_ms;
+    m_flush_bytes = bytes;
+}
+
+void Log::set_rotate_policy(long long max_bytes, bool compress)
+{
+    m_max_bytes = max_bytes;
+    m_compress = compress;
+}
+
+/* 按刷新策略决定是否 fflush（调用前需持有 m_mutex）*/
+void Log::flush_by_policy(size_t n)
+{
+    // 读取缓存的单调时间，不进行系统调用
+    long long now_ms = Clock::getInstance()->mono_ms();
+
+    m_unflushed += n;
+    if (m_unflushed >= (size_t)m_flush_bytes || now_ms - m_last_flush_ms >= m_flush_interval_ms)
+    {
+        fflush(m_fp);
+        m_unflushed = 0;
+        m_last_flush_ms = now_ms;
+    }
+}
+
 
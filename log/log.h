@@ -11,7 +11,12 @@
 #include <string>
 #include <stdarg.h>
 #include <pthread.h>
-#include "block_queue.h"
+#include <atomic>
+#include <vector>
+#include "../lock/locker.h"
+#include "../timer/clock.h"
+#include "log_ring.h"
+#include "log_binary.h"
 
 using namespace std;
 
@@ -34,11 +39,47 @@ public:
     static void *flush_log_thread(void *)
     {
         Log::getInstance()->async_write_log();
+        return NULL;
     }
 
-    // 可选择的参数有日志文件、日志缓冲区大小、最大行数以及最长日志条队列
+    /* 后台线程：日志文件切分和切分后文件的压缩 */
+    static void *log_bg_thread(void *)
+    {
+        Log::getInstance()->bg_work();
+        return NULL;
+    }
+
+    /* 每线程无锁环形缓冲区模式下，后台线程把所有线程的环批量写入日志文件 */
+    static void *ring_drain_thread(void *)
+    {
+        Log::getInstance()->ring_drain();
+        return NULL;
+    }
+
+    // 可选择的参数有日志文件、日志缓冲区大小、最大行数、最长日志条队列以及每线程环形缓冲区大小
+    // ring_size >= 1 时使用每线程无锁环形缓冲区，优先于 max_queue_size
+    // binary 为 true 时（需配合 ring_size）写二进制日志，由 logdecode 还原为文本
     bool init(const char *file_name, int close_log, int log_buf_size = 8192, int spilt_lines = 5000000,
-              int max_queue_size = 0);
+              int max_queue_size = 0, int ring_size = 0, bool binary = false);
+
+    /* 登记一个调用点的格式串，返回格式ID（每个调用点只在第一次执行时调用一次）*/
+    int register_format(int level, const char *file, int line, const char *format);
+
+    /* LOG_* 宏的入口：二进制模式只记录格式ID和原始参数，否则按文本格式化 */
+    template <typename... Args>
+    void write_log_id(int fmt_id, int level, const char *format, Args... args)
+    {
+        if (m_is_binary)
+        {
+            LogRing *ring = thread_ring();
+            BinLogEncoder enc(thread_buf(), m_log_buf_size);
+            int expand[] = {0, (enc.arg(args), 0)...};
+            (void)expand;
+            ring->push(thread_buf(), enc.finish(fmt_id, level, Clock::getInstance()->mono_ns()));
+            return;
+        }
+        write_log(level, format, args...);
+    }
 
 
     /** 同步日志 （增加API的响应时间。日志记录操作需要占用主线程的资源）
@@ -47,8 +88,25 @@ public:
      * 服务器所能处理的并发能力将有所下降，尤其是在峰值的时候，写日志可能成为系统的瓶颈 */
     void write_log(int level, const char *format, ...);
 
+    /* 强制把 stdio 缓冲区写入文件（LOG_ERROR 和定时器滴答时调用）*/
     void flush();
 
+    /* 刷新策略：距上次刷新超过 interval_ms 毫秒，或未刷新字节数超过 bytes 时刷新，需在 init 之前设置 */
+    void set_flush_policy(int interval_ms, int bytes);
+
+    /* 切分策略：单个文件超过 max_bytes 字节时切分（0 不限制），compress 为 true 时后台 gzip 切分后的文件，需在 init 之前设置 */
+    void set_rotate_policy(long long max_bytes, bool compress);
+
+    /* 运行时日志级别（0:DEBUG 1:INFO 2:WARN 3:ERROR），低于该级别的日志不记录，可随时修改 */
+    void set_level(int level)
+    {
+        m_level.store(level < 0 ? 0 : (level > 3 ? 3 : level), std::memory_order_relaxed);
+    }
+    int get_level()
+    {
+        return m_level.load(std::memory_order_relaxed);
+    }
+
 private:
     Log();          // 私有构造函数
     virtual ~Log(); // 虚析构函数
@@ -56,62 +114,152 @@ private:
     /* 异步日志 
     （将日志记录操作放到另一个线程或进程中进行，而不会阻塞主线程）
     （日志记录操作不会影响主线程的执行，使得主线程能够更快地响应客户端请求）
-    将所写的日志内容先存入阻塞队列，写线程从阻塞队列中取出内容，写入日志 */
-    void *async_write_log()
+    双缓冲：工作线程把日志追加到前台缓冲区，写满或刷新间隔到期时与后台缓冲区交换，
+    写线程把整块后台缓冲区用一次 write 写入文件；没有逐行的内存分配和逐行的唤醒 */
+    void async_write_log();
+    void write_async_log(int level, const char *format, va_list valst);
+    /* 格式化一行文本日志，返回字节数（含换行）*/
+    int format_line(char *buf, int level, const char *format, va_list valst);
+
+    /* 按刷新策略决定是否 fflush（调用前需持有 m_mutex）*/
+    void flush_by_policy(size_t n);
+
+    /* 当前线程第一次写日志时，创建并登记它独占的环形缓冲区 */
+    LogRing *thread_ring();
+    /* 当前线程的格式化/编码缓冲区，第一次使用时创建 */
+    char *thread_buf();
+    /* 当前线程格式化一条日志写入自己的环，不加锁、不进行系统调用 */
+    void write_ring_log(int level, const char *format, va_list valst);
+    /* 后台线程：轮询所有环，用一次 writev 批量写入日志文件 */
+    void ring_drain();
+    /* 按日期/行数/字节数切分日志文件（只由写线程或后台线程调用）*/
+    void rotate(time_t now);
+    /* 是否需要切分：只比较预先计算的切分时间和行数/字节数上限 */
+    bool need_rotate(time_t now)
     {
-        string single_log;
-        // 从阻塞队列中取出一个日志string，写入文件
-        while (m_log_queue->pop(single_log))
-        {
-            m_mutex.lock();
-            fputs(single_log.c_str(), m_fp);    // 向Log文件中写入日志，
-            m_mutex.unlock();
-        }
+        return now >= m_next_rotate_sec || m_count >= m_split_lines || (m_max_bytes > 0 && m_file_bytes >= m_max_bytes);
     }
+    /* 同步日志：通知后台线程切分 */
+    void request_rotate();
+    /* 后台线程：切分、压缩、回收压缩子进程 */
+    void bg_work();
+    void compress_file(const string &file_name);
+    /* 同一天第 seq 个日志文件的文件名 */
+    void day_file_name(char *buf, const char *tail, int seq);
+    /* 按已有的文件确定同一天应当写入的文件序号（重启后不覆盖之前的文件）*/
+    int resume_file_seq(const char *tail);
+    /* 二进制日志：把尚未写出的格式字典写入当前文件，new_file 时先写文件头并重写全部字典 */
+    void write_binary_formats(int fd, bool new_file);
 
 private:
     char dir_name[128]; // Log文件保存路径
     char log_name[128]; // log文件名
     int m_split_lines;  // 日志文件最大行数（每一个日志文件）
     int m_log_buf_size; // 日志缓冲区大小(先存放在该缓冲区中)
-    long long m_count;  // 日志行数记录（仅当天）
+    long long m_count;  // 日志行数记录（当前文件）
     int m_today;        // 因为按天分类,记录当前时间是那一天
     FILE *m_fp;         // 打开log的文件指针
-    char *m_buf;        // 日志缓冲区数组指针
+    char m_file_name[256];  // 当前日志文件名
 
-    // （异步日志，将所写的日志内容先存入阻塞队列，写线程从阻塞队列中取出内容，写入日志）
-    BlockQueue<string> *m_log_queue; // 阻塞队列（用于异步日志）
+    // （文件切分，工作线程只做比较，打开/关闭文件在后台线程或写线程中完成）
+    long long m_file_bytes;             // 当前文件已写入的字节数
+    int m_file_seq;                     // 同一天内的切分序号
+    time_t m_next_rotate_sec;           // 下次按天切分的时间（本地零点）
+    long long m_max_bytes;              // 单个文件的字节数上限（0 不限制）
+    bool m_compress;                    // 是否压缩切分后的文件
+    std::atomic<bool> m_rotate_pending; // 同步日志：已通知后台线程切分
+    MutexLocker m_bg_mutex;             // 保护待压缩文件列表
+    Cond m_bg_cond;                     // 唤醒后台线程
+    vector<string> m_compress_files;    // 待压缩的文件
+    vector<pid_t> m_compress_pids;      // 正在运行的压缩子进程（后台线程使用）
+    bool m_bg_stop;                     // 通知后台线程退出
+    bool m_bg_started;                  // 后台线程是否已启动
+    pthread_t m_bg_tid;                 // 后台线程
+
+    // （异步日志，前后台双缓冲，写线程整块写入日志文件）
     bool m_is_async;                 // 是否异步标志位
+    MutexLocker m_async_mutex;       // 保护前后台缓冲区
+    Cond m_async_cond;               // 缓冲区写满/请求刷新时唤醒写线程
+    char *m_front_buf;               // 前台缓冲区（工作线程追加）
+    char *m_back_buf;                // 后台缓冲区（写线程写入文件）
+    size_t m_front_len;              // 前台缓冲区已用字节数
+    size_t m_back_len;               // 后台缓冲区待写字节数（0 表示空闲）
+    size_t m_async_buf_size;         // 每块缓冲区的字节数
+    long long m_async_lines;         // 前台缓冲区中的日志行数（用于按行数分割）
+    unsigned long m_async_dropped;   // 两块缓冲区都满时丢弃的日志条数
+    bool m_flush_request;            // ERROR 日志请求立即写出
+    bool m_async_stop;               // 通知写线程退出
+    pthread_t m_async_tid;           // 写线程
     MutexLocker m_mutex;             // 互斥锁（写日志文件的同步）
     int m_close_log;                 // 关闭日志
+    std::atomic<int> m_level;        // 运行时日志级别
+
+    // （刷新策略，避免每行日志一次 fflush 系统调用）
+    int m_flush_interval_ms;         // 刷新间隔（毫秒）
+    int m_flush_bytes;               // 未刷新字节数上限（同时作为 stdio 缓冲区大小）
+    size_t m_unflushed;              // 上次刷新后写入的字节数
+    long long m_last_flush_ms;       // 上次刷新时间（毫秒）
+
+    // （每线程环形缓冲区日志，工作线程只写自己的环，由刷盘线程统一批量写入）
+    bool m_is_ring;                     // 是否使用每线程环形缓冲区
+    int m_ring_size;                    // 每个线程环形缓冲区的字节数
+    std::atomic<LogRing *> m_rings;     // 所有线程的环（单链表头）
+    std::atomic<bool> m_ring_stop;      // 通知刷盘线程退出
+    pthread_t m_ring_tid;               // 刷盘线程
+
+    // （二进制日志，调用点只写格式ID和原始参数）
+    struct BinLogFormat
+    {
+        int level;
+        const char *file;
+        int line;
+        const char *format;
+    };
+    bool m_is_binary;                   // 是否写二进制日志
+    vector<BinLogFormat> m_formats;     // 格式字典，下标+1 即格式ID（受 m_mutex 保护）
+    size_t m_formats_written;           // 当前文件中已写出的字典条数（刷盘线程使用）
+    int m_text_fmt_id;                  // 直接调用 write_log 时使用的 "%s" 格式
+    int m_drop_fmt_id;                  // 环满丢弃告警使用的格式
 };
 
-#define LOG_DEBUG(format, ...)                                   \
-    if (0 == m_close_log)                                        \
-    {                                                            \
-        Log::getInstance()->write_log(0, format, ##__VA_ARGS__); \
-        Log::getInstance()->flush();                             \
-    }
+/* 编译期最低日志级别：低于该级别的 LOG_* 宏展开为空，参数也不会求值（make LOG_LEVEL=1）*/
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
 
-#define LOG_INFO(format, ...)                                    \
-    if (0 == m_close_log)                                        \
-    {                                                            \
-        Log::getInstance()->write_log(1, format, ##__VA_ARGS__); \
-        Log::getInstance()->flush();                             \
+/* 运行时级别过滤 + 调用点格式ID；只有 ERROR 强制刷新，其余由刷新策略决定 */
+#define LOG_WRITE(level, format, ...)                                                \
+    if (0 == m_close_log && level >= Log::getInstance()->get_level())                \
+    {                                                                                \
+        static const int _log_fmt_id =                                               \
+            Log::getInstance()->register_format(level, __FILE__, __LINE__, format); \
+        Log::getInstance()->write_log_id(_log_fmt_id, level, format, ##__VA_ARGS__); \
+        if (3 == level)                                                              \
+            Log::getInstance()->flush();                                             \
     }
 
-#define LOG_WARN(format, ...)                                    \
-    if (0 == m_close_log)                                        \
-    {                                                            \
-        Log::getInstance()->write_log(2, format, ##__VA_ARGS__); \
-        Log::getInstance()->flush();                             \
-    }
+#if LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(format, ...) LOG_WRITE(0, format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...)
+#endif
 
-#define LOG_ERROR(format, ...)                                   \
-    if (0 == m_close_log)                                        \
-    {                                                            \
-        Log::getInstance()->write_log(3, format, ##__VA_ARGS__); \
-        Log::getInstance()->flush();                             \
-    }
+#if LOG_MIN_LEVEL <= 1
+#define LOG_INFO(format, ...) LOG_WRITE(1, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...)
+#endif
+
+#if LOG_MIN_LEVEL <= 2
+#define LOG_WARN(format, ...) LOG_WRITE(2, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...)
+#endif
+
+#if LOG_MIN_LEVEL <= 3
+#define LOG_ERROR(format, ...) LOG_WRITE(3, format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...)
+#endif
 
 #endif // !LOG_H
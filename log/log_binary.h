@@ -0,0 +1,178 @@
+/**
+ * 二进制日志格式（NanoLog 思路）
+ * 每个 LOG_* 调用点第一次执行时登记自己的格式串，得到一个静态的格式ID；
+ * 热路径上只写入 格式ID + 单调时钟时间戳 + 原始参数，不调用 vsnprintf 格式化。
+ * 格式串字典随日志文件一起写出，由离线工具 logdecode 还原为文本日志。
+ *
+ * 文件布局：BinLogFileHeader，之后是若干条记录，每条记录以 BinLogRecord 开头
+ *   BINLOG_FORMAT : 格式字典，负载为 文件名 + 格式串（均为 uint16长度 + 字节）
+ *   BINLOG_ENTRY  : 一条日志，负载为 nargs 个参数（1字节类型 + 值）
+ */
+
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <type_traits>
+
+#define BINLOG_MAGIC "TWSBLOG1"
+#define BINLOG_VERSION 1
+
+// 记录类型
+enum BINLOG_RECORD
+{
+    BINLOG_FORMAT = 1, // 格式字典
+    BINLOG_ENTRY       // 日志
+};
+
+// 参数类型
+enum BINLOG_ARG
+{
+    BINLOG_ARG_INT = 'i',    // 有符号整数，8字节
+    BINLOG_ARG_UINT = 'u',   // 无符号整数，8字节
+    BINLOG_ARG_DOUBLE = 'd', // 浮点数，8字节
+    BINLOG_ARG_STR = 's',    // 字符串，uint16长度 + 字节
+    BINLOG_ARG_PTR = 'p'     // 指针，8字节
+};
+
+// 文件头：同一时刻采样的墙上时间和单调时间，用于把记录中的单调时间还原为日期
+struct BinLogFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    int64_t wall_ns;
+    int64_t mono_ns;
+};
+
+// 记录头
+struct BinLogRecord
+{
+    uint32_t length;  // 整条记录的字节数（含记录头）
+    uint8_t type;     // BINLOG_RECORD
+    uint8_t level;    // 日志级别
+    uint16_t nargs;   // 参数个数（BINLOG_ENTRY）
+    uint32_t fmt_id;  // 格式ID
+    uint32_t line;    // 调用点行号（BINLOG_FORMAT）
+    int64_t time_ns;  // 单调时钟时间戳（BINLOG_ENTRY）
+};
+
+/* 单调时钟（纳秒），clock_gettime 走 vDSO 不陷入内核 */
+inline int64_t binlog_now_ns(clockid_t clk = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* 把一条日志的原始参数编码到缓冲区，空间不足时截断字符串、丢弃后续参数 */
+class BinLogEncoder
+{
+public:
+    BinLogEncoder(char *buf, size_t cap) : mBuf(buf), mCap(cap), mLen(sizeof(BinLogRecord)), mArgs(0) {}
+
+    /* 整数（含枚举、bool、char） */
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type arg(T v)
+    {
+        if (std::is_signed<T>::value || std::is_enum<T>::value)
+        {
+            int64_t x = (int64_t)v;
+            put_arg(BINLOG_ARG_INT, &x, sizeof(x));
+        }
+        else
+        {
+            uint64_t x = (uint64_t)v;
+            put_arg(BINLOG_ARG_UINT, &x, sizeof(x));
+        }
+    }
+
+    /* 浮点数 */
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type arg(T v)
+    {
+        double x = v;
+        put_arg(BINLOG_ARG_DOUBLE, &x, sizeof(x));
+    }
+
+    /* 非字符指针，按地址记录 */
+    template <typename T>
+    void arg(const T *p)
+    {
+        uint64_t x = (uint64_t)(uintptr_t)p;
+        put_arg(BINLOG_ARG_PTR, &x, sizeof(x));
+    }
+
+    /* 字符串，复制内容（调用返回后原缓冲区可能被复用） */
+    void arg(const char *s)
+    {
+        if (!s)
+        {
+            s = "(null)";
+        }
+        size_t n = strlen(s);
+        size_t room = mCap - mLen;
+        if (room < 1 + sizeof(uint16_t))
+        {
+            return;
+        }
+        room -= 1 + sizeof(uint16_t);
+        if (n > room)
+        {
+            n = room;
+        }
+        if (n > 0xffff)
+        {
+            n = 0xffff;
+        }
+        uint16_t len = (uint16_t)n;
+        mBuf[mLen++] = BINLOG_ARG_STR;
+        memcpy(mBuf + mLen, &len, sizeof(len));
+        mLen += sizeof(len);
+        memcpy(mBuf + mLen, s, n);
+        mLen += n;
+        ++mArgs;
+    }
+
+    void arg(char *s)
+    {
+        arg((const char *)s);
+    }
+
+    /* 写入记录头，返回整条记录的字节数 */
+    size_t finish(uint32_t fmt_id, int level, int64_t time_ns)
+    {
+        BinLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.length = (uint32_t)mLen;
+        rec.type = BINLOG_ENTRY;
+        rec.level = (uint8_t)level;
+        rec.nargs = (uint16_t)mArgs;
+        rec.fmt_id = fmt_id;
+        rec.time_ns = time_ns;
+        memcpy(mBuf, &rec, sizeof(rec));
+        return mLen;
+    }
+
+private:
+    void put_arg(char tag, const void *v, size_t n)
+    {
+        if (mCap - mLen < 1 + n)
+        {
+            return;
+        }
+        mBuf[mLen++] = tag;
+        memcpy(mBuf + mLen, v, n);
+        mLen += n;
+        ++mArgs;
+    }
+
+    char *mBuf;
+    size_t mCap;
+    size_t mLen;
+    int mArgs;
+};
+
+#endif // !LOG_BINARY_H
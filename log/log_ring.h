@@ -0,0 +1,124 @@
+/**
+ * 单生产者单消费者(SPSC) 无锁环形字节缓冲区
+ * 每个写日志的线程独占一个环，只有该线程写入(生产者)，只有后台刷盘线程读出(消费者)
+ * 生产者只修改 mTail，消费者只修改 mHead，两端都不需要加锁
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <atomic>
+
+class LogRing
+{
+public:
+    // capacity 向上取整为2的幂，下标用 & (mCap - 1) 代替取模
+    explicit LogRing(size_t capacity)
+    {
+        mCap = 1;
+        while (mCap < capacity)
+        {
+            mCap <<= 1;
+        }
+        mBuf = new char[mCap];
+        mHead.store(0, std::memory_order_relaxed);
+        mTail.store(0, std::memory_order_relaxed);
+        mDropped.store(0, std::memory_order_relaxed);
+        mLines.store(0, std::memory_order_relaxed);
+        mClosed.store(false, std::memory_order_relaxed);
+        mNext = NULL;
+    }
+
+    ~LogRing()
+    {
+        delete[] mBuf;
+    }
+
+    /* 生产者：写入一整条日志，空间不足时整条丢弃并计数，绝不阻塞 */
+    bool push(const char *data, size_t len)
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        size_t head = mHead.load(std::memory_order_acquire);
+        if (mCap - (tail - head) < len)
+        {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        size_t pos = tail & (mCap - 1);
+        size_t first = mCap - pos;      // 到数组末尾为止的连续空间
+        if (first >= len)
+        {
+            memcpy(mBuf + pos, data, len);
+        }
+        else
+        {
+            memcpy(mBuf + pos, data, first);
+            memcpy(mBuf, data + first, len - first);
+        }
+
+        mLines.fetch_add(1, std::memory_order_relaxed);
+        mTail.store(tail + len, std::memory_order_release); // 发布数据
+        return true;
+    }
+
+    /* 消费者：取出当前可读区域，环形回绕时分成两段，返回可读字节数 */
+    size_t peek(struct iovec iov[2], int *iovcnt)
+    {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        size_t tail = mTail.load(std::memory_order_acquire);
+        size_t len = tail - head;
+        *iovcnt = 0;
+        if (0 == len)
+        {
+            return 0;
+        }
+
+        size_t pos = head & (mCap - 1);
+        size_t first = mCap - pos;
+        iov[0].iov_base = mBuf + pos;
+        if (first >= len)
+        {
+            iov[0].iov_len = len;
+            *iovcnt = 1;
+        }
+        else
+        {
+            iov[0].iov_len = first;
+            iov[1].iov_base = mBuf;
+            iov[1].iov_len = len - first;
+            *iovcnt = 2;
+        }
+        return len;
+    }
+
+    /* 消费者：数据写入文件后，释放len字节空间给生产者 */
+    void consume(size_t len)
+    {
+        mHead.store(mHead.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    bool empty()
+    {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+public:
+    std::atomic<unsigned long> mDropped; // 环满丢弃的日志条数
+    std::atomic<unsigned long> mLines;   // 写入的日志条数(用于按行数分割日志文件)
+    std::atomic<bool> mClosed;           // 所属线程已退出，刷盘线程读空后回收
+    LogRing *mNext;                      // 日志系统中所有环组成的单链表
+
+private:
+    char *mBuf;
+    size_t mCap;
+
+    // 生产者、消费者各自修改的下标放在不同缓存行，避免伪共享
+    alignas(64) std::atomic<size_t> mHead; // 消费者读位置（只增不减）
+    alignas(64) std::atomic<size_t> mTail; // 生产者写位置（只增不减）
+};
+
+#endif // !LOG_RING_H
@@ -0,0 +1,361 @@
+/*******************************************************
+ * logdecode : 把二进制日志（-l 3）还原为文本日志
+ * 用法：./logdecode [-v] 日志文件...
+ *   -v : 每行附带调用点 文件名:行号
+ * 输出格式与文本日志相同：日期 时间.微秒 [级别]: 内容
+ ********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <map>
+#include <vector>
+
+#include "log_binary.h"
+
+using namespace std;
+
+// 格式字典中的一项
+struct Format
+{
+    int level;
+    string file;
+    int line;
+    string format;
+};
+
+// 一条日志中的一个参数
+struct Arg
+{
+    char type;
+    int64_t i;
+    uint64_t u;
+    double d;
+    string s;
+};
+
+static const char *level_name(int level)
+{
+    switch (level)
+    {
+    case 0:
+        return "[DEBUG]:";
+    case 2:
+        return "[WARN]:";
+    case 3:
+        return "[ERROR]:";
+    default:
+        return "[INFO]:";
+    }
+}
+
+/* 读取一个带16位长度前缀的字符串，越过记录末尾时返回 false */
+static bool read_str(const char *&p, const char *end, string &out)
+{
+    uint16_t len;
+    if (end - p < (long)sizeof(len))
+        return false;
+    memcpy(&len, p, sizeof(len));
+    p += sizeof(len);
+    if (end - p < len)
+        return false;
+    out.assign(p, len);
+    p += len;
+    return true;
+}
+
+/* 解析记录负载中的参数 */
+static bool read_args(const char *p, const char *end, int nargs, vector<Arg> &args)
+{
+    for (int k = 0; k < nargs; ++k)
+    {
+        if (p >= end)
+            return false;
+
+        Arg a;
+        a.type = *p++;
+        a.i = 0;
+        a.u = 0;
+        a.d = 0;
+        if (a.type == BINLOG_ARG_STR)
+        {
+            if (!read_str(p, end, a.s))
+                return false;
+        }
+        else
+        {
+            if (end - p < 8)
+                return false;
+            if (a.type == BINLOG_ARG_INT)
+                memcpy(&a.i, p, 8);
+            else if (a.type == BINLOG_ARG_DOUBLE)
+                memcpy(&a.d, p, 8);
+            else
+                memcpy(&a.u, p, 8);
+            p += 8;
+        }
+        args.push_back(a);
+    }
+    return true;
+}
+
+/* 取出 * 宽度/精度对应的整数参数（写入时按 int 实参记录）*/
+static bool star_arg(const vector<Arg> &args, size_t &next, long long &v)
+{
+    if (next >= args.size())
+        return false;
+    const Arg &a = args[next++];
+    v = a.type == BINLOG_ARG_INT ? (long long)a.i : (long long)a.u;
+    return true;
+}
+
+/* 按格式串依次取出参数，逐个转换说明符交给 snprintf 格式化 */
+static string render(const string &format, const vector<Arg> &args)
+{
+    string out;
+    size_t next = 0;
+    char buf[4096];
+
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        if (format[i] != '%')
+        {
+            out += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%')
+        {
+            out += '%';
+            ++i;
+            continue;
+        }
+
+        // 取出一个完整的转换说明：%[标志][宽度][.精度][长度]转换符
+        // 宽度、精度为 * 时各多消耗一个整数参数，把取到的值写入说明符
+        size_t j = i + 1;
+        string spec = "%";
+        bool missing = false;
+        long long star;
+        while (j < format.size() && strchr("-+ #0", format[j]))
+            spec += format[j++];
+        if (j < format.size() && format[j] == '*')
+        {
+            ++j;
+            if (star_arg(args, next, star))
+                spec += to_string(star);    // 负宽度即左对齐，"%-5d" 与 printf 的含义相同
+            else
+                missing = true;
+        }
+        while (j < format.size() && isdigit((unsigned char)format[j]))
+            spec += format[j++];
+        if (j < format.size() && format[j] == '.')
+        {
+            ++j;
+            if (j < format.size() && format[j] == '*')
+            {
+                ++j;
+                if (!star_arg(args, next, star))
+                    missing = true;
+                else if (star >= 0)
+                    spec += "." + to_string(star); // 负精度等同于没有精度
+            }
+            else
+            {
+                spec += '.';
+                while (j < format.size() && isdigit((unsigned char)format[j]))
+                    spec += format[j++];
+            }
+        }
+        while (j < format.size() && strchr("hlLqjzt", format[j]))
+            ++j; // 长度修饰符按参数的实际类型重新生成
+        if (j >= format.size())
+        {
+            out += format.substr(i);
+            break;
+        }
+        char conv = format[j];
+        i = j;
+
+        if (missing || next >= args.size())
+        {
+            out += "<missing>";
+            continue;
+        }
+        const Arg &a = args[next++];
+
+        if (conv == 's')
+        {
+            snprintf(buf, sizeof(buf), (spec + "s").c_str(), a.type == BINLOG_ARG_STR ? a.s.c_str() : "<bad>");
+        }
+        else if (conv == 'c')
+        {
+            snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)(a.type == BINLOG_ARG_INT ? a.i : a.u));
+        }
+        else if (strchr("fFeEgGaA", conv))
+        {
+            double v = a.type == BINLOG_ARG_DOUBLE ? a.d : (a.type == BINLOG_ARG_INT ? (double)a.i : (double)a.u);
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), v);
+        }
+        else if (conv == 'p')
+        {
+            snprintf(buf, sizeof(buf), (spec + "p").c_str(), (void *)(uintptr_t)a.u);
+        }
+        else if (conv == 'd' || conv == 'i')
+        {
+            long long v = a.type == BINLOG_ARG_INT ? (long long)a.i : (long long)a.u;
+            snprintf(buf, sizeof(buf), (spec + "lld").c_str(), v);
+        }
+        else if (strchr("uxXo", conv))
+        {
+            unsigned long long v = a.type == BINLOG_ARG_INT ? (unsigned long long)a.i : (unsigned long long)a.u;
+            snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), v);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "<%%%c?>", conv);
+        }
+        out += buf;
+    }
+    return out;
+}
+
+/* 解码一个二进制日志文件，输出到 stdout */
+static bool decode_file(const char *path, bool verbose)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "logdecode: cannot open %s\n", path);
+        return false;
+    }
+
+    map<uint32_t, Format> formats;
+    int64_t wall_ns = 0;
+    int64_t mono_ns = 0;
+    bool ok = true;
+    vector<char> rec;
+
+    while (true)
+    {
+        // 文件头（轮转后的每个文件开头都有一个）
+        char magic[8];
+        size_t n = fread(magic, 1, sizeof(uint32_t), fp);
+        if (n == 0)
+            break;
+        if (n < sizeof(uint32_t))
+        {
+            fprintf(stderr, "logdecode: %s: truncated record\n", path);
+            ok = false;
+            break;
+        }
+        if (memcmp(magic, BINLOG_MAGIC, sizeof(uint32_t)) == 0)
+        {
+            BinLogFileHeader hdr;
+            memcpy(&hdr, magic, sizeof(uint32_t));
+            if (fread((char *)&hdr + sizeof(uint32_t), 1, sizeof(hdr) - sizeof(uint32_t), fp) != sizeof(hdr) - sizeof(uint32_t) ||
+                memcmp(hdr.magic, BINLOG_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != BINLOG_VERSION)
+            {
+                fprintf(stderr, "logdecode: %s: bad file header\n", path);
+                ok = false;
+                break;
+            }
+            wall_ns = hdr.wall_ns;
+            mono_ns = hdr.mono_ns;
+            continue;
+        }
+
+        // 记录
+        uint32_t length;
+        memcpy(&length, magic, sizeof(length));
+        if (length < sizeof(BinLogRecord))
+        {
+            fprintf(stderr, "logdecode: %s: bad record length %u\n", path, length);
+            ok = false;
+            break;
+        }
+        rec.resize(length);
+        memcpy(&rec[0], &length, sizeof(length));
+        if (fread(&rec[sizeof(length)], 1, length - sizeof(length), fp) != length - sizeof(length))
+        {
+            fprintf(stderr, "logdecode: %s: truncated record\n", path);
+            ok = false;
+            break;
+        }
+
+        BinLogRecord hdr;
+        memcpy(&hdr, &rec[0], sizeof(hdr));
+        const char *p = &rec[0] + sizeof(hdr);
+        const char *end = &rec[0] + length;
+
+        if (hdr.type == BINLOG_FORMAT)
+        {
+            Format f;
+            f.level = hdr.level;
+            f.line = hdr.line;
+            if (!read_str(p, end, f.file) || !read_str(p, end, f.format))
+            {
+                fprintf(stderr, "logdecode: %s: truncated format record\n", path);
+                ok = false;
+                break;
+            }
+            formats[hdr.fmt_id] = f;
+        }
+        else if (hdr.type == BINLOG_ENTRY)
+        {
+            // 单调时间 -> 墙上时间
+            int64_t t = wall_ns + (hdr.time_ns - mono_ns);
+            time_t sec = (time_t)(t / 1000000000LL);
+            long usec = (long)(t % 1000000000LL) / 1000;
+            struct tm my_tm;
+            localtime_r(&sec, &my_tm);
+
+            vector<Arg> args;
+            map<uint32_t, Format>::iterator it = formats.find(hdr.fmt_id);
+            string msg;
+            if (it == formats.end())
+                msg = "<unknown format id>";
+            else if (!read_args(p, end, hdr.nargs, args))
+                msg = "<corrupt arguments>";
+            else
+                msg = render(it->second.format, args);
+
+            printf("%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
+                   my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
+                   my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, usec, level_name(hdr.level));
+            if (verbose && it != formats.end())
+                printf("(%s:%d) ", it->second.file.c_str(), it->second.line);
+            printf("%s\n", msg.c_str());
+        }
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "v")) != -1)
+    {
+        if (opt == 'v')
+            verbose = true;
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-v] logfile...\n", argv[0]);
+        return 1;
+    }
+
+    int ret = 0;
+    for (int i = optind; i < argc; ++i)
+    {
+        if (!decode_file(argv[i], verbose))
+            ret = 1;
+    }
+    return ret;
+}
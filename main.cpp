@@ -19,7 +19,12 @@ int main(int argc, char *argv[])
 
     // 初始化（将解析的命令行参数）
     server.init(config.Port, user, passwd, databasename, config.LogWrite, config.OptLinger, 
-                config.TrigMode,  config.sql_num,  config.thread_num, config.close_log, config.actor_model);
+                config.TrigMode,  config.sql_num,  config.thread_num, config.close_log, config.actor_model,
+                config.log_level, config.log_compress, config.user_snapshot, config.async_db,
+                config.register_batch, config.user_store, config.metrics_port,
+                config.trace_slow_ms, config.shm_stats_ms, config.codel_target_ms,
+                config.ip_max_conns, config.ip_rate, config.accept_budget,
+                config.listen_backlog, config.defer_accept);
     // 日志
     server.log_write();
     // 数据库
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+#include "shm_stats.h"
+#include "../log/log.h"
+
+const uint64_t METRICS_LATENCY_BOUNDS_US[METRICS_LATENCY_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000};
+
+const uint64_t METRICS_STAGE_BOUNDS_US[METRICS_STAGE_BUCKETS] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 10000, 50000, 250000, 1000000};
+
+const char *TRACE_STAGE_NAMES[TRACE_MARK_NUM] = {
+    "epoll", "dispatch", "queue", "read", "parse", "handle", "respond", "send"};
+
+static const char *counter_names[M_COUNTER_NUM][2] = {
+    {"tws_accepts_total", "Accepted client connections."},
+    {"tws_accept_errors_total", "Failed accept calls."},
+    {"tws_connections_rejected_total", "Connections closed because the server was full."},
+    {"tws_bytes_in_total", "Bytes read from clients."},
+    {"tws_bytes_out_total", "Bytes written to clients."},
+    {"tws_timer_expirations_total", "Connections closed by the idle timer."},
+    {"tws_read_timeouts_total", "Connections closed because a request was not read within its deadline."},
+    {"tws_shed_queue_full_total", "Requests answered with 503 because the thread pool queue was full."},
+    {"tws_shed_queue_delay_total", "Requests answered with 503 because queueing delay stayed above the target."},
+    {"tws_accept_pauses_total", "Times accepting was paused near the connection or file descriptor limit."},
+    {"tws_connections_ip_limited_total", "Connections closed at accept because their IP was over its limits."},
+    {"tws_requests_rate_limited_total", "Requests answered with 429 because their IP was over its request rate."},
+};
+
+static const char *gauge_names[G_GAUGE_NUM][2] = {
+    {"tws_queue_depth", "Tasks waiting in the thread pool queue."},
+};
+
+static const char *route_names[R_ROUTE_NUM] = {"static", "login", "register", "page", "other"};
+static const char *status_names[S_STATUS_NUM] = {"200", "400", "403", "404", "429", "500", "503", "other"};
+
+static_assert(R_ROUTE_NUM <= SHM_STATS_MAX_ROUTES, "shm stats segment has too few route slots");
+
+// 所有分片的汇总
+struct MetricsTotals
+{
+    uint64_t counters[M_COUNTER_NUM];
+    int64_t gauges[G_GAUGE_NUM];
+    uint64_t requests[R_ROUTE_NUM][S_STATUS_NUM];
+    uint64_t latency[R_ROUTE_NUM][METRICS_LATENCY_BUCKETS + 1];
+    uint64_t latency_sum_us[R_ROUTE_NUM];
+    uint64_t stage[TRACE_MARK_NUM][METRICS_STAGE_BUCKETS + 1];
+    uint64_t stage_sum_ns[TRACE_MARK_NUM];
+    uint64_t busy_ns[SHM_STATS_MAX_WORKERS];
+    uint64_t tasks[SHM_STATS_MAX_WORKERS];
+    int worker_num;
+};
+
+Metrics::Metrics() : m_worker_num(0), m_listenfd(-1), m_close_log(1), m_shm(NULL), m_shm_interval_ms(0),
+                     m_connections(NULL)
+{
+    m_shm_name[0] = '\0';
+}
+
+Metrics::~Metrics()
+{
+}
+
+int Metrics::status_index(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return S_200;
+    case 400:
+        return S_400;
+    case 403:
+        return S_403;
+    case 404:
+        return S_404;
+    case 429:
+        return S_429;
+    case 500:
+        return S_500;
+    case 503:
+        return S_503;
+    default:
+        return S_OTHER;
+    }
+}
+
+/* 线程第一次更新指标时调用：分配分片并加入列表（线程退出后分片保留，其计数仍计入总和）*/
+MetricsShard *Metrics::register_shard()
+{
+    MetricsShard *s = new MetricsShard;
+    for (int i = 0; i < M_COUNTER_NUM; ++i)
+        s->counters[i].store(0, std::memory_order_relaxed);
+    for (int i = 0; i < G_GAUGE_NUM; ++i)
+        s->gauges[i].store(0, std::memory_order_relaxed);
+    for (int r = 0; r < R_ROUTE_NUM; ++r)
+    {
+        for (int i = 0; i < S_STATUS_NUM; ++i)
+            s->requests[r][i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i <= METRICS_LATENCY_BUCKETS; ++i)
+            s->latency[r][i].store(0, std::memory_order_relaxed);
+        s->latency_sum_us[r].store(0, std::memory_order_relaxed);
+    }
+    for (int m = 0; m < TRACE_MARK_NUM; ++m)
+    {
+        for (int i = 0; i <= METRICS_STAGE_BUCKETS; ++i)
+            s->stage[m][i].store(0, std::memory_order_relaxed);
+        s->stage_sum_ns[m].store(0, std::memory_order_relaxed);
+    }
+    s->worker = -1;
+    s->busy_ns.store(0, std::memory_order_relaxed);
+    s->tasks.store(0, std::memory_order_relaxed);
+    m_lock.lock();
+    m_shards.push_back(s);
+    m_lock.unlock();
+    return s;
+}
+
+int Metrics::register_worker()
+{
+    MetricsShard *s = shard();
+    m_lock.lock();
+    s->worker = m_worker_num++;
+    m_lock.unlock();
+    return s->worker;
+}
+
+void Metrics::add_collector(Collector c)
+{
+    m_lock.lock();
+    m_collectors.push_back(c);
+    m_lock.unlock();
+}
+
+static void append_header(std::string &out, const char *name, const char *help, const char *type)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+/* 汇总：各分片的值由所属线程单独写入，读到的是某个时刻之后的值，各指标之间不要求一致 */
+void Metrics::sum_shards(MetricsTotals *t)
+{
+    memset(t, 0, sizeof(*t));
+    m_lock.lock();
+    for (size_t k = 0; k < m_shards.size(); ++k)
+    {
+        MetricsShard *s = m_shards[k];
+        for (int i = 0; i < M_COUNTER_NUM; ++i)
+            t->counters[i] += s->counters[i].load(std::memory_order_relaxed);
+        for (int i = 0; i < G_GAUGE_NUM; ++i)
+            t->gauges[i] += s->gauges[i].load(std::memory_order_relaxed);
+        for (int r = 0; r < R_ROUTE_NUM; ++r)
+        {
+            for (int i = 0; i < S_STATUS_NUM; ++i)
+                t->requests[r][i] += s->requests[r][i].load(std::memory_order_relaxed);
+            for (int i = 0; i <= METRICS_LATENCY_BUCKETS; ++i)
+                t->latency[r][i] += s->latency[r][i].load(std::memory_order_relaxed);
+            t->latency_sum_us[r] += s->latency_sum_us[r].load(std::memory_order_relaxed);
+        }
+        for (int m = 0; m < TRACE_MARK_NUM; ++m)
+        {
+            for (int i = 0; i <= METRICS_STAGE_BUCKETS; ++i)
+                t->stage[m][i] += s->stage[m][i].load(std::memory_order_relaxed);
+            t->stage_sum_ns[m] += s->stage_sum_ns[m].load(std::memory_order_relaxed);
+        }
+        if (s->worker >= 0 && s->worker < SHM_STATS_MAX_WORKERS)
+        {
+            t->busy_ns[s->worker] = s->busy_ns.load(std::memory_order_relaxed);
+            t->tasks[s->worker] = s->tasks.load(std::memory_order_relaxed);
+        }
+    }
+    t->worker_num = m_worker_num < SHM_STATS_MAX_WORKERS ? m_worker_num : SHM_STATS_MAX_WORKERS;
+    m_lock.unlock();
+}
+
+void Metrics::scrape(std::string &out)
+{
+    MetricsTotals *t = new MetricsTotals;
+    sum_shards(t);
+
+    m_lock.lock();
+    std::vector<Collector> collectors = m_collectors;
+    m_lock.unlock();
+
+    char line[256];
+    for (int i = 0; i < M_COUNTER_NUM; ++i)
+    {
+        append_header(out, counter_names[i][0], counter_names[i][1], "counter");
+        snprintf(line, sizeof(line), "%s %llu\n", counter_names[i][0], (unsigned long long)t->counters[i]);
+        out += line;
+    }
+    for (int i = 0; i < G_GAUGE_NUM; ++i)
+    {
+        append_header(out, gauge_names[i][0], gauge_names[i][1], "gauge");
+        snprintf(line, sizeof(line), "%s %lld\n", gauge_names[i][0], (long long)t->gauges[i]);
+        out += line;
+    }
+
+    append_header(out, "tws_requests_total", "Completed responses by route and status.", "counter");
+    for (int r = 0; r < R_ROUTE_NUM; ++r)
+        for (int i = 0; i < S_STATUS_NUM; ++i)
+        {
+            snprintf(line, sizeof(line), "tws_requests_total{route=\"%s\",status=\"%s\"} %llu\n",
+                     route_names[r], status_names[i], (unsigned long long)t->requests[r][i]);
+            out += line;
+        }
+
+    // 直方图：桶为累计计数，时间单位为秒
+    append_header(out, "tws_request_duration_seconds", "Time from the first request byte to the last response byte.", "histogram");
+    for (int r = 0; r < R_ROUTE_NUM; ++r)
+    {
+        uint64_t cumulative = 0;
+        for (int i = 0; i < METRICS_LATENCY_BUCKETS; ++i)
+        {
+            cumulative += t->latency[r][i];
+            snprintf(line, sizeof(line), "tws_request_duration_seconds_bucket{route=\"%s\",le=\"%g\"} %llu\n",
+                     route_names[r], METRICS_LATENCY_BOUNDS_US[i] / 1e6, (unsigned long long)cumulative);
+            out += line;
+        }
+        cumulative += t->latency[r][METRICS_LATENCY_BUCKETS];
+        snprintf(line, sizeof(line), "tws_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %llu\n",
+                 route_names[r], (unsigned long long)cumulative);
+        out += line;
+        snprintf(line, sizeof(line), "tws_request_duration_seconds_sum{route=\"%s\"} %.6f\n",
+                 route_names[r], t->latency_sum_us[r] / 1e6);
+        out += line;
+        snprintf(line, sizeof(line), "tws_request_duration_seconds_count{route=\"%s\"} %llu\n",
+                 route_names[r], (unsigned long long)cumulative);
+        out += line;
+    }
+
+    // 阶段耗时（只在开启追踪 -T 时有数据）；起点 epoll 没有对应的阶段
+    append_header(out, "tws_stage_duration_seconds", "Time spent in each request pipeline stage.", "histogram");
+    for (int m = TRACE_EPOLL + 1; m < TRACE_MARK_NUM; ++m)
+    {
+        uint64_t cumulative = 0;
+        for (int i = 0; i < METRICS_STAGE_BUCKETS; ++i)
+        {
+            cumulative += t->stage[m][i];
+            snprintf(line, sizeof(line), "tws_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                     TRACE_STAGE_NAMES[m], METRICS_STAGE_BOUNDS_US[i] / 1e6, (unsigned long long)cumulative);
+            out += line;
+        }
+        cumulative += t->stage[m][METRICS_STAGE_BUCKETS];
+        snprintf(line, sizeof(line), "tws_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                 TRACE_STAGE_NAMES[m], (unsigned long long)cumulative);
+        out += line;
+        snprintf(line, sizeof(line), "tws_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n",
+                 TRACE_STAGE_NAMES[m], t->stage_sum_ns[m] / 1e9);
+        out += line;
+        snprintf(line, sizeof(line), "tws_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+                 TRACE_STAGE_NAMES[m], (unsigned long long)cumulative);
+        out += line;
+    }
+
+    // 工作线程繁忙时间（利用率 = 一段时间内的增量 / 时间）
+    append_header(out, "tws_worker_busy_seconds_total", "Time each thread pool worker spent running tasks.", "counter");
+    for (int w = 0; w < t->worker_num; ++w)
+    {
+        snprintf(line, sizeof(line), "tws_worker_busy_seconds_total{worker=\"%d\"} %.6f\n", w, t->busy_ns[w] / 1e9);
+        out += line;
+    }
+    append_header(out, "tws_worker_tasks_total", "Tasks run by each thread pool worker.", "counter");
+    for (int w = 0; w < t->worker_num; ++w)
+    {
+        snprintf(line, sizeof(line), "tws_worker_tasks_total{worker=\"%d\"} %llu\n", w, (unsigned long long)t->tasks[w]);
+        out += line;
+    }
+    delete t;
+
+    for (size_t i = 0; i < collectors.size(); ++i)
+        collectors[i](out);
+}
+
+bool Metrics::serve(int port, int close_log)
+{
+    m_close_log = close_log;
+
+    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    if (m_listenfd < 0)
+        return false;
+    int reuse = 1;
+    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // 内部端口：只监听本机回环地址
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(m_listenfd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(m_listenfd, 16) < 0)
+    {
+        LOG_ERROR("metrics: listen on port %d failed, errno is:%d", port, errno);
+        close(m_listenfd);
+        m_listenfd = -1;
+        return false;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, serve_thread, this) != 0)
+    {
+        close(m_listenfd);
+        m_listenfd = -1;
+        return false;
+    }
+    pthread_detach(tid);
+    LOG_INFO("metrics: serving /metrics on 127.0.0.1:%d", port);
+    return true;
+}
+
+void *Metrics::serve_thread(void *arg)
+{
+    ((Metrics *)arg)->run_server();
+    return NULL;
+}
+
+/* 抓取线程：阻塞地逐个处理请求，每个连接只应答一次后关闭 */
+void Metrics::run_server()
+{
+    while (true)
+    {
+        int connfd = accept(m_listenfd, NULL, NULL);
+        if (connfd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("metrics: accept error, errno is:%d", errno);
+            usleep(100000);
+            continue;
+        }
+
+        // 抓取端不发完请求头时不会一直阻塞
+        struct timeval tv = {1, 0};
+        setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        char req[2048];
+        int len = 0;
+        while (len < (int)sizeof(req) - 1)
+        {
+            int n = recv(connfd, req + len, sizeof(req) - 1 - len, 0);
+            if (n <= 0)
+                break;
+            len += n;
+            req[len] = '\0';
+            if (strstr(req, "\r\n\r\n") != NULL)
+                break;
+        }
+        req[len] = '\0';
+
+        std::string body;
+        const char *status = "200 OK";
+        if (strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET /metrics?", 13) == 0)
+            scrape(body);
+        else
+        {
+            status = "404 Not Found";
+            body = "try /metrics\n";
+        }
+
+        char head[256];
+        int head_len = snprintf(head, sizeof(head),
+                                "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                "Content-Length: %d\r\nConnection: close\r\n\r\n",
+                                status, (int)body.size());
+        std::string resp(head, head_len);
+        resp += body;
+        size_t sent = 0;
+        while (sent < resp.size())
+        {
+            ssize_t n = send(connfd, resp.data() + sent, resp.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        close(connfd);
+    }
+}
+
+bool Metrics::publish_shm(int port, int interval_ms, std::atomic<int> *connections)
+{
+    shm_stats_name(m_shm_name, sizeof(m_shm_name), port);
+    // 上次异常退出留下的段先删除，webtop 不会读到旧进程的数据
+    shm_unlink(m_shm_name);
+    int fd = shm_open(m_shm_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR("metrics: shm_open %s failed, errno is:%d", m_shm_name, errno);
+        return false;
+    }
+    if (ftruncate(fd, sizeof(ShmStats)) < 0)
+    {
+        LOG_ERROR("metrics: ftruncate %s failed, errno is:%d", m_shm_name, errno);
+        close(fd);
+        shm_unlink(m_shm_name);
+        return false;
+    }
+    void *addr = mmap(NULL, sizeof(ShmStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        shm_unlink(m_shm_name);
+        return false;
+    }
+
+    // 新建的段内容全为0，只需填写只写一次的字段，最后发布 magic
+    ShmStats *shm = (ShmStats *)addr;
+    shm->version = SHM_STATS_VERSION;
+    shm->size = sizeof(ShmStats);
+    shm->pid = getpid();
+    shm->port = port;
+    shm->interval_ms = interval_ms;
+    shm->route_num = R_ROUTE_NUM;
+    for (int r = 0; r < R_ROUTE_NUM; ++r)
+        snprintf(shm->route_names[r], SHM_STATS_NAME_LEN, "%s", route_names[r]);
+    shm->magic.store(SHM_STATS_MAGIC, std::memory_order_release);
+
+    m_shm = shm;
+    m_shm_interval_ms = interval_ms;
+    m_connections = connections;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, publish_thread, this) != 0)
+    {
+        unpublish_shm();
+        return false;
+    }
+    pthread_detach(tid);
+    LOG_INFO("metrics: publishing stats to /dev/shm%s every %dms", m_shm_name, interval_ms);
+    return true;
+}
+
+/* 进程退出前删除段名（已映射的 webtop 仍可读取到最后一次发布的值）*/
+void Metrics::unpublish_shm()
+{
+    if (m_shm_name[0] != '\0')
+        shm_unlink(m_shm_name);
+}
+
+void *Metrics::publish_thread(void *arg)
+{
+    ((Metrics *)arg)->run_publisher();
+    return NULL;
+}
+
+/* 发布线程：定期汇总所有分片写入共享内存，读者不需要与服务器交互 */
+void Metrics::run_publisher()
+{
+    ShmStats *shm = m_shm;
+    MetricsTotals *t = new MetricsTotals;
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    while (true)
+    {
+        sum_shards(t);
+        // 顺序锁：seq 为奇数期间读者丢弃读到的样本
+        shm->seq.store(shm->seq.load(relaxed) + 1, relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint64_t errors = 0;
+        for (int r = 0; r < R_ROUTE_NUM; ++r)
+        {
+            uint64_t total = 0;
+            for (int i = 0; i < S_STATUS_NUM; ++i)
+                total += t->requests[r][i];
+            shm->requests[r].store(total, relaxed);
+            errors += total - t->requests[r][S_200];
+        }
+        shm->errors.store(errors, relaxed);
+        shm->connections.store(m_connections ? m_connections->load(relaxed) : 0, relaxed);
+        shm->queue_depth.store(t->gauges[G_QUEUE_DEPTH], relaxed);
+        shm->accepts.store(t->counters[M_ACCEPTS], relaxed);
+        shm->rejected.store(t->counters[M_CONN_REJECTED], relaxed);
+        shm->bytes_in.store(t->counters[M_BYTES_IN], relaxed);
+        shm->bytes_out.store(t->counters[M_BYTES_OUT], relaxed);
+        shm->timer_expirations.store(t->counters[M_TIMER_EXPIRATIONS], relaxed);
+        for (int w = 0; w < t->worker_num; ++w)
+        {
+            shm->workers[w].busy_ns.store(t->busy_ns[w], relaxed);
+            shm->workers[w].tasks.store(t->tasks[w], relaxed);
+        }
+        shm->worker_num.store(t->worker_num, relaxed);
+        shm->update_ns.store(metrics_now_ns(), relaxed);
+        shm->seq.store(shm->seq.load(relaxed) + 1, std::memory_order_release);
+
+        usleep(m_shm_interval_ms * 1000);
+    }
+}
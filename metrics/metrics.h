@@ -0,0 +1,249 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "../lock/locker.h"
+
+/**
+ * 运行指标（单例模式）
+ * 每个线程第一次更新指标时分配自己的分片（按缓存行对齐），之后只写自己的分片：
+ * 同一个计数器只有一个写者，relaxed 读-加-写即可，没有原子 RMW 指令和缓存行争用。
+ * 抓取时遍历所有分片求和（分片随线程注册，进程结束前不释放），
+ * 以 Prometheus 文本格式（text/plain; version=0.0.4）在独立的内部端口输出 /metrics
+ */
+
+// 计数器（只增不减）
+enum METRIC_COUNTER
+{
+    M_ACCEPTS = 0,          // 接受的连接数
+    M_ACCEPT_ERRORS,        // accept 失败次数
+    M_CONN_REJECTED,        // 连接数已满被拒绝的连接数
+    M_BYTES_IN,             // 读入的字节数
+    M_BYTES_OUT,            // 写出的字节数
+    M_TIMER_EXPIRATIONS,    // 超时关闭的连接数
+    M_READ_TIMEOUTS,        // 其中请求没有在读取期限内读完（慢速攻击防护）的连接数
+    M_SHED_QUEUE_FULL,      // 线程池队列已满，回复 503 的请求数
+    M_SHED_QUEUE_DELAY,     // 排队时间过长（CoDel），回复 503 的请求数
+    M_ACCEPT_PAUSES,        // 连接数接近上限或文件描述符耗尽，暂停 accept 的次数
+    M_CONN_IP_LIMITED,      // 单IP连接数或请求速率超限，accept 后直接关闭的连接数
+    M_REQUESTS_RATE_LIMITED,// 单IP请求速率超限，回复 429 的请求数
+    M_COUNTER_NUM
+};
+
+// 增量仪表：各分片保存增减量，抓取时求和（加、减可以发生在不同线程）
+enum METRIC_GAUGE
+{
+    G_QUEUE_DEPTH = 0,      // 线程池工作队列中等待的任务数
+    G_GAUGE_NUM
+};
+
+// 请求路由（与 do_request 中 url 最后一段的首字符对应）
+enum METRIC_ROUTE
+{
+    R_STATIC = 0,   // 静态文件
+    R_LOGIN,        // POST /2 登录
+    R_REGISTER,     // POST /3 注册
+    R_PAGE,         // /0 /1 /5 /6 /7 跳转页面
+    R_OTHER,        // 请求行无法解析
+    R_ROUTE_NUM
+};
+
+// 响应状态码
+enum METRIC_STATUS
+{
+    S_200 = 0,
+    S_400,
+    S_403,
+    S_404,
+    S_429,
+    S_500,
+    S_503,
+    S_OTHER,
+    S_STATUS_NUM
+};
+
+// 请求延迟直方图的桶上界（微秒），最后一个桶为 +Inf
+const int METRICS_LATENCY_BUCKETS = 14;
+extern const uint64_t METRICS_LATENCY_BOUNDS_US[METRICS_LATENCY_BUCKETS];
+
+/**
+ * 请求处理流水线上的时间点（http_conn 阶段耗时追踪）
+ * 阶段耗时 = 该时间点 - 按时间先后的上一个时间点；reactor、proactor 下时间点的先后不同
+ * （proactor 主线程先读再入队，reactor 工作线程出队后读），按时间排序后计算即可
+ */
+enum TRACE_MARK
+{
+    TRACE_EPOLL = 0,    // epoll_wait 返回可读事件（起点，没有对应的阶段）
+    TRACE_QUEUED,       // 放入线程池队列        阶段 dispatch
+    TRACE_DEQUEUED,     // 工作线程取出          阶段 queue
+    TRACE_READ,         // read_once 读入数据    阶段 read
+    TRACE_PARSED,       // 解析出完整请求        阶段 parse
+    TRACE_HANDLED,      // do_request 完成（含用户表、数据库查询） 阶段 handle
+    TRACE_RESPONSE,     // process_write 生成响应 阶段 respond
+    TRACE_SENT,         // 响应最后一个字节写出  阶段 send（含等待 EPOLLOUT）
+    TRACE_MARK_NUM
+};
+extern const char *TRACE_STAGE_NAMES[TRACE_MARK_NUM];
+
+// 阶段耗时直方图的桶上界（微秒），比请求延迟更细
+const int METRICS_STAGE_BUCKETS = 13;
+extern const uint64_t METRICS_STAGE_BOUNDS_US[METRICS_STAGE_BUCKETS];
+
+// 一个线程的全部指标（每个分片只有所属线程写，抓取线程读）
+struct alignas(64) MetricsShard
+{
+    std::atomic<uint64_t> counters[M_COUNTER_NUM];
+    std::atomic<int64_t> gauges[G_GAUGE_NUM];
+    std::atomic<uint64_t> requests[R_ROUTE_NUM][S_STATUS_NUM];
+    std::atomic<uint64_t> latency[R_ROUTE_NUM][METRICS_LATENCY_BUCKETS + 1];
+    std::atomic<uint64_t> latency_sum_us[R_ROUTE_NUM];
+    std::atomic<uint64_t> stage[TRACE_MARK_NUM][METRICS_STAGE_BUCKETS + 1];
+    std::atomic<uint64_t> stage_sum_ns[TRACE_MARK_NUM];
+
+    int worker;                         // 线程池工作线程编号，其他线程为 -1
+    std::atomic<uint64_t> busy_ns;      // 工作线程：执行任务的累计时间
+    std::atomic<uint64_t> tasks;        // 工作线程：执行的任务数
+};
+
+struct MetricsTotals;
+struct ShmStats;
+
+/**
+ * 单调时间，请求延迟、阶段耗时使用（缓存时间的精度不足以区分亚毫秒的请求）
+ * 与 Clock 相同的 CLOCK_MONOTONIC（vDSO，不进入内核），两者的时间点可以直接相减
+ */
+inline uint64_t metrics_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline uint64_t metrics_now_us()
+{
+    return metrics_now_ns() / 1000;
+}
+
+class Metrics
+{
+public:
+    static Metrics *getInstance()
+    {
+        static Metrics instance;
+        return &instance;
+    }
+
+    /* 抓取时额外输出的指标（如连接池统计、当前连接数），追加到 out */
+    typedef void (*Collector)(std::string &out);
+    void add_collector(Collector c);
+
+    /* 在 127.0.0.1:port 上启动抓取线程 */
+    bool serve(int port, int close_log);
+
+    /* 汇总所有分片，生成文本格式 */
+    void scrape(std::string &out);
+
+    void inc(METRIC_COUNTER c, uint64_t n = 1)
+    {
+        bump(shard()->counters[c], n);
+    }
+
+    void gauge_add(METRIC_GAUGE g, int64_t delta)
+    {
+        std::atomic<int64_t> &v = shard()->gauges[g];
+        v.store(v.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    /* 一个请求响应完成 */
+    void request(int route, int status, uint64_t latency_us)
+    {
+        MetricsShard *s = shard();
+        bump(s->requests[route][status], 1);
+        int b = 0;
+        while (b < METRICS_LATENCY_BUCKETS && latency_us > METRICS_LATENCY_BOUNDS_US[b])
+            ++b;
+        bump(s->latency[route][b], 1);
+        bump(s->latency_sum_us[route], latency_us);
+    }
+
+    /* 一个请求在阶段 mark（以该时间点结束）上的耗时 */
+    void stage(int mark, uint64_t ns)
+    {
+        MetricsShard *s = shard();
+        uint64_t us = ns / 1000;
+        int b = 0;
+        while (b < METRICS_STAGE_BUCKETS && us > METRICS_STAGE_BOUNDS_US[b])
+            ++b;
+        bump(s->stage[mark][b], 1);
+        bump(s->stage_sum_ns[mark], ns);
+    }
+
+    /* 线程池工作线程启动时调用，分配工作线程编号 */
+    int register_worker();
+
+    /* 工作线程执行完一个任务 */
+    void worker_busy(uint64_t ns)
+    {
+        MetricsShard *s = shard();
+        bump(s->busy_ns, ns);
+        bump(s->tasks, 1);
+    }
+
+    /**
+     * 共享内存统计段：发布线程每 interval_ms 毫秒把汇总值写入 /dev/shm/tws_stats_<port>，
+     * connections 为当前连接数（http_conn::m_user_count）
+     */
+    bool publish_shm(int port, int interval_ms, std::atomic<int> *connections);
+    void unpublish_shm();
+
+    /* HTTP 状态码对应的 METRIC_STATUS */
+    static int status_index(int status);
+
+private:
+    Metrics();
+    ~Metrics();
+
+    static void bump(std::atomic<uint64_t> &v, uint64_t n)
+    {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    MetricsShard *shard()
+    {
+        static thread_local MetricsShard *s = NULL;
+        if (s == NULL)
+            s = register_shard();
+        return s;
+    }
+    MetricsShard *register_shard();
+
+    void sum_shards(MetricsTotals *t);
+
+    static void *serve_thread(void *arg);
+    void run_server();
+
+    static void *publish_thread(void *arg);
+    void run_publisher();
+
+    MutexLocker m_lock;                     // 保护分片、收集函数列表
+    std::vector<MetricsShard *> m_shards;
+    std::vector<Collector> m_collectors;
+
+    int m_worker_num;
+
+    int m_listenfd;
+    int m_close_log;
+
+    ShmStats *m_shm;                        // 共享内存统计段（NULL：未发布）
+    char m_shm_name[64];
+    int m_shm_interval_ms;
+    std::atomic<int> *m_connections;
+};
+
+#endif
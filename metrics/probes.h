@@ -0,0 +1,50 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * USDT 静态探针（provider: tws），perf / bpftrace 不需要重新编译即可挂载
+ *
+ * sys/sdt.h 把每个探针编译为一条 nop 指令，并在 ELF 的 .note.stapsdt 段记录位置和参数的取法；
+ * 没有挂载时只执行 nop（参数都是已在寄存器或栈上的值，不额外计算），挂载后内核把 nop 换成断点。
+ * 没有安装 sys/sdt.h（systemtap-sdt-dev / systemtap-sdt-devel），或编译时定义了 TWS_NO_USDT，
+ * 探针宏展开为空。
+ *
+ * 查看探针：readelf -n ./server | grep -A2 stapsdt 或 bpftrace -l 'usdt:./server:tws:*'
+ * 示例脚本见 metrics/bpftrace/
+ *
+ * 探针                     参数
+ * accept                   fd, 对方IPv4地址（网络字节序）
+ * conn__init               fd, 连接代数
+ * request__parsed          fd, 请求方法(0:GET 1:POST), url, 消息体长度
+ * do_request__start        fd, url
+ * do_request__end          fd, HTTP_CODE, url（结果页面）
+ * db__acquire__start       -
+ * db__acquire              MYSQL*（超时为 NULL）
+ * db__release              MYSQL*
+ * write__done              fd, 发送字节数, 是否保持连接
+ * timer__expire            fd
+ * conn__close              fd
+ */
+
+#if !defined(TWS_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TWS_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef TWS_HAVE_USDT
+#define TWS_PROBE(name) DTRACE_PROBE(tws, name)
+#define TWS_PROBE1(name, a) DTRACE_PROBE1(tws, name, a)
+#define TWS_PROBE2(name, a, b) DTRACE_PROBE2(tws, name, a, b)
+#define TWS_PROBE3(name, a, b, c) DTRACE_PROBE3(tws, name, a, b, c)
+#define TWS_PROBE4(name, a, b, c, d) DTRACE_PROBE4(tws, name, a, b, c, d)
+#else
+#define TWS_PROBE(name)
+#define TWS_PROBE1(name, a)
+#define TWS_PROBE2(name, a, b)
+#define TWS_PROBE3(name, a, b, c)
+#define TWS_PROBE4(name, a, b, c, d)
+#endif
+
+#endif
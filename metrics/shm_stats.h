@@ -0,0 +1,68 @@
+#ifndef SHM_STATS_H
+#define SHM_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * 共享内存统计段（/dev/shm/tws_stats_<port>），服务器与 webtop 共用的布局
+ * 服务器的发布线程每隔 interval_ms 把各线程分片的汇总值用 relaxed 原子写入；
+ * webtop 只读映射后直接读取，服务器一侧没有任何额外的系统调用，过载时也能观察。
+ *
+ * 兼容性：magic、version、size 三者都一致才读取；布局有不兼容的改动时 version 加一。
+ * magic 最后写入（release），读者看到 magic 时其余只写一次的字段（名称、pid 等）已就绪
+ *
+ * 每次发布的字段以 seq 作顺序锁：写入前 seq 加一成为奇数，写完再加一成为偶数；
+ * 读者复制前后读到同一个偶数 seq 才采用这次复制，否则重读，不会得到新旧混杂的样本
+ */
+
+const uint32_t SHM_STATS_MAGIC = 0x53535754;   // "TWSS"
+const uint32_t SHM_STATS_VERSION = 2;
+const int SHM_STATS_MAX_ROUTES = 8;
+const int SHM_STATS_MAX_WORKERS = 128;
+const int SHM_STATS_NAME_LEN = 16;
+
+/* 段名（shm_open 使用），按监听端口区分同一台机器上的多个服务器 */
+inline void shm_stats_name(char *buf, int size, int port)
+{
+    snprintf(buf, size, "/tws_stats_%d", port);
+}
+
+// 一个工作线程（只由发布线程写）
+struct alignas(64) ShmWorkerStats
+{
+    std::atomic<uint64_t> busy_ns;  // 累计执行任务的时间
+    std::atomic<uint64_t> tasks;    // 累计执行的任务数
+};
+
+struct ShmStats
+{
+    /* 只写一次 */
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t size;                  // sizeof(ShmStats)
+    int32_t pid;
+    int32_t port;
+    int32_t interval_ms;            // 发布间隔
+    int32_t route_num;
+    char route_names[SHM_STATS_MAX_ROUTES][SHM_STATS_NAME_LEN];
+
+    /* 每次发布更新 */
+    alignas(64) std::atomic<uint64_t> seq;  // 顺序锁：奇数表示正在发布，seq / 2 为发布次数
+    std::atomic<uint64_t> update_ns;        // 最近一次发布的 CLOCK_MONOTONIC 时间
+    std::atomic<int64_t> connections;       // 当前连接数
+    std::atomic<int64_t> queue_depth;       // 线程池队列长度
+    std::atomic<uint64_t> accepts;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_out;
+    std::atomic<uint64_t> timer_expirations;
+    std::atomic<uint64_t> requests[SHM_STATS_MAX_ROUTES];   // 按路由的完成请求数
+    std::atomic<uint64_t> errors;                           // 非 200 响应数
+
+    std::atomic<int32_t> worker_num;        // workers 中有效的个数
+    ShmWorkerStats workers[SHM_STATS_MAX_WORKERS];
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*******************************************************
+ * webtop : 读取服务器的共享内存统计段（-S），实时显示速率
+ * 用法：./webtop [-p port] [-i interval_ms] [-n count] [-b]
+ *   -p : 服务器监听端口，默认 9006（段名 /tws_stats_<port>）
+ *   -i : 刷新间隔（毫秒），默认 1000
+ *   -n : 刷新次数后退出，默认 0 一直运行
+ *   -b : 批处理模式，不清屏，每次刷新追加输出
+ * 只读映射统计段，不向服务器发送请求，服务器一侧没有系统调用
+ ********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_stats.h"
+
+static const int TAKE_MAX_TRIES = 1000;     // 读取一致样本的最多尝试次数
+
+// 一次读取的全部计数
+struct Sample
+{
+    uint64_t seq;
+    uint64_t update_ns;
+    int64_t connections;
+    int64_t queue_depth;
+    uint64_t accepts;
+    uint64_t rejected;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t timer_expirations;
+    uint64_t requests[SHM_STATS_MAX_ROUTES];
+    uint64_t errors;
+    int worker_num;
+    uint64_t busy_ns[SHM_STATS_MAX_WORKERS];
+    uint64_t tasks[SHM_STATS_MAX_WORKERS];
+};
+
+static const ShmStats *attach(int port)
+{
+    char name[64];
+    shm_stats_name(name, sizeof(name), port);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "webtop: cannot open /dev/shm%s: %s (start the server with -S <ms>)\n", name, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ShmStats))
+    {
+        fprintf(stderr, "webtop: /dev/shm%s is too small, server and webtop versions differ\n", name);
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, sizeof(ShmStats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        fprintf(stderr, "webtop: mmap failed: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    // 服务器刚创建段时 magic 尚未写入，稍等
+    const ShmStats *shm = (const ShmStats *)addr;
+    for (int i = 0; i < 50 && shm->magic.load(std::memory_order_acquire) != SHM_STATS_MAGIC; ++i)
+        usleep(20000);
+    if (shm->magic.load(std::memory_order_acquire) != SHM_STATS_MAGIC)
+    {
+        fprintf(stderr, "webtop: /dev/shm%s is not a stats segment\n", name);
+        return NULL;
+    }
+    if (shm->version != SHM_STATS_VERSION || shm->size != sizeof(ShmStats))
+    {
+        fprintf(stderr, "webtop: segment version %u (size %u), webtop expects version %u (size %u)\n",
+                shm->version, shm->size, SHM_STATS_VERSION, (unsigned)sizeof(ShmStats));
+        return NULL;
+    }
+    return shm;
+}
+
+/* 逐个字段复制，一致性由 take 检查 */
+static void copy(const ShmStats *shm, Sample *s)
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    s->update_ns = shm->update_ns.load(relaxed);
+    s->connections = shm->connections.load(relaxed);
+    s->queue_depth = shm->queue_depth.load(relaxed);
+    s->accepts = shm->accepts.load(relaxed);
+    s->rejected = shm->rejected.load(relaxed);
+    s->bytes_in = shm->bytes_in.load(relaxed);
+    s->bytes_out = shm->bytes_out.load(relaxed);
+    s->timer_expirations = shm->timer_expirations.load(relaxed);
+    for (int r = 0; r < shm->route_num && r < SHM_STATS_MAX_ROUTES; ++r)
+        s->requests[r] = shm->requests[r].load(relaxed);
+    s->errors = shm->errors.load(relaxed);
+    s->worker_num = shm->worker_num.load(relaxed);
+    if (s->worker_num > SHM_STATS_MAX_WORKERS)
+        s->worker_num = SHM_STATS_MAX_WORKERS;
+    for (int w = 0; w < s->worker_num; ++w)
+    {
+        s->busy_ns[w] = shm->workers[w].busy_ns.load(relaxed);
+        s->tasks[w] = shm->workers[w].tasks.load(relaxed);
+    }
+}
+
+/* 复制一次发布的全部计数：seq 为奇数（正在发布）或复制期间变化时重读 */
+static void take(const ShmStats *shm, Sample *s)
+{
+    for (int tries = 0; tries < TAKE_MAX_TRIES; ++tries)
+    {
+        uint64_t seq = shm->seq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            usleep(100);
+            continue;
+        }
+        copy(shm, s);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (shm->seq.load(std::memory_order_relaxed) == seq)
+        {
+            s->seq = seq / 2;
+            return;
+        }
+    }
+    // 服务器在发布中途退出或停住：保留最后一次复制
+    copy(shm, s);
+    s->seq = shm->seq.load(std::memory_order_relaxed) / 2;
+}
+
+/* 计数器在 dt 秒内的速率（服务器重启后计数变小时按0计）*/
+static double rate(uint64_t now, uint64_t prev, double dt)
+{
+    return now >= prev ? (now - prev) / dt : 0.0;
+}
+
+static void show(const ShmStats *shm, const Sample &a, const Sample &b, bool batch)
+{
+    if (!batch)
+        printf("\033[H\033[2J");
+
+    // 速率以服务器发布时间为准，与 webtop 的刷新时刻无关
+    double dt = (b.update_ns - a.update_ns) / 1e9;
+    bool alive = kill(shm->pid, 0) == 0 || errno == EPERM;
+    printf("webtop - pid %d port %d, published every %dms, seq %llu%s\n", shm->pid, shm->port, shm->interval_ms,
+           (unsigned long long)b.seq, !alive ? " (server exited)" : (dt <= 0 ? " (stale)" : ""));
+    if (dt <= 0)
+    {
+        printf("connections %lld  queue %lld\n\n", (long long)b.connections, (long long)b.queue_depth);
+        fflush(stdout);
+        return;
+    }
+
+    // route_num 来自共享内存，与 copy 一样限制在数组范围内
+    int routes = shm->route_num < SHM_STATS_MAX_ROUTES ? shm->route_num : SHM_STATS_MAX_ROUTES;
+    uint64_t req_a = 0, req_b = 0;
+    for (int r = 0; r < routes; ++r)
+    {
+        req_a += a.requests[r];
+        req_b += b.requests[r];
+    }
+    printf("connections %-8lld queue %-6lld accepts/s %-9.1f rejected/s %-7.1f timeouts/s %.1f\n",
+           (long long)b.connections, (long long)b.queue_depth, rate(b.accepts, a.accepts, dt),
+           rate(b.rejected, a.rejected, dt), rate(b.timer_expirations, a.timer_expirations, dt));
+    printf("requests/s %-9.1f errors/s %-8.1f in %.2f MB/s  out %.2f MB/s\n\n", rate(req_b, req_a, dt),
+           rate(b.errors, a.errors, dt), rate(b.bytes_in, a.bytes_in, dt) / 1e6, rate(b.bytes_out, a.bytes_out, dt) / 1e6);
+
+    printf("%-10s %12s %14s\n", "ROUTE", "REQ/S", "TOTAL");
+    for (int r = 0; r < routes; ++r)
+        printf("%-10s %12.1f %14llu\n", shm->route_names[r], rate(b.requests[r], a.requests[r], dt),
+               (unsigned long long)b.requests[r]);
+
+    printf("\n%-10s %12s %14s\n", "WORKER", "BUSY%", "TASKS/S");
+    for (int w = 0; w < b.worker_num; ++w)
+    {
+        uint64_t busy_a = w < a.worker_num ? a.busy_ns[w] : 0;
+        uint64_t tasks_a = w < a.worker_num ? a.tasks[w] : 0;
+        printf("%-10d %12.1f %14.1f\n", w, rate(b.busy_ns[w], busy_a, dt) / 1e9 * 100, rate(b.tasks[w], tasks_a, dt));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int port = 9006;
+    int interval_ms = 1000;
+    int count = 0;
+    bool batch = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:i:n:b")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'b':
+            batch = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-i interval_ms] [-n count] [-b]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (interval_ms <= 0)
+        interval_ms = 1000;
+
+    const ShmStats *shm = attach(port);
+    if (shm == NULL)
+        return 1;
+
+    Sample *prev = new Sample;
+    Sample *cur = new Sample;
+    take(shm, prev);
+    for (int i = 0; count == 0 || i < count; ++i)
+    {
+        usleep(interval_ms * 1000);
+        take(shm, cur);
+        show(shm, *prev, *cur, batch);
+        Sample *t = prev;
+        prev = cur;
+        cur = t;
+    }
+    delete prev;
+    delete cur;
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*******************************************************
+ * dbsmoke : 非阻塞数据库连接（AsyncDB）对真实 MySQL/MariaDB 的冒烟测试
+ * 用法：./dbsmoke [-h host] [-P port] [-u user] [-p password] [-d database]
+ *   默认连接 localhost:3306，用户名、密码、库名与 main.cpp 相同
+ *
+ * 依次检查：
+ *   1. 查询经 epoll 事件循环推进并在回调中返回结果
+ *   2. escape 转义的字符串（引号、反斜杠）原样往返
+ *   3. 用另一条连接 KILL 非阻塞连接后，AsyncDB 自动重连，之后的查询在新连接上成功
+ *
+ * 连不上数据库、或客户端库没有非阻塞 API 时输出 SKIP 并返回 0；任何一项失败返回 1
+ * 只读查询，不修改数据库中的表
+ ********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <string>
+#include <mysql/mysql.h>
+
+#include "../../CGImysql/async_db.h"
+#include "../../timer/clock.h"
+
+static const int WAIT_MS = 5000;   // 每项检查的最长等待时间
+
+// 一次查询的结果
+struct Reply
+{
+    bool done;
+    int err;
+    std::string value;  // 第一行第一列
+};
+
+static void on_reply(void *arg, int err, MYSQL_RES *result)
+{
+    Reply *r = (Reply *)arg;
+    r->done = true;
+    r->err = err;
+    r->value.clear();
+    MYSQL_ROW row = result ? mysql_fetch_row(result) : NULL;
+    if (row && row[0])
+        r->value = row[0];
+}
+
+/* 驱动事件循环，直到 reply 完成或超时 */
+static bool pump(int epollfd, Reply *reply, int timeout_ms)
+{
+    AsyncDB *db = AsyncDB::getInstance();
+    long long deadline = Clock::getInstance()->mono_ms() + timeout_ms;
+    epoll_event events[16];
+    while (!reply->done)
+    {
+        int n = epoll_wait(epollfd, events, 16, 50);
+        Clock::getInstance()->update();
+        for (int i = 0; i < n; ++i)
+        {
+            if (db->owns(events[i].data.fd))
+                db->handle_event(events[i].data.fd, events[i].events);
+        }
+        db->tick();
+        if (Clock::getInstance()->mono_ms() >= deadline)
+            return false;
+    }
+    return true;
+}
+
+/* 提交一条查询并等待完成 */
+static bool query(int epollfd, const char *sql, Reply *reply)
+{
+    reply->done = false;
+    AsyncDB::getInstance()->submit(sql, true, on_reply, reply);
+    return pump(epollfd, reply, WAIT_MS);
+}
+
+static int fail(const char *what, const Reply &r)
+{
+    printf("dbsmoke: FAIL %s (done %d, err %d, value '%s')\n", what, r.done, r.err, r.value.c_str());
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string host = "localhost";
+    std::string user = "root";
+    std::string password = "rootpass";
+    std::string database = "tinywebserver_ybb";
+    int port = 3306;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:P:u:p:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            host = optarg;
+            break;
+        case 'P':
+            port = atoi(optarg);
+            break;
+        case 'u':
+            user = optarg;
+            break;
+        case 'p':
+            password = optarg;
+            break;
+        case 'd':
+            database = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-P port] [-u user] [-p password] [-d database]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 同步连接：先确认数据库可用，之后用它 KILL 非阻塞连接
+    MYSQL *admin = mysql_init(NULL);
+    if (admin == NULL ||
+        mysql_real_connect(admin, host.c_str(), user.c_str(), password.c_str(), database.c_str(), port, NULL, 0) == NULL)
+    {
+        printf("dbsmoke: SKIP cannot connect to %s:%d: %s\n", host.c_str(), port, admin ? mysql_error(admin) : "mysql_init failed");
+        return 0;
+    }
+
+    Clock::getInstance()->update();
+    int epollfd = epoll_create(5);
+    AsyncDB *db = AsyncDB::getInstance();
+    if (!db->init(host, user, password, database, port, 1, epollfd, 1))
+    {
+        printf("dbsmoke: SKIP client library has no nonblocking API\n");
+        mysql_close(admin);
+        return 0;
+    }
+
+    // 1. 查询往返
+    Reply r;
+    if (!query(epollfd, "SELECT CONNECTION_ID()", &r) || r.err || r.value.empty())
+        return fail("SELECT CONNECTION_ID()", r);
+    std::string conn_id = r.value;
+    printf("dbsmoke: query ok (connection %s)\n", conn_id.c_str());
+
+    // 2. 转义往返
+    const char *raw = "it's a \"quote\" \\ and 'more'";
+    char esc[128];
+    char sql[256];
+    snprintf(sql, sizeof(sql), "SELECT '%s'", db->escape(esc, raw));
+    if (!query(epollfd, sql, &r) || r.err || r.value != raw)
+        return fail("escape round trip", r);
+    printf("dbsmoke: escape ok\n");
+
+    // 3. 服务器断开连接后自动重连：断开时在途的查询可能失败，之后的查询应在新连接上成功
+    snprintf(sql, sizeof(sql), "KILL %s", conn_id.c_str());
+    if (mysql_query(admin, sql))
+    {
+        printf("dbsmoke: FAIL %s: %s\n", sql, mysql_error(admin));
+        return 1;
+    }
+    bool reconnected = false;
+    long long deadline = Clock::getInstance()->mono_ms() + WAIT_MS;
+    while (!reconnected && Clock::getInstance()->mono_ms() < deadline)
+    {
+        if (query(epollfd, "SELECT CONNECTION_ID()", &r) && 0 == r.err && !r.value.empty())
+            reconnected = r.value != conn_id;
+    }
+    if (!reconnected)
+        return fail("reconnect after KILL", r);
+    printf("dbsmoke: reconnect ok (connection %s -> %s)\n", conn_id.c_str(), r.value.c_str());
+
+    mysql_close(admin);
+    printf("dbsmoke: PASS\n");
+    return 0;
+}
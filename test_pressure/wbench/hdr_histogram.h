@@ -0,0 +1,121 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+/**
+ * HdrHistogram（High Dynamic Range Histogram）的精简实现
+ * 按2的幂分桶，每个桶再线性分成 2048 个子桶：任意量级的值都保持3位有效数字的精度，
+ * 记录是 O(1) 的一次下标计算 + 自增，与记录次数无关；多个直方图可以直接按下标合并
+ * 本工具中记录的是延迟（微秒），取分位数时返回该下标对应区间的最大值
+ */
+class HdrHistogram
+{
+public:
+    // 默认可记录 1微秒 ~ 1小时
+    explicit HdrHistogram(int64_t highest = 3600LL * 1000000) : m_highest(highest), m_total(0),
+                                                                m_min(INT64_MAX), m_max(0), m_sum(0), m_sum_sq(0)
+    {
+        m_counts.resize(index_of(highest) + 1, 0);
+    }
+
+    void record(int64_t v)
+    {
+        if (v < 0)
+            v = 0;
+        if (v > m_highest)
+            v = m_highest;  // 超出范围的值按上限记录
+        ++m_counts[index_of(v)];
+        ++m_total;
+        if (v < m_min)
+            m_min = v;
+        if (v > m_max)
+            m_max = v;
+        m_sum += v;
+        m_sum_sq += (double)v * v;
+    }
+
+    /* 合并另一个（相同范围的）直方图 */
+    void merge(const HdrHistogram &o)
+    {
+        for (size_t i = 0; i < m_counts.size() && i < o.m_counts.size(); ++i)
+            m_counts[i] += o.m_counts[i];
+        m_total += o.m_total;
+        if (o.m_min < m_min)
+            m_min = o.m_min;
+        if (o.m_max > m_max)
+            m_max = o.m_max;
+        m_sum += o.m_sum;
+        m_sum_sq += o.m_sum_sq;
+    }
+
+    int64_t count() const { return m_total; }
+    int64_t min() const { return m_total ? m_min : 0; }
+    int64_t max() const { return m_max; }
+    double mean() const { return m_total ? m_sum / m_total : 0; }
+    double stddev() const
+    {
+        if (!m_total)
+            return 0;
+        double m = mean();
+        double var = m_sum_sq / m_total - m * m;
+        return var > 0 ? sqrt(var) : 0;
+    }
+
+    /* 分位数，p 取 0 ~ 100 */
+    int64_t percentile(double p) const
+    {
+        if (m_total == 0)
+            return 0;
+        int64_t rank = (int64_t)ceil(p / 100.0 * m_total);
+        if (rank < 1)
+            rank = 1;
+        int64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= rank)
+            {
+                int64_t v = highest_equivalent(i);
+                return v < m_max ? v : m_max;
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static const int SUB_BUCKET_HALF_MAGNITUDE = 10;    // 2048个子桶：3位有效数字
+    static const int64_t SUB_BUCKET_MASK = (1LL << (SUB_BUCKET_HALF_MAGNITUDE + 1)) - 1;
+
+    static size_t index_of(int64_t v)
+    {
+        int bucket = 64 - __builtin_clzll((uint64_t)(v | SUB_BUCKET_MASK)) - (SUB_BUCKET_HALF_MAGNITUDE + 1);
+        int64_t sub = v >> bucket;
+        return ((size_t)(bucket + 1) << SUB_BUCKET_HALF_MAGNITUDE) + (sub - (1LL << SUB_BUCKET_HALF_MAGNITUDE));
+    }
+
+    /* 下标对应区间的最大值 */
+    static int64_t highest_equivalent(size_t idx)
+    {
+        int bucket = (int)(idx >> SUB_BUCKET_HALF_MAGNITUDE) - 1;
+        int64_t sub = (idx & ((1 << SUB_BUCKET_HALF_MAGNITUDE) - 1)) + (1LL << SUB_BUCKET_HALF_MAGNITUDE);
+        if (bucket < 0)
+        {
+            bucket = 0;
+            sub -= 1LL << SUB_BUCKET_HALF_MAGNITUDE;
+        }
+        return (sub << bucket) + (1LL << bucket) - 1;
+    }
+
+    std::vector<int64_t> m_counts;
+    int64_t m_highest;
+    int64_t m_total;
+    int64_t m_min;
+    int64_t m_max;
+    double m_sum;
+    double m_sum_sq;
+};
+
+#endif
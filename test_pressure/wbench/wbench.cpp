@@ -0,0 +1,902 @@
+/*******************************************************
+ * wbench : 基于 epoll 的 HTTP 压力测试工具（替代 webbench）
+ * 用法：./wbench [选项] http://host:port/path
+ *   -c N      : 连接总数，平均分给各线程（默认 100）
+ *   -n N      : 线程数，每个线程一个 epoll（默认 4）
+ *   -t SEC    : 测试时长（默认 10）
+ *   -d N      : 流水线深度，每个连接同时在途的请求数（默认 1）
+ *   -r RATE   : 开环模式，按固定速率（请求/秒，所有线程合计）发送；默认闭环，收到响应后立即发下一个
+ *   -K        : 关闭长连接，每个请求新建一个连接（与 webbench 相同）
+ *   -m MIX    : 内置请求组合 static | login | register | mixed
+ *   -s FILE   : 请求脚本，每行：权重 方法 路径 [请求体]，请求体中的 $SEQ 替换为唯一序号
+ *   -o MS     : 请求超时（默认 5000），超时的请求计为错误并重建连接
+ *   -j FILE   : 以 JSON 输出结果（- 表示标准输出，此时不输出文本结果）
+ *
+ * 延迟从请求“应当发出”的时刻算起：开环模式下连接繁忙导致的排队时间也计入延迟，
+ * 避免闭环测试中服务器变慢、请求随之变少而低估尾延迟（coordinated omission）
+ ********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+
+#include "hdr_histogram.h"
+
+using namespace std;
+
+// 请求模板（脚本中的一行）
+struct RequestSpec
+{
+    int weight;
+    string method;
+    string path;
+    string body;    // 可含 $SEQ
+};
+
+// 命令行参数
+struct Options
+{
+    int connections;
+    int threads;
+    int duration;
+    int depth;
+    double rate;
+    bool keep_alive;
+    int timeout_ms;
+    string mix;
+    string script;
+    string json;
+    string url;
+};
+
+// 一个在途请求
+struct Pending
+{
+    int spec;
+    int64_t start_ns;   // 计算延迟的起点：开环为计划发出时刻，闭环为实际发出时刻
+    int64_t sent_ns;    // 实际发出时刻，用于超时判断
+};
+
+// 一个客户端连接
+struct Conn
+{
+    int fd;
+    uint32_t index;         // 在 Worker::conns 中的下标
+    uint32_t gen;           // 每次建立连接加1，丢弃旧连接遗留的 epoll 事件
+    bool connecting;
+    int64_t retry_ns;       // fd < 0 时为重新连接的时刻，连接中为发起连接的时刻
+    string out;             // 待发送的请求
+    size_t out_off;
+    deque<Pending> inflight;
+    string in;              // 已收到、未解析的响应数据
+    bool header_done;       // 当前响应的首部已解析
+    int status;
+    int64_t body_left;      // 剩余消息体字节数，-1 表示读到连接关闭为止
+    bool close_after;       // 响应带 Connection: close
+};
+
+// 错误分类
+enum ERROR_KIND
+{
+    ERR_NONE = -1,
+    ERR_CONNECT = 0,
+    ERR_READ,
+    ERR_WRITE,
+    ERR_TIMEOUT,
+    ERR_KINDS
+};
+
+static const char *error_names[ERR_KINDS] = {"connect", "read", "write", "timeout"};
+
+// 工作线程：独立的 epoll、连接、统计，测试结束后由主线程合并
+struct Worker
+{
+    int id;
+    int epfd;
+    int conn_num;
+    vector<Conn> conns;
+    pthread_t tid;
+
+    uint64_t rng;
+    uint64_t seq;           // $SEQ 序号
+    double rate;            // 本线程的开环速率
+    int64_t next_ns;        // 开环：下一个请求的计划发出时刻
+    deque<int64_t> backlog; // 开环：已到计划时刻、还没有空闲连接发送的请求
+    size_t rr;              // 开环：轮询分派的起始连接
+
+    int64_t requests;
+    int64_t bytes;
+    int64_t connects;
+    int64_t dropped;        // 开环积压过多而丢弃的请求
+    int64_t errors[ERR_KINDS];
+    int64_t status[6];      // 1xx ~ 5xx，0 为无法解析
+    vector<int64_t> spec_count;
+    vector<HdrHistogram> spec_hist;
+};
+
+static const size_t MAX_BACKLOG = 1000000;
+static const size_t MAX_HEADER = 65536;
+static const int MAX_EVENTS = 1024;
+
+static Options g_opt;
+static vector<RequestSpec> g_specs;
+static int g_total_weight = 0;
+static struct sockaddr_in g_addr;
+static string g_host;
+static string g_run_id;
+static atomic<bool> g_stop(false);
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* xorshift64* */
+static uint64_t next_rand(uint64_t &s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 2685821657736338717ULL;
+}
+
+/* 解析 http://host[:port]/path */
+static bool parse_url(const string &url, string &host, int &port, string &path)
+{
+    if (url.compare(0, 7, "http://") != 0)
+        return false;
+    size_t p = 7;
+    size_t slash = url.find('/', p);
+    string hostport = url.substr(p, slash == string::npos ? string::npos : slash - p);
+    path = slash == string::npos ? "/" : url.substr(slash);
+    size_t colon = hostport.find(':');
+    host = hostport.substr(0, colon);
+    port = colon == string::npos ? 80 : atoi(hostport.c_str() + colon + 1);
+    return !host.empty() && port > 0 && port < 65536;
+}
+
+static void add_spec(int weight, const string &method, const string &path, const string &body)
+{
+    RequestSpec s;
+    s.weight = weight;
+    s.method = method;
+    s.path = path;
+    s.body = body;
+    g_specs.push_back(s);
+    g_total_weight += weight;
+}
+
+/* 内置请求组合 */
+static bool builtin_mix(const string &mix, const string &path)
+{
+    if (mix == "static")
+        add_spec(1, "GET", path, "");
+    else if (mix == "login")
+        add_spec(1, "POST", "/2CGISQL.cgi", "user=wbench&password=wbench");
+    else if (mix == "register")
+        add_spec(1, "POST", "/3CGISQL.cgi", "user=wb$SEQ&password=wbench");
+    else if (mix == "mixed")
+    {
+        add_spec(80, "GET", path, "");
+        add_spec(15, "POST", "/2CGISQL.cgi", "user=wbench&password=wbench");
+        add_spec(5, "POST", "/3CGISQL.cgi", "user=wb$SEQ&password=wbench");
+    }
+    else
+        return false;
+    return true;
+}
+
+/* 请求脚本：每行 权重 方法 路径 [请求体]，# 开头为注释 */
+static bool load_script(const string &file)
+{
+    FILE *fp = fopen(file.c_str(), "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "wbench: cannot open %s\n", file.c_str());
+        return false;
+    }
+    char line[4096];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        ++lineno;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line + strspn(line, " \t");
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        int weight = 0;
+        char method[16], path[2048];
+        int n = 0;
+        if (sscanf(p, "%d %15s %2047s %n", &weight, method, path, &n) < 3 || weight <= 0)
+        {
+            fprintf(stderr, "wbench: %s:%d: expected \"weight method path [body]\"\n", file.c_str(), lineno);
+            fclose(fp);
+            return false;
+        }
+        add_spec(weight, method, path, p + n);
+    }
+    fclose(fp);
+    if (g_specs.empty())
+    {
+        fprintf(stderr, "wbench: %s: no requests\n", file.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* 按权重选一个请求模板，生成请求报文追加到连接的发送缓冲区 */
+static int append_request(Worker *w, Conn &c)
+{
+    int spec = 0;
+    if (g_specs.size() > 1)
+    {
+        int r = (int)(next_rand(w->rng) % g_total_weight);
+        while (r >= g_specs[spec].weight)
+            r -= g_specs[spec++].weight;
+    }
+    const RequestSpec &s = g_specs[spec];
+
+    string body = s.body;
+    size_t pos = body.find("$SEQ");
+    if (pos != string::npos)
+    {
+        char seq[64];
+        snprintf(seq, sizeof(seq), "%s%d_%llu", g_run_id.c_str(), w->id, (unsigned long long)w->seq++);
+        body.replace(pos, 4, seq);
+    }
+
+    c.out += s.method + " " + s.path + " HTTP/1.1\r\nHost: " + g_host + "\r\nUser-Agent: wbench\r\nConnection: ";
+    c.out += g_opt.keep_alive ? "keep-alive\r\n" : "close\r\n";
+    if (s.method == "POST" || !body.empty())
+    {
+        char header[128];
+        int n = snprintf(header, sizeof(header), "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n", body.size());
+        c.out.append(header, n);
+    }
+    c.out.append("\r\n");
+    c.out.append(body);
+    return spec;
+}
+
+static void conn_open(Worker *w, Conn &c);
+
+static void conn_reset(Conn &c)
+{
+    c.fd = -1;
+    c.connecting = false;
+    c.out.clear();
+    c.out_off = 0;
+    c.inflight.clear();
+    c.in.clear();
+    c.header_done = false;
+    c.body_left = 0;
+    c.close_after = false;
+}
+
+/* 关闭连接，仍在途的请求按 kind 计为错误；delay_ms 后重新连接（0 为立即重连）*/
+static void conn_close(Worker *w, Conn &c, int kind, int delay_ms)
+{
+    if (kind != ERR_NONE && !g_stop.load(std::memory_order_relaxed))
+    {
+        // 连接失败本身算一次错误，其他情况按在途请求数计
+        w->errors[kind] += kind == ERR_CONNECT ? 1 : (int64_t)c.inflight.size();
+    }
+    if (c.fd >= 0)
+    {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c.fd, NULL);
+        close(c.fd);
+    }
+    conn_reset(c);
+    c.retry_ns = now_ns() + (int64_t)delay_ms * 1000000;
+    if (delay_ms == 0 && !g_stop.load(std::memory_order_relaxed))
+    {
+        conn_open(w, c);
+    }
+}
+
+static void conn_open(Worker *w, Conn &c)
+{
+    conn_reset(c);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        c.retry_ns = now_ns() + 100000000;
+        ++w->errors[ERR_CONNECT];
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    c.fd = fd;
+    c.connecting = true;
+    c.retry_ns = now_ns();
+    ++c.gen;
+    if (connect(fd, (struct sockaddr *)&g_addr, sizeof(g_addr)) < 0 && errno != EINPROGRESS)
+    {
+        conn_close(w, c, ERR_CONNECT, 100);
+        return;
+    }
+
+    // 边沿触发：读写都要做到 EAGAIN 为止
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    ev.data.u64 = ((uint64_t)c.index << 32) | c.gen;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* 尽量写出发送缓冲区 */
+static bool conn_flush(Worker *w, Conn &c)
+{
+    while (c.out_off < c.out.size())
+    {
+        ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+            conn_close(w, c, ERR_WRITE, 0);
+            return false;
+        }
+        c.out_off += n;
+    }
+    c.out.clear();
+    c.out_off = 0;
+    return true;
+}
+
+/* 按流水线深度补足在途请求：闭环立即生成，开环从积压队列取 */
+static bool conn_fill(Worker *w, Conn &c)
+{
+    if (c.fd < 0 || c.connecting || c.close_after || g_stop.load(std::memory_order_relaxed))
+        return true;
+    int depth = g_opt.keep_alive ? g_opt.depth : 1;
+    int64_t now = now_ns();
+    bool added = false;
+    while ((int)c.inflight.size() < depth)
+    {
+        Pending p;
+        if (w->rate > 0)
+        {
+            if (w->backlog.empty())
+                break;
+            p.start_ns = w->backlog.front();
+            w->backlog.pop_front();
+        }
+        else
+        {
+            p.start_ns = now;
+        }
+        p.sent_ns = now;
+        p.spec = append_request(w, c);
+        c.inflight.push_back(p);
+        added = true;
+    }
+    return !added || conn_flush(w, c);
+}
+
+/* 一个响应接收完毕 */
+static void complete_response(Worker *w, Conn &c)
+{
+    Pending p = c.inflight.front();
+    c.inflight.pop_front();
+    c.header_done = false;
+
+    int64_t us = (now_ns() - p.start_ns) / 1000;
+    w->spec_hist[p.spec].record(us);
+    ++w->spec_count[p.spec];
+    ++w->requests;
+    int cls = c.status / 100;
+    ++w->status[cls >= 1 && cls <= 5 ? cls : 0];
+}
+
+/* 解析已收到的数据，返回 false 表示连接已关闭 */
+static bool parse_responses(Worker *w, Conn &c)
+{
+    while (!c.in.empty())
+    {
+        if (!c.header_done)
+        {
+            size_t end = c.in.find("\r\n\r\n");
+            if (end == string::npos)
+            {
+                if (c.in.size() > MAX_HEADER)
+                {
+                    conn_close(w, c, ERR_READ, 0);
+                    return false;
+                }
+                return true;
+            }
+            if (c.inflight.empty())
+            {
+                conn_close(w, c, ERR_READ, 0);    // 没有请求却收到响应
+                return false;
+            }
+
+            c.status = c.in.compare(0, 7, "HTTP/1.") == 0 && end > 12 ? atoi(c.in.c_str() + 9) : 0;
+            c.body_left = -1;
+            c.close_after = !g_opt.keep_alive;
+            size_t pos = c.in.find("\r\n") + 2;
+            while (pos < end)
+            {
+                size_t eol = c.in.find("\r\n", pos);
+                const char *line = c.in.c_str() + pos;
+                if (strncasecmp(line, "Content-Length:", 15) == 0)
+                    c.body_left = atoll(line + 15);
+                else if (strncasecmp(line, "Connection:", 11) == 0)
+                {
+                    const char *v = line + 11 + strspn(line + 11, " \t");
+                    c.close_after = strncasecmp(v, "close", 5) == 0;
+                }
+                pos = eol + 2;
+            }
+            c.in.erase(0, end + 4);
+            c.header_done = true;
+        }
+
+        if (c.body_left < 0)
+        {
+            c.in.clear();   // 没有 Content-Length：读到连接关闭为止
+            return true;
+        }
+        size_t take = c.in.size() < (size_t)c.body_left ? c.in.size() : (size_t)c.body_left;
+        c.in.erase(0, take);
+        c.body_left -= take;
+        if (c.body_left > 0)
+            return true;
+
+        complete_response(w, c);
+        if (c.close_after)
+        {
+            // 服务器将关闭连接：其余在途请求作废，重新连接
+            conn_close(w, c, ERR_READ, 0);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void conn_read(Worker *w, Conn &c)
+{
+    char buf[65536];
+    while (true)
+    {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            w->bytes += n;
+            c.in.append(buf, n);
+            if (!parse_responses(w, c))
+                return;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        // 对端关闭：以关闭为结束的响应到此完成
+        if (n == 0 && c.header_done && c.body_left < 0 && !c.inflight.empty())
+            complete_response(w, c);
+        conn_close(w, c, ERR_READ, 0);
+        return;
+    }
+    conn_fill(w, c);
+}
+
+static void handle_event(Worker *w, uint64_t data, uint32_t events)
+{
+    Conn &c = w->conns[data >> 32];
+    if (c.fd < 0 || c.gen != (uint32_t)data)
+        return;     // 本批事件中较早处理的事件已关闭（并可能重建）该连接
+    if (c.connecting)
+    {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            return;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            conn_close(w, c, ERR_CONNECT, 100);
+            return;
+        }
+        c.connecting = false;
+        ++w->connects;
+        if (!conn_fill(w, c))
+            return;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+    {
+        conn_read(w, c);
+        if (c.fd < 0)
+            return;
+    }
+    if (events & EPOLLOUT)
+        conn_flush(w, c);
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    struct epoll_event events[MAX_EVENTS];
+    int64_t timeout_ns = (int64_t)g_opt.timeout_ms * 1000000;
+    int64_t last_check = now_ns();
+
+    w->conns.resize(w->conn_num);
+    for (size_t i = 0; i < w->conns.size(); ++i)
+    {
+        conn_reset(w->conns[i]);
+        w->conns[i].index = (uint32_t)i;
+        w->conns[i].gen = 0;
+        conn_open(w, w->conns[i]);
+    }
+    w->next_ns = now_ns();
+
+    while (!g_stop.load(std::memory_order_relaxed))
+    {
+        int wait_ms = 10;
+        if (w->rate > 0)
+        {
+            int64_t d = (w->next_ns - now_ns()) / 1000000;
+            wait_ms = d < 0 ? 0 : (d < 10 ? (int)d : 10);
+        }
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, wait_ms);
+        for (int i = 0; i < n; ++i)
+            handle_event(w, events[i].data.u64, events[i].events);
+
+        int64_t now = now_ns();
+
+        // 开环：到达计划时刻的请求进入积压队列，分派给有空位的连接
+        if (w->rate > 0)
+        {
+            int64_t interval = (int64_t)(1e9 / w->rate);
+            while (w->next_ns <= now)
+            {
+                if (w->backlog.size() < MAX_BACKLOG)
+                    w->backlog.push_back(w->next_ns);
+                else
+                    ++w->dropped;
+                w->next_ns += interval;
+            }
+            for (size_t k = 0; k < w->conns.size() && !w->backlog.empty(); ++k)
+            {
+                Conn &c = w->conns[(w->rr + k) % w->conns.size()];
+                conn_fill(w, c);
+            }
+            w->rr = (w->rr + 1) % w->conns.size();
+        }
+
+        // 每 10ms：超时检查、重连
+        if (now - last_check >= 10000000)
+        {
+            last_check = now;
+            for (size_t k = 0; k < w->conns.size(); ++k)
+            {
+                Conn &c = w->conns[k];
+                if (c.fd >= 0 && !c.inflight.empty() && now - c.inflight.front().sent_ns > timeout_ns)
+                    conn_close(w, c, ERR_TIMEOUT, 0);
+                else if (c.fd >= 0 && c.connecting && now - c.retry_ns > timeout_ns)
+                    conn_close(w, c, ERR_CONNECT, 100);
+                if (c.fd < 0 && now >= c.retry_ns)
+                    conn_open(w, c);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < w->conns.size(); ++i)
+    {
+        if (w->conns[i].fd >= 0)
+            close(w->conns[i].fd);
+    }
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-c connections] [-n threads] [-t seconds] [-d depth] [-r rate] [-K]\n"
+            "          [-m static|login|register|mixed] [-s script] [-o timeout_ms] [-j json_file] http://host:port/path\n",
+            prog);
+}
+
+static bool parse_args(int argc, char *argv[])
+{
+    g_opt.connections = 100;
+    g_opt.threads = 4;
+    g_opt.duration = 10;
+    g_opt.depth = 1;
+    g_opt.rate = 0;
+    g_opt.keep_alive = true;
+    g_opt.timeout_ms = 5000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:t:d:r:Km:s:o:j:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            g_opt.connections = atoi(optarg);
+            break;
+        case 'n':
+            g_opt.threads = atoi(optarg);
+            break;
+        case 't':
+            g_opt.duration = atoi(optarg);
+            break;
+        case 'd':
+            g_opt.depth = atoi(optarg);
+            break;
+        case 'r':
+            g_opt.rate = atof(optarg);
+            break;
+        case 'K':
+            g_opt.keep_alive = false;
+            break;
+        case 'm':
+            g_opt.mix = optarg;
+            break;
+        case 's':
+            g_opt.script = optarg;
+            break;
+        case 'o':
+            g_opt.timeout_ms = atoi(optarg);
+            break;
+        case 'j':
+            g_opt.json = optarg;
+            break;
+        default:
+            return false;
+        }
+    }
+    if (optind != argc - 1 || g_opt.connections <= 0 || g_opt.threads <= 0 || g_opt.duration <= 0 ||
+        g_opt.depth <= 0 || g_opt.rate < 0 || g_opt.timeout_ms <= 0)
+        return false;
+    g_opt.url = argv[optind];
+    if (g_opt.threads > g_opt.connections)
+        g_opt.threads = g_opt.connections;
+    return true;
+}
+
+/* JSON 字符串转义 */
+static string json_str(const string &s)
+{
+    string out = "\"";
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        char ch = s[i];
+        if (ch == '"' || ch == '\\')
+        {
+            out += '\\';
+            out += ch;
+        }
+        else if ((unsigned char)ch < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out += buf;
+        }
+        else
+            out += ch;
+    }
+    return out + "\"";
+}
+
+static const double report_percentiles[] = {50, 90, 99, 99.9, 99.99};
+static const char *report_names[] = {"p50", "p90", "p99", "p99.9", "p99.99"};
+static const int REPORT_PERCENTILES = 5;
+
+static void print_latency_row(FILE *fp, const string &name, const HdrHistogram &h)
+{
+    fprintf(fp, "  %-28s %9lld %9lld %9.1f", name.c_str(), (long long)h.count(), (long long)h.min(), h.mean());
+    for (int i = 0; i < REPORT_PERCENTILES; ++i)
+        fprintf(fp, " %9lld", (long long)h.percentile(report_percentiles[i]));
+    fprintf(fp, " %9lld\n", (long long)h.max());
+}
+
+static void json_latency(FILE *fp, const HdrHistogram &h)
+{
+    fprintf(fp, "{\"count\": %lld, \"min\": %lld, \"mean\": %.1f, \"stddev\": %.1f",
+            (long long)h.count(), (long long)h.min(), h.mean(), h.stddev());
+    for (int i = 0; i < REPORT_PERCENTILES; ++i)
+        fprintf(fp, ", \"%s\": %lld", report_names[i], (long long)h.percentile(report_percentiles[i]));
+    fprintf(fp, ", \"max\": %lld}", (long long)h.max());
+}
+
+int main(int argc, char *argv[])
+{
+    if (!parse_args(argc, argv))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int port;
+    string path;
+    if (!parse_url(g_opt.url, g_host, port, path))
+    {
+        fprintf(stderr, "wbench: bad url %s\n", g_opt.url.c_str());
+        return 1;
+    }
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(g_host.c_str(), NULL, &hints, &res) != 0)
+    {
+        fprintf(stderr, "wbench: cannot resolve %s\n", g_host.c_str());
+        return 1;
+    }
+    g_addr = *(struct sockaddr_in *)res->ai_addr;
+    g_addr.sin_port = htons(port);
+    freeaddrinfo(res);
+
+    if (!g_opt.script.empty())
+    {
+        if (!load_script(g_opt.script))
+            return 1;
+    }
+    else if (!builtin_mix(g_opt.mix.empty() ? "static" : g_opt.mix, path))
+    {
+        fprintf(stderr, "wbench: unknown mix %s\n", g_opt.mix.c_str());
+        return 1;
+    }
+
+    // 每次运行的 $SEQ 前缀不同，重复测试注册时不会与上次的用户名冲突
+    char run_id[32];
+    snprintf(run_id, sizeof(run_id), "%lx%x_", (unsigned long)time(NULL), (unsigned)getpid() & 0xffff);
+    g_run_id = run_id;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<Worker *> workers;
+    for (int i = 0; i < g_opt.threads; ++i)
+    {
+        Worker *w = new Worker();
+        w->id = i;
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->conn_num = g_opt.connections / g_opt.threads + (i < g_opt.connections % g_opt.threads ? 1 : 0);
+        w->rng = 0x9E3779B97F4A7C15ULL * (i + 1) ^ (uint64_t)now_ns();
+        w->seq = 0;
+        w->rate = g_opt.rate / g_opt.threads;
+        w->rr = 0;
+        w->requests = w->bytes = w->connects = w->dropped = 0;
+        memset(w->errors, 0, sizeof(w->errors));
+        memset(w->status, 0, sizeof(w->status));
+        w->spec_count.assign(g_specs.size(), 0);
+        w->spec_hist.assign(g_specs.size(), HdrHistogram());
+        workers.push_back(w);
+    }
+
+    int64_t start = now_ns();
+    for (size_t i = 0; i < workers.size(); ++i)
+        pthread_create(&workers[i]->tid, NULL, worker_main, workers[i]);
+
+    struct timespec ts;
+    ts.tv_sec = g_opt.duration;
+    ts.tv_nsec = 0;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+    g_stop.store(true);
+    double elapsed = (now_ns() - start) / 1e9;
+    for (size_t i = 0; i < workers.size(); ++i)
+        pthread_join(workers[i]->tid, NULL);
+
+    // 合并各线程的统计
+    int64_t requests = 0, bytes = 0, connects = 0, dropped = 0;
+    int64_t errors[ERR_KINDS] = {0};
+    int64_t status[6] = {0};
+    vector<int64_t> spec_count(g_specs.size(), 0);
+    vector<HdrHistogram> spec_hist(g_specs.size(), HdrHistogram());
+    HdrHistogram total;
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        Worker *w = workers[i];
+        requests += w->requests;
+        bytes += w->bytes;
+        connects += w->connects;
+        dropped += w->dropped;
+        for (int k = 0; k < ERR_KINDS; ++k)
+            errors[k] += w->errors[k];
+        for (int k = 0; k < 6; ++k)
+            status[k] += w->status[k];
+        for (size_t k = 0; k < g_specs.size(); ++k)
+        {
+            spec_count[k] += w->spec_count[k];
+            spec_hist[k].merge(w->spec_hist[k]);
+            total.merge(w->spec_hist[k]);
+        }
+        close(w->epfd);
+        delete w;
+    }
+
+    vector<string> names;
+    for (size_t k = 0; k < g_specs.size(); ++k)
+        names.push_back(g_specs[k].method + " " + g_specs[k].path);
+
+    if (g_opt.json != "-")
+    {
+        printf("wbench %s: %d threads, %d connections, %d s, %s, %s, depth %d\n",
+               g_opt.url.c_str(), g_opt.threads, g_opt.connections, g_opt.duration,
+               g_opt.rate > 0 ? "open loop" : "closed loop", g_opt.keep_alive ? "keep-alive" : "close", g_opt.depth);
+        if (g_opt.rate > 0)
+            printf("target rate: %.1f req/s\n", g_opt.rate);
+        printf("requests: %lld in %.2f s, %.1f req/s, %.2f MB/s read\n",
+               (long long)requests, elapsed, requests / elapsed, bytes / elapsed / 1048576);
+        printf("connects: %lld, errors: connect %lld, read %lld, write %lld, timeout %lld",
+               (long long)connects, (long long)errors[ERR_CONNECT], (long long)errors[ERR_READ],
+               (long long)errors[ERR_WRITE], (long long)errors[ERR_TIMEOUT]);
+        if (dropped)
+            printf(", dropped %lld", (long long)dropped);
+        printf("\nstatus: 2xx %lld, 3xx %lld, 4xx %lld, 5xx %lld, other %lld\n",
+               (long long)status[2], (long long)status[3], (long long)status[4], (long long)status[5],
+               (long long)(status[0] + status[1]));
+        printf("latency (us):\n  %-28s %9s %9s %9s", "", "count", "min", "mean");
+        for (int i = 0; i < REPORT_PERCENTILES; ++i)
+            printf(" %9s", report_names[i]);
+        printf(" %9s\n", "max");
+        print_latency_row(stdout, "all", total);
+        if (g_specs.size() > 1)
+        {
+            for (size_t k = 0; k < g_specs.size(); ++k)
+                print_latency_row(stdout, names[k], spec_hist[k]);
+        }
+    }
+
+    if (!g_opt.json.empty())
+    {
+        FILE *fp = g_opt.json == "-" ? stdout : fopen(g_opt.json.c_str(), "w");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "wbench: cannot write %s\n", g_opt.json.c_str());
+            return 1;
+        }
+        fprintf(fp, "{\n  \"url\": %s,\n  \"threads\": %d,\n  \"connections\": %d,\n  \"duration_s\": %.3f,\n",
+                json_str(g_opt.url).c_str(), g_opt.threads, g_opt.connections, elapsed);
+        fprintf(fp, "  \"mode\": \"%s\",\n  \"target_rate\": %.1f,\n  \"keep_alive\": %s,\n  \"depth\": %d,\n",
+                g_opt.rate > 0 ? "open" : "closed", g_opt.rate, g_opt.keep_alive ? "true" : "false", g_opt.depth);
+        fprintf(fp, "  \"requests\": %lld,\n  \"rps\": %.1f,\n  \"bytes\": %lld,\n  \"connects\": %lld,\n  \"dropped\": %lld,\n",
+                (long long)requests, requests / elapsed, (long long)bytes, (long long)connects, (long long)dropped);
+        fprintf(fp, "  \"errors\": {");
+        for (int k = 0; k < ERR_KINDS; ++k)
+            fprintf(fp, "%s\"%s\": %lld", k ? ", " : "", error_names[k], (long long)errors[k]);
+        fprintf(fp, "},\n  \"status\": {\"2xx\": %lld, \"3xx\": %lld, \"4xx\": %lld, \"5xx\": %lld, \"other\": %lld},\n",
+                (long long)status[2], (long long)status[3], (long long)status[4], (long long)status[5],
+                (long long)(status[0] + status[1]));
+        fprintf(fp, "  \"latency_us\": ");
+        json_latency(fp, total);
+        fprintf(fp, ",\n  \"requests_by_type\": [\n");
+        for (size_t k = 0; k < g_specs.size(); ++k)
+        {
+            fprintf(fp, "    {\"name\": %s, \"weight\": %d, \"requests\": %lld, \"latency_us\": ",
+                    json_str(names[k]).c_str(), g_specs[k].weight, (long long)spec_count[k]);
+            json_latency(fp, spec_hist[k]);
+            fprintf(fp, "}%s\n", k + 1 < g_specs.size() ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+        if (fp != stdout)
+            fclose(fp);
+    }
+    return 0;
+}
@@ -9,20 +9,28 @@
 #include <exception>
 
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
+#include "../metrics/metrics.h"
 
 // 半同步/半反应堆 线程池
 // 使用一个工作队列 完全解除 主线程、工作线程的耦合关系：主线程向工作队列中，插入任务，工作线程通过竞争来取得任务并执行它
 // * 同步I/O模拟proactor模式
 // * 半同步/半反应堆
 // * 线程池
+//
+// 过载保护（CoDel，按排队时间丢弃）：工作线程取出任务时计算它在队列中等待的时间。
+// 一个 CODEL_INTERVAL_MS 窗口内的最小排队时间仍高于目标值，说明队列一直没有排空（持续积压，
+// 而不是瞬时突发），下一个窗口处于过载状态：排队超过 2 倍目标值的读请求不再处理，改为回复 503（T::shed()）。
+// 被接纳请求的排队延迟因此有上界，而不是随积压无限增长；回复 503 只需复制一段内存，积压很快消化。
+// 写任务（reactor 模式下发送响应）从不丢弃
+const int CODEL_INTERVAL_MS = 100;
 
 template <typename T>
 class ThreadPool
 {
 public:
 	/*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-	ThreadPool(int actor_model, ConnectionPool *connPool, int threadNumber = 8, int max_request = 10000);
+	/*codel_target_ms：排队时间目标值（毫秒），0 不按排队时间丢弃*/
+	ThreadPool(int actor_model, int threadNumber = 8, int max_request = 10000, int codel_target_ms = 0);
 	~ThreadPool();
 	
 	/* 往请求队列中添加任务 */
@@ -35,27 +43,47 @@ private:
 
 	void run();
 
+	/* 取出任务时调用（持有队列锁）：按排队时间决定是否丢弃该任务 */
+	bool codel_drop(uint64_t now, uint64_t sojourn);
+
 private:
+	// 队列元素：任务 + 入队时间（不启用 CoDel 时为 0）
+	struct Entry
+	{
+		T *request;
+		uint64_t enqueue_ns;
+	};
+
 	int m_thread_number;		// 线程池中的线程数
 	int m_max_requests;			// 请求队列中 允许的最大请求数
 	pthread_t *m_threads;		// 线程池数组，大小为m_thread_number
 
-	std::list<T *> m_workqueue; // 请求队列（双向链表，任何位置插入和删除很快，但额外内存开销大）
+	std::list<Entry> m_workqueue; // 请求队列（双向链表，任何位置插入和删除很快，但额外内存开销大）
 	MutexLocker m_queuelocker;	// 互斥锁 (保护请求队列)
 	Sem m_queuestat;			// 信号量，唤醒工作线程来竞争任务
-	ConnectionPool *m_connPool; // 数据库连接池
     
 	int m_actor_model;			// 模型切换(1:reactor  2:proactor)
+
+	/* CoDel 状态（受 m_queuelocker 保护）*/
+	uint64_t m_codel_target_ns;	// 排队时间目标值，0 不启用
+	uint64_t m_codel_interval_ns;
+	uint64_t m_interval_end_ns;	// 当前窗口的结束时刻
+	uint64_t m_min_sojourn_ns;	// 当前窗口内的最小排队时间（取空队列的任务计为 0）
+	bool m_overloaded;			// 上一个窗口的最小排队时间高于目标值
 };
 
 
 template <typename T>
-ThreadPool<T>::ThreadPool(int actor_model, ConnectionPool *connPool, int thread_number, int max_requests) : 
+ThreadPool<T>::ThreadPool(int actor_model, int thread_number, int max_requests, int codel_target_ms) : 
     m_actor_model(actor_model),             // 模型切换
     m_thread_number(thread_number),
     m_max_requests(max_requests),
     m_threads(NULL),                        // 线程池数组
-    m_connPool(connPool)                    // 数据库连接池
+    m_codel_target_ns((uint64_t)(codel_target_ms > 0 ? codel_target_ms : 0) * 1000000),
+    m_codel_interval_ns((uint64_t)CODEL_INTERVAL_MS * 1000000),
+    m_interval_end_ns(0),
+    m_min_sojourn_ns(UINT64_MAX),
+    m_overloaded(false)
 {
     if (thread_number <= 0 || max_requests <= 0)
         throw std::exception();
@@ -113,7 +141,9 @@ bool ThreadPool<T>::append(T *request, int state)
     }
     request->m_state = state;
     // 工作队列还可以继续添加任务
-    m_workqueue.push_back(request);
+    Entry entry = {request, m_codel_target_ns ? metrics_now_ns() : 0};
+    m_workqueue.push_back(entry);
+    Metrics::getInstance()->gauge_add(G_QUEUE_DEPTH, 1);
 
     /* 如果先唤醒，再解锁。则其他wait唤醒后，去拿锁失败，继续阻塞 */
     /* 所以要先解锁，在post唤醒，这样其他线程就能顺利拿到锁*/
@@ -136,12 +166,34 @@ bool ThreadPool<T>::append_p(T *request)
         return false;
     }
     //
-    m_workqueue.push_back(request);
+    Entry entry = {request, m_codel_target_ns ? metrics_now_ns() : 0};
+    m_workqueue.push_back(entry);
+    Metrics::getInstance()->gauge_add(G_QUEUE_DEPTH, 1);
     m_queuelocker.unlock();
     m_queuestat.post();
     return true;
 }
 
+/**
+ * 窗口结束时由窗口内的最小排队时间决定下一个窗口是否过载；整个窗口没有取出任务（空闲）不算过载。
+ * 取出后队列为空的任务计为 0：队列排空过，就不是持续积压
+ */
+template <typename T>
+bool ThreadPool<T>::codel_drop(uint64_t now, uint64_t sojourn)
+{
+    if (now >= m_interval_end_ns)
+    {
+        m_overloaded = now < m_interval_end_ns + m_codel_interval_ns && m_min_sojourn_ns > m_codel_target_ns;
+        m_min_sojourn_ns = UINT64_MAX;
+        m_interval_end_ns = now + m_codel_interval_ns;
+    }
+    uint64_t observed = m_workqueue.empty() ? 0 : sojourn;
+    if (observed < m_min_sojourn_ns)
+        m_min_sojourn_ns = observed;
+
+    return m_overloaded && sojourn > 2 * m_codel_target_ns;
+}
+
 /* 工作线程 回调函数 */
 template <typename T>
 void *ThreadPool<T>::worker(void *arg)
@@ -158,6 +210,8 @@ void *ThreadPool<T>::worker(void *arg)
 template <typename T>
 void ThreadPool<T>::run()
 {
+    Metrics::getInstance()->register_worker();
+
     while (true)
     {
         /* 所有工作线程阻塞在这里 */
@@ -171,15 +225,53 @@ void ThreadPool<T>::run()
         }
 
         /* 取出工作队列中的队首任务元素 */
-        T *request = m_workqueue.front(); // 获取首元素
-        m_workqueue.pop_front();          // 删除首元素
+        Entry entry = m_workqueue.front(); // 获取首元素
+        m_workqueue.pop_front();           // 删除首元素
+        T *request = entry.request;
+
+        /* 按排队时间决定是否丢弃：只丢弃读请求，写任务发送的是已生成的响应 */
+        bool shed = false;
+        if (m_codel_target_ns && request)
+        {
+            uint64_t now = metrics_now_ns();
+            shed = codel_drop(now, now - entry.enqueue_ns) && (1 != m_actor_model || 0 == request->m_state);
+        }
         m_queuelocker.unlock();
+        Metrics::getInstance()->gauge_add(G_QUEUE_DEPTH, -1);
 
         /* 判断取出的元素是不是空的 */
         if (!request)
         {
             continue;
         }
+        request->trace_mark(TRACE_DEQUEUED);
+        uint64_t busy_start = metrics_now_ns(); /* 工作线程繁忙时间 */
+
+        if (shed)
+        {
+            Metrics::getInstance()->inc(M_SHED_QUEUE_DELAY);
+            /* reactor 模式下数据还未读取，先读出请求再回复 503（未读的数据会使关闭连接时发送 RST）*/
+            if (1 == m_actor_model)
+            {
+                if (request->read_once())
+                {
+                    request->save_read_progress();
+                    request->improv = 1;
+                    request->shed();
+                }
+                else
+                {
+                    request->timer_flag = 1;
+                    request->improv = 1;
+                }
+            }
+            else
+            {
+                request->shed();
+            }
+            Metrics::getInstance()->worker_busy(metrics_now_ns() - busy_start);
+            continue;
+        }
 
         // 1:reactor
         if (1 == m_actor_model)
@@ -190,15 +282,17 @@ void ThreadPool<T>::run()
                 /* read_once() ：循环读取客户数据，直到无数据可读 or 对方关闭连接 */
                 if (request->read_once())
                 {
+                    /* 先保存读取进度再置1：主线程随即按保存的进度设置期限，与下面的 process() 并行 */
+                    request->save_read_progress();
                     request->improv = 1; /* 置1，标志着http连接的读写任务已完成（请求已处理完毕）*/
 
-                    ConnectionRAII mysqlcon(&request->mysql, m_connPool); /* 从数据库连接池m_connPool中取出一个连接，传出给request->mysql */
-                    request->process();                                   /* 执行HTTP请求的 process函数 */
+                    /* 执行HTTP请求的 process函数；需要查询时才由用户存储后端从数据库连接池取出连接 */
+                    request->process();
                 }
                 else
-                { /* 读数据出错*/
-                    request->improv = 1;
+                { /* 读数据出错：先置 timer_flag，最后置 improv，主线程看到 improv 时一定能看到 timer_flag */
                     request->timer_flag = 1; /* 0：定时器已删除，解绑客户端连接  1:定时器正绑定客户端连接 */
+                    request->improv = 1;
                 }
             }
             else /* 1 : 写状态 */
@@ -209,17 +303,17 @@ void ThreadPool<T>::run()
                 }
                 else /*写数据 出错*/
                 {
-                    request->improv = 1;
                     request->timer_flag = 1;
+                    request->improv = 1;
                 }
             }
         }
         // 2:proactor
         else
         {
-            ConnectionRAII mysqlcon(&request->mysql, m_connPool);
             request->process();
         }
+        Metrics::getInstance()->worker_busy(metrics_now_ns() - busy_start);
     }
 }
 
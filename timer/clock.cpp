@@ -0,0 +1,116 @@
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "clock.h"
+
+Clock::Clock()
+{
+    m_seq.store(0);
+    memset(&m_snap, 0, sizeof(m_snap));
+    m_interval_ms = 0;
+    m_stop.store(false);
+    m_ticker_started = false;
+    update();   // 构造后即可读取，未启动更新的程序（如单独使用日志）也能得到有效时间
+}
+
+Clock::~Clock()
+{
+    if (m_ticker_started)
+    {
+        m_stop.store(true);
+        pthread_join(m_ticker_tid, NULL);
+    }
+}
+
+void Clock::update()
+{
+    struct timespec mono;
+    struct timespec wall;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    m_write_mutex.lock();
+    unsigned seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_snap.mono_ns = (long long)mono.tv_sec * 1000000000LL + mono.tv_nsec;
+    m_snap.wall_usec = wall.tv_nsec / 1000;
+    // 秒数变化时才做时区转换和格式化
+    if (wall.tv_sec != m_snap.wall_sec)
+    {
+        struct tm my_tm;
+        localtime_r(&wall.tv_sec, &my_tm);
+        snprintf(m_snap.log_date, sizeof(m_snap.log_date), "%d-%02d-%02d %02d:%02d:%02d",
+                 my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
+                 my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec);
+        gmtime_r(&wall.tv_sec, &my_tm);
+        strftime(m_snap.http_date, sizeof(m_snap.http_date), "%a, %d %b %Y %H:%M:%S GMT", &my_tm);
+        m_snap.wall_sec = wall.tv_sec;
+    }
+
+    m_seq.store(seq + 2, std::memory_order_release);
+    m_write_mutex.unlock();
+}
+
+void Clock::read(ClockSnapshot *snap)
+{
+    unsigned begin, end;
+    do
+    {
+        begin = m_seq.load(std::memory_order_acquire);
+        memcpy(snap, &m_snap, sizeof(*snap));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = m_seq.load(std::memory_order_relaxed);
+    } while ((begin & 1) || begin != end);
+}
+
+long long Clock::mono_ns()
+{
+    unsigned begin, end;
+    long long ns;
+    do
+    {
+        begin = m_seq.load(std::memory_order_acquire);
+        ns = m_snap.mono_ns;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = m_seq.load(std::memory_order_relaxed);
+    } while ((begin & 1) || begin != end);
+    return ns;
+}
+
+time_t Clock::now()
+{
+    unsigned begin, end;
+    time_t sec;
+    do
+    {
+        begin = m_seq.load(std::memory_order_acquire);
+        sec = m_snap.wall_sec;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = m_seq.load(std::memory_order_relaxed);
+    } while ((begin & 1) || begin != end);
+    return sec;
+}
+
+void Clock::start_ticker(int interval_ms)
+{
+    if (m_ticker_started)
+    {
+        return;
+    }
+    m_interval_ms = interval_ms;
+    m_ticker_started = (0 == pthread_create(&m_ticker_tid, NULL, ticker_thread, this));
+}
+
+void *Clock::ticker_thread(void *arg)
+{
+    Clock *clock = (Clock *)arg;
+    while (!clock->m_stop.load())
+    {
+        usleep(clock->m_interval_ms * 1000);
+        clock->update();
+    }
+    return NULL;
+}
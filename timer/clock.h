@@ -0,0 +1,73 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include "../lock/locker.h"
+
+/**
+ * 时间缓存服务：主线程每轮事件循环更新一次，另有低频后台线程兜底（主线程阻塞在 epoll_wait 时）
+ * 日志、定时器、HTTP Date 头读取缓存的时间，热路径上不再调用 gettimeofday/time/localtime
+ *
+ * 顺序锁(seqlock)：写者更新前后各把序号加一（奇数表示正在更新），
+ * 读者拷贝快照前后序号一致且为偶数才有效，读者不加锁、不写共享内存
+ */
+
+// 一次更新发布的全部时间
+struct ClockSnapshot
+{
+    long long mono_ns;      // 单调时间（纳秒），定时器、刷新策略、二进制日志使用
+    time_t wall_sec;        // 墙上时间（秒）
+    long wall_usec;         // 墙上时间的微秒部分
+    char log_date[24];      // 本地时间 "2024-01-01 12:00:00"，文本日志使用
+    char http_date[32];     // GMT "Mon, 01 Jan 2024 12:00:00 GMT"，Date 头使用
+};
+
+class Clock
+{
+public:
+    static Clock *getInstance()
+    {
+        static Clock instance;
+        return &instance;
+    }
+
+    /* 读取当前时间并发布（每秒才重新格式化一次日期字符串）*/
+    void update();
+
+    /* 启动后台线程，每 interval_ms 毫秒更新一次 */
+    void start_ticker(int interval_ms);
+
+    /* 读取完整快照 */
+    void read(ClockSnapshot *snap);
+
+    /* 只读取单个字段 */
+    long long mono_ns();
+    long long mono_ms()
+    {
+        return mono_ns() / 1000000;
+    }
+    time_t mono_sec()
+    {
+        return (time_t)(mono_ns() / 1000000000);
+    }
+    time_t now();
+
+private:
+    Clock();
+    ~Clock();
+
+    static void *ticker_thread(void *arg);
+
+    std::atomic<unsigned> m_seq;    // 序号，奇数表示写者正在更新
+    ClockSnapshot m_snap;           // 受 m_seq 保护的快照
+    MutexLocker m_write_mutex;      // 主线程和后台线程都会更新，写者之间互斥
+
+    int m_interval_ms;              // 后台线程的更新间隔
+    std::atomic<bool> m_stop;       // 通知后台线程退出
+    bool m_ticker_started;
+    pthread_t m_ticker_tid;
+};
+
+#endif
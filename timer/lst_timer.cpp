@@ -1,5 +1,7 @@
 #include "lst_timer.h"
 #include "../http/http_conn.h"
+#include "../http/ip_limiter.h"
+#include "../metrics/probes.h"
 
 sort_timer_list::sort_timer_list()
 {
@@ -84,6 +86,37 @@ void sort_timer_list::adjust_timer(util_timer *timer)
     {
         return;
     }
+    // 超时时间提前（请求的读取期限早于原来的空闲超时）：摘下后从原位置向前找插入位置
+    if (timer->prev && timer->expire < timer->prev->expire)
+    {
+        util_timer *pos = timer->prev;
+        pos->next = timer->next;
+        if (timer->next)
+            timer->next->prev = pos;
+        else
+            tail = pos;
+
+        while (pos && timer->expire < pos->expire)
+        {
+            pos = pos->prev;
+        }
+        if (!pos)
+        {
+            // 插入到头部
+            timer->prev = NULL;
+            timer->next = head;
+            head->prev = timer;
+            head = timer;
+        }
+        else
+        {
+            timer->prev = pos;
+            timer->next = pos->next;
+            pos->next->prev = timer;
+            pos->next = timer;
+        }
+        return;
+    }
     util_timer *temp = timer->next;
     // 传入timer超时时间 < 传入定时器的下一个定时器的超时时间
     if (!temp || (timer->expire < temp->expire))
@@ -152,8 +185,8 @@ void sort_timer_list::tick()
     {
         return;
     }
-    // 记录当前时间
-    time_t cur = time(NULL);
+    // 记录当前时间（缓存的单调时间，不受系统时间调整影响）
+    time_t cur = Clock::getInstance()->mono_sec();
     util_timer *temp = head;            // temp保存头节点
     // 循环遍历  定时器链表 ，查看链表中的定时器有没有超时
     while (temp)
@@ -165,6 +198,10 @@ void sort_timer_list::tick()
         }
         // 定时器超时，执行回调函数
         // 传入当前链接的客户端数据，将该连接 删除
+        Metrics::getInstance()->inc(M_TIMER_EXPIRATIONS);
+        if (temp->user_data->reading)
+            Metrics::getInstance()->inc(M_READ_TIMEOUTS);
+        TWS_PROBE1(timer__expire, temp->user_data->sockfd);
         temp->cb_func(temp->user_data);
         // 头结点指针指向下一个
         head = temp->next;
@@ -277,6 +314,14 @@ void cb_func(client_data *user_data)
     epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);              /* 断言：判断用户数据指针是否为空 */
     close(user_data->sockfd);   /* 关闭客户端连接 */
+    TWS_PROBE1(conn__close, user_data->sockfd);
+
+    /* 释放该连接在按IP限流表中的登记 */
+    if (user_data->ip_counted)
+    {
+        IpLimiter::getInstance()->release(user_data->address.sin_addr.s_addr);
+        user_data->ip_counted = false;
+    }
 
     http_conn::m_user_count--;      /* 连接用户数量-1*/
 }
@@ -23,6 +23,7 @@
 
 #include <time.h>
 #include "../log/log.h"
+#include "clock.h"
 /**
  * 如果某一用户connect()到服务器之后，长时间不交换数据，一直占用服务器端的文件描述符，导致连接资源的浪费。
  * 利用定时器把这些超时的非活动连接释放掉，关闭其占用的文件描述符。
@@ -36,6 +37,8 @@ struct client_data
     sockaddr_in address; // 客户端socket地址
     int sockfd;          // 占用的服务器的文件描述符
     util_timer *timer;   // 定时器
+    bool ip_counted;     // 是否已在按IP限流表中登记（关闭时释放）
+    bool reading;        // 定时器当前是请求的读取期限（而不是空闲超时）
 };
 
 
@@ -47,7 +50,7 @@ public:
     util_timer() : prev(NULL), next(NULL) {}
 
 public:
-    time_t expire;          // 超时时间
+    time_t expire;          // 超时时间（单调时间，秒）
 
     /* 返回值void，(*cb_func)表示这是函数指针，client_data *：函数 */
     /* 函数指针初始化：void (*cb_func)(client_data *) = &foo*/
@@ -70,7 +73,7 @@ public:
     ~sort_timer_list();
 
     void add_timer(util_timer *timer);      // 添加定时器
-    void adjust_timer(util_timer *timer);   // 调整定时器
+    void adjust_timer(util_timer *timer);   // 调整定时器（超时时间可以延长，也可以提前）
     void del_timer(util_timer *timer);      // 删除定时器
     void tick();        // 滴答计时
 
@@ -1,4 +1,7 @@
 #include "webserver.h"
+#include "./metrics/probes.h"
+
+#include <algorithm>
 
 WebServer::WebServer()
 {
@@ -15,7 +18,12 @@ WebServer::WebServer()
     strcat(m_root, root);
 
     // 定时器
-    users_timer = new client_data[MAX_FD]; // 用户数据 数组65536
+    users_timer = new client_data[MAX_FD](); // 用户数据 数组65536（值初始化，ip_counted 为 false）
+
+    m_max_conn = MAX_FD;
+    m_resume_conn = MAX_FD;
+    m_accept_paused = false;
+    m_accept_resume_ms = 0;
 }
 
 WebServer::~WebServer()
@@ -27,11 +35,15 @@ WebServer::~WebServer()
     delete[] users;       // 释放所有 http_conn *users
     delete[] users_timer; // 释放动态内存中的 用户数据
     delete m_pool;        // 释放动态内存中的 数据库连接池对象
+    Metrics::getInstance()->unpublish_shm(); // 删除共享内存统计段
 }
 
 /* 根据main函数中解析的命令行参数，初始化WebServer */
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model,
+                     int log_level, int log_compress, int user_snapshot, int async_db, int register_batch, int user_store,
+                     int metrics_port, int trace_slow_ms, int shm_stats_ms, int codel_target_ms,
+                     int ip_max_conns, int ip_rate, int accept_budget, int listen_backlog, int defer_accept)
 {
     m_port = port;                 // 端口号
     m_user = user;                 // 登陆数据库用户名
@@ -44,6 +56,21 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_TRIGMode = trigmode;         // 触发模式  ET  LT？
     m_close_log = close_log;       // 日志开启？
     m_actormodel = actor_model;    //
+    m_log_level = log_level;       // 运行时日志级别
+    m_log_compress = log_compress; // 压缩切分后的日志文件
+    m_user_snapshot = user_snapshot; // 用户表快照文件
+    m_async_db = async_db;         // 非阻塞数据库连接数量
+    m_register_batch = register_batch; // 注册批量提交的最大行数
+    m_user_store = user_store;     // 用户存储后端
+    m_metrics_port = metrics_port; // 指标抓取端口
+    m_trace_slow_ms = trace_slow_ms; // 阶段耗时追踪、慢请求阈值
+    m_shm_stats_ms = shm_stats_ms; // 共享内存统计段的发布间隔
+    m_codel_target_ms = codel_target_ms; // 排队时间目标值
+    m_ip_max_conns = ip_max_conns; // 单IP并发连接数上限
+    m_ip_rate = ip_rate;           // 单IP每秒请求数
+    m_accept_budget = accept_budget > 0 ? accept_budget : 1; // 每轮事件循环最多接受的连接数
+    m_listen_backlog = listen_backlog > 0 ? listen_backlog : SOMAXCONN; // 全连接队列长度
+    m_defer_accept = defer_accept; // 延迟接受的最长等待
 }
 
 
@@ -83,14 +110,31 @@ void WebServer::log_write()
 {
     if (0 == m_close_log)
     {
+        // 运行时日志级别（SIGUSR1/SIGUSR2 可在运行中调整）
+        Log::getInstance()->set_level(m_log_level);
+        // 刷新策略：每秒或累计64KB刷新一次，ERROR 日志立即刷新
+        Log::getInstance()->set_flush_policy(1000, 64 * 1024);
+        // 切分策略：按天、800000 行或 64MB 切分，切分在后台完成，可选 gzip 压缩旧文件
+        Log::getInstance()->set_rotate_policy(64LL << 20, 1 == m_log_compress);
+
         // 初始化日志
         if (1 == m_log_write)
         {
-            /* 异步日志： 将所写的日志内容先存入阻塞队列，写线程从阻塞队列中取出内容，写入日志 */
-            // 异步需要设置阻塞队列的长度，同步不需要设置
+            /* 异步日志： 将所写的日志内容先追加到前台缓冲区，写线程交换缓冲区后整块写入日志 */
+            // 异步需要设置缓冲区容量（800 条 * 2000 字节），同步不需要设置
             // bool Log::init(const char *file_name,  close_log,  log_buf_size,  split_lines,  max_queue_size)
             Log::getInstance()->init("./ServerLog", m_close_log, 2000, 800000, 800);
         }
+        else if (2 == m_log_write)
+        {
+            /* 每线程无锁环形缓冲区：工作线程只写自己的环，刷盘线程批量 writev 写入文件 */
+            Log::getInstance()->init("./ServerLog", m_close_log, 2000, 800000, 0, 1 << 20);
+        }
+        else if (3 == m_log_write)
+        {
+            /* 二进制日志：调用点只写格式ID和原始参数，用 ./logdecode 还原为文本 */
+            Log::getInstance()->init("./ServerLog.bin", m_close_log, 2000, 800000, 0, 1 << 20, true);
+        }
         else
         {
             /* 同步日志 ：在工作线程中写入日志 */
@@ -99,21 +143,109 @@ void WebServer::log_write()
     }
 }
 
-// SQL数据库池
+// SQL数据库池、用户存储后端
 void WebServer::sql_pool()
 {
-    // 初始化数据库连接池
     m_connPool = ConnectionPool::getInstance();
+
+    // 嵌入式日志文件：单机部署，不需要数据库服务器
+    if (1 == m_user_store)
+    {
+        FileUserStore *store = new FileUserStore(m_close_log);
+        if (!store->open("./UserStore.log"))
+        {
+            exit(1);
+        }
+        m_store = store;
+        users->init_user_store(m_store, m_close_log, 1 == m_user_snapshot ? "./UserStore.snap" : NULL);
+        return;
+    }
+    // 纯内存：不持久化，用于压测
+    if (2 == m_user_store)
+    {
+        m_store = new MemoryUserStore;
+        users->init_user_store(m_store, m_close_log);
+        return;
+    }
+
+    // 初始化数据库连接池
     // 127.0.0.1    localhost
-    m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
-    // 初始化数据库读取表
-    users->initmysql_result(m_connPool);
+    // 最多 m_sql_num 条连接，启动时建立一半，等待时扩容，空闲时收缩
+    m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log,
+                     (m_sql_num + 1) / 2, SQL_ACQUIRE_TIMEOUT_MS);
+    m_store = new MysqlUserStore(m_connPool, m_close_log);
+    // 初始化数据库读取表（后台流式加载，可选快照文件加速重启）
+    users->init_user_store(m_store, m_close_log, 1 == m_user_snapshot ? "./UserTable.snap" : NULL);
+
+    // 注册批量提交：多个注册合并为一条多行 INSERT
+    if (m_register_batch > 0 &&
+        !RegisterBatcher::getInstance()->init("localhost", m_user, m_passWord, m_databaseName, 3306,
+                                              m_register_batch, REGISTER_BATCH_DELAY_MS, m_close_log))
+    {
+        LOG_WARN("%s", "register batch unavailable, insert one by one");
+    }
 }
 
 // 线程池
 void WebServer::thread_pool()
 {
-    m_pool = new ThreadPool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    m_pool = new ThreadPool<http_conn>(m_actormodel, m_thread_num, MAX_QUEUED_REQUESTS, m_codel_target_ms);
+}
+
+/* 抓取时的当前连接数 */
+static void collect_connections(std::string &out)
+{
+    char line[128];
+    snprintf(line, sizeof(line),
+             "# HELP tws_connections_active Open client connections.\n"
+             "# TYPE tws_connections_active gauge\n"
+             "tws_connections_active %d\n", http_conn::m_user_count.load());
+    out += line;
+}
+
+/* 抓取时的数据库连接池统计（取连接的等待次数、超时、累计等待时间等）*/
+static void collect_sql_pool(std::string &out)
+{
+    PoolStats st;
+    ConnectionPool::getInstance()->stats(&st);
+    char buf[1536];
+    snprintf(buf, sizeof(buf),
+             "# HELP tws_db_pool_connections Connections in the database pool.\n"
+             "# TYPE tws_db_pool_connections gauge\n"
+             "tws_db_pool_connections{state=\"free\"} %d\n"
+             "tws_db_pool_connections{state=\"busy\"} %d\n"
+             "# HELP tws_db_pool_waiting Threads waiting for a database connection.\n"
+             "# TYPE tws_db_pool_waiting gauge\n"
+             "tws_db_pool_waiting %d\n"
+             "# HELP tws_db_pool_acquires_total Connections taken from the pool.\n"
+             "# TYPE tws_db_pool_acquires_total counter\n"
+             "tws_db_pool_acquires_total %llu\n"
+             "# HELP tws_db_pool_waits_total Acquires that had to wait for a connection.\n"
+             "# TYPE tws_db_pool_waits_total counter\n"
+             "tws_db_pool_waits_total %llu\n"
+             "# HELP tws_db_pool_wait_timeouts_total Acquires that timed out.\n"
+             "# TYPE tws_db_pool_wait_timeouts_total counter\n"
+             "tws_db_pool_wait_timeouts_total %llu\n"
+             "# HELP tws_db_pool_wait_seconds_total Time spent waiting for a connection.\n"
+             "# TYPE tws_db_pool_wait_seconds_total counter\n"
+             "tws_db_pool_wait_seconds_total %.3f\n"
+             "# HELP tws_db_pool_reconnects_total Broken connections reconnected by the checker.\n"
+             "# TYPE tws_db_pool_reconnects_total counter\n"
+             "tws_db_pool_reconnects_total %llu\n",
+             st.free, st.total - st.free, st.waiting, st.acquires, st.waits, st.timeouts,
+             st.wait_ms / 1000.0, st.reconnects);
+    out += buf;
+}
+
+/* 抓取时按IP限流表中记录的IP数 */
+static void collect_ip_limiter(std::string &out)
+{
+    char line[160];
+    snprintf(line, sizeof(line),
+             "# HELP tws_ip_limiter_entries Client IPs tracked by the per-IP limiter.\n"
+             "# TYPE tws_ip_limiter_entries gauge\n"
+             "tws_ip_limiter_entries %lu\n", (unsigned long)IpLimiter::getInstance()->size());
+    out += line;
 }
 
 // 事件监听
@@ -149,12 +281,57 @@ void WebServer::eventListen()
     ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
 
-    
-    ret = listen(m_listenfd, 5);
+    /* 延迟接受：三次握手完成后，客户端发来数据（或超过 m_defer_accept 秒）才通知 accept，
+       只建立连接不发请求的客户端不占用连接和定时器，accept 后的第一次读通常就能读到请求 */
+    if (m_defer_accept > 0 &&
+        setsockopt(m_listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &m_defer_accept, sizeof(m_defer_accept)) < 0)
+    {
+        LOG_WARN("TCP_DEFER_ACCEPT unavailable: errno %d", errno);
+    }
+
+    /* 全连接队列长度：连接风暴时已完成握手、等待 accept 的连接数，超过后新的握手被丢弃（客户端超时重传SYN）；
+       实际值不超过内核参数 net.core.somaxconn */
+    ret = listen(m_listenfd, m_listen_backlog);
     assert(ret >= 0);
 
+    /* 连接数上限：连接的fd直接作为 users 数组下标，不能超过 MAX_FD；
+       进程的文件描述符上限更低时以它为准，并预留一部分给日志、数据库连接、管道等 */
+    int fd_limit = MAX_FD;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t)MAX_FD)
+        fd_limit = (int)rl.rlim_cur;
+    m_max_conn = fd_limit > 2 * ACCEPT_FD_RESERVE ? fd_limit - ACCEPT_FD_RESERVE : fd_limit / 2;
+    m_resume_conn = m_max_conn - m_max_conn / 8;
+    LOG_INFO("max connections %d, resume accepting below %d", m_max_conn, m_resume_conn);
+
+    /* 按客户端IP限流：单个客户端不能占满连接、独占工作线程；桶容量为2秒的请求数，容纳页面加载时的突发 */
+    if ((m_ip_max_conns > 0 || m_ip_rate > 0) &&
+        !IpLimiter::getInstance()->init(m_ip_max_conns, m_ip_rate, 2 * m_ip_rate, IP_LIMIT_SLOTS))
+    {
+        LOG_WARN("%s", "per-IP limiter unavailable");
+    }
+
     utils.init(TIMESLOT); // 最小超时单位
 
+    /* 运行指标：热路径只更新本线程的分片，抓取时在独立端口上汇总输出 */
+    if (m_metrics_port > 0)
+    {
+        Metrics::getInstance()->add_collector(collect_connections);
+        if (IpLimiter::getInstance()->enabled())
+            Metrics::getInstance()->add_collector(collect_ip_limiter);
+        if (0 == m_user_store)
+            Metrics::getInstance()->add_collector(collect_sql_pool);
+        if (!Metrics::getInstance()->serve(m_metrics_port, m_close_log))
+        {
+            LOG_WARN("metrics port %d unavailable, metrics disabled", m_metrics_port);
+        }
+    }
+    /* 共享内存统计段：webtop 直接读取，不经过网络，服务器过载时也能观察 */
+    if (m_shm_stats_ms > 0 && !Metrics::getInstance()->publish_shm(m_port, m_shm_stats_ms, &http_conn::m_user_count))
+    {
+        LOG_WARN("%s", "shm stats segment unavailable");
+    }
+
     // epoll 创建内核事件表 文件描述符
     epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5);
@@ -162,6 +339,14 @@ void WebServer::eventListen()
 
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
     http_conn::m_epollfd = m_epollfd; /*将默认的-1值 该为现在的m_epollfd */
+    http_conn::m_trace_slow_ms = m_trace_slow_ms;
+
+    /* 非阻塞数据库：连接的socket注册到同一个epoll，登录、注册的查询由主线程推进，不占用工作线程 */
+    if (0 == m_user_store && m_async_db > 0 &&
+        !AsyncDB::getInstance()->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_async_db, m_epollfd, m_close_log))
+    {
+        LOG_WARN("%s", "async db unavailable, fall back to blocking queries");
+    }
 
     /* 创建2个相互连接的管道套接字（双向管道，）*/
     /* pipe():创建的描述符一端只能用于读，一端用于写，socketpair()创建的描述符任意一端既可以读也可以写*/
@@ -177,6 +362,8 @@ void WebServer::eventListen()
     utils.addsig(SIGPIPE, SIG_IGN);                  /* 忽略目标信号*/
     utils.addsig(SIGALRM, utils.sig_handler, false); /* 定时器信号 */
     utils.addsig(SIGTERM, utils.sig_handler, false); /* 终止进程信号，kill命令默认发送的就是该信号 */
+    utils.addsig(SIGUSR1, utils.sig_handler, false); /* 运行时降低日志级别 */
+    utils.addsig(SIGUSR2, utils.sig_handler, false); /* 运行时提高日志级别 */
 
     alarm(TIMESLOT); /*定时*/
 
@@ -193,8 +380,12 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address)
 
     /* 初始化client_data 数据*/
     /* 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中*/
+    /* fd 被复用而旧连接没有经过定时器回调关闭（工作线程关闭的连接）：先释放旧连接在限流表中的登记 */
+    if (users_timer[connfd].ip_counted)
+        IpLimiter::getInstance()->release(users_timer[connfd].address.sin_addr.s_addr);
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
+    users_timer[connfd].ip_counted = IpLimiter::getInstance()->enabled();
 
     util_timer *timer = new util_timer;      /* 定时器 —— 链表节点 */
     timer->user_data = &users_timer[connfd]; // 客户端数据
@@ -202,8 +393,10 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address)
     /* 初始化定时器的函数指针 为 cb_func*/
     timer->cb_func = cb_func;
 
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    // 新连接只有 FIRST_BYTE_TIMEOUT 秒发来第一个字节，不是完整的空闲超时
+    time_t cur = Clock::getInstance()->mono_sec();
+    timer->expire = cur + FIRST_BYTE_TIMEOUT;
+    users_timer[connfd].reading = true;
     users_timer[connfd].timer = timer;
     utils.m_timer_lst.add_timer(timer);
 }
@@ -211,14 +404,49 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address)
 /* 若有数据传输，则将定时器往后延迟3个单位, 并对新的定时器在链表上的位置进行调整*/
 void WebServer::adjust_timer(util_timer *timer)
 {
-    time_t cur = time(NULL);
+    time_t cur = Clock::getInstance()->mono_sec();
     timer->expire = cur + 3 * TIMESLOT;
+    timer->user_data->reading = false;
 
     utils.m_timer_lst.adjust_timer(timer);
 
     LOG_INFO("%s", "adjust timer once");
 }
 
+/**
+ * 读事件后按当前请求的读取进度设置期限（慢速攻击防护），读事件本身不再延长连接：
+ *   请求头：从第一个字节起 HEADER_TIMEOUT 秒，每收到 MIN_RATE 字节延长1秒，最多 HEADER_TIMEOUT_MAX 秒
+ *   消息体：从请求头解析完成起 BODY_TIMEOUT 秒，每收到 MIN_RATE 字节延长1秒
+ * 逐字节发送请求头的客户端最多占用连接 HEADER_TIMEOUT_MAX 秒；期限由定时器链表在 tick 中执行
+ * 读取进度是读完数据时保存的（save_read_progress），reactor 模式下工作线程可能仍在 process() 中修改解析状态
+ */
+void WebServer::read_timer(util_timer *timer, int sockfd)
+{
+    uint64_t start_us, body_start_us;
+    long bytes;
+    users[sockfd].saved_read_progress(&start_us, &body_start_us, &bytes);
+    if (0 == start_us)
+    {
+        // 没有读到数据（ET模式下的空读事件）：按空闲超时处理
+        adjust_timer(timer);
+        return;
+    }
+
+    time_t expire;
+    if (body_start_us)
+    {
+        expire = (time_t)(body_start_us / 1000000) + BODY_TIMEOUT + bytes / MIN_RATE;
+    }
+    else
+    {
+        long extend = bytes / MIN_RATE;
+        expire = (time_t)(start_us / 1000000) + std::min((long)HEADER_TIMEOUT + extend, (long)HEADER_TIMEOUT_MAX);
+    }
+    timer->expire = expire;
+    timer->user_data->reading = true;
+    utils.m_timer_lst.adjust_timer(timer);
+}
+
 /** 处理指定的sockfd 定时器
  * 执行定时器回调函数，即将客户端sockfd从epoll上删除,关闭连接，连接用户数量-1
  * 关闭连接后，将定时器从 升序定时器链表 中删除，并delete释放该定时器
@@ -238,61 +466,106 @@ void WebServer::deal_timer(util_timer *timer, int sockfd)
     LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
 }
 
-/* 处理 客户端数据 */
+/**
+ * 暂停接受连接：将监听socket从epoll移除，新连接留在内核的全连接队列中（队列满后客户端的SYN重传），
+ * 而不是接受后立即关闭。resume_ms 为最早恢复的时间，0 表示只等连接数降到恢复水位
+ */
+void WebServer::pause_accept(long long resume_ms)
+{
+    m_accept_resume_ms = resume_ms;
+    if (m_accept_paused)
+        return;
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_listenfd, 0);
+    m_accept_paused = true;
+    Metrics::getInstance()->inc(M_ACCEPT_PAUSES);
+    LOG_WARN("accept paused: %d connections", http_conn::m_user_count.load());
+}
+
+/* 每轮事件循环检查：连接数降到恢复水位以下、且已过暂停时间，重新监听 */
+void WebServer::resume_accept()
+{
+    if (http_conn::m_user_count >= m_resume_conn || Clock::getInstance()->mono_ms() < m_accept_resume_ms)
+        return;
+    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+    m_accept_paused = false;
+    LOG_INFO("accept resumed: %d connections", http_conn::m_user_count.load());
+}
+
+/**
+ * 处理 客户端数据：接受新连接
+ * 每次最多接受 m_accept_budget 个连接，连接风暴时不会长时间占用事件循环、饿死已有连接的读写事件；
+ * 剩余的连接留到下一轮 epoll_wait：LT 模式下监听socket仍然可读会再次触发，
+ * ET 模式下不会再有新的边沿，用 EPOLL_CTL_MOD 重新登记，内核发现仍然可读时重新通知
+ */
 bool WebServer::dealclinetdata()
 {
     struct sockaddr_in client_address;
-    socklen_t client_addrlength = sizeof(client_address);
+    socklen_t client_addrlength;
+    bool accepted = false;
 
-    // 监听触发模式  LT模式
-    // 0：只接受一次客户端连接
-    if (0 == m_LISTENTrigmode)
+    for (int i = 0; i < m_accept_budget; ++i)
     {
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+        client_addrlength = sizeof(client_address);
+        // accept4：新连接直接设为非阻塞 + close-on-exec，不需要再调用 fcntl
+        int connfd = accept4(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
         // accept失败，返回-1，并设置errno
         if (connfd < 0)
         {
-            LOG_ERROR("%s:errno is:%d", "accept error", errno);
-            return false;
+            int err = errno;
+            // EAGAIN：已接受完全部连接，不计为错误
+            if (err != EAGAIN && err != EWOULDBLOCK)
+            {
+                LOG_ERROR("%s:errno is:%d", "accept error", err);
+                Metrics::getInstance()->inc(M_ACCEPT_ERRORS);
+            }
+            // 文件描述符耗尽：监听socket一直可读，暂停一段时间，避免事件循环空转；
+            // ET 模式下剩余的连接不会再次触发事件，暂停后重新加入epoll时会再次通知
+            if (EMFILE == err || ENFILE == err)
+                pause_accept(Clock::getInstance()->mono_ms() + ACCEPT_BACKOFF_MS);
+            return accepted;
         }
+        Metrics::getInstance()->inc(M_ACCEPTS);
+        TWS_PROBE2(accept, connfd, client_address.sin_addr.s_addr);
 
         // accept成功
         // 1. 用户数量超过最大连接数量，则向客户端的发送信息，并关闭连接
-        if (http_conn::m_user_count >= MAX_FD)
+        if (http_conn::m_user_count >= m_max_conn || connfd >= MAX_FD)
         {
+            Metrics::getInstance()->inc(M_CONN_REJECTED);
             utils.show_error(connfd, "Internal server busy");
             LOG_ERROR("%s", "Internal server busy");
-            return false;
+            pause_accept(0);
+            return accepted;
+        }
+        // 2. 该IP的连接数或请求速率超限：直接关闭，不占用连接、不发送响应，继续接受其他连接
+        if (IpLimiter::getInstance()->enabled() &&
+            !IpLimiter::getInstance()->acquire(client_address.sin_addr.s_addr, (uint32_t)Clock::getInstance()->mono_ms()))
+        {
+            Metrics::getInstance()->inc(M_CONN_IP_LIMITED);
+            close(connfd);
+            continue;
         }
-        // 2. 没有异常，初始化的客户端定时器
+        // 3. 没有异常，初始化的客户端定时器
         timer(connfd, client_address);
-    }
-    else    // 监听触发模式  ET模式
-    {
-        /* 1：循环接受客户端连接，直到accept失败 或 连接数量超过最大 */
-        while (1)
+        accepted = true;
+        // 4. 达到连接数上限，暂停接受连接
+        if (http_conn::m_user_count >= m_max_conn)
         {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
-            // accept失败，返回-1，并设置errno
-            if (connfd < 0)
-            {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                break;
-            }
-            // accept成功
-            // 1. 用户数量超过最大连接数量，则向客户端的发送信息，并关闭连接
-            if (http_conn::m_user_count >= MAX_FD)
-            {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
-                break;
-            }
-            // 没有异常，则设置定时器
-            timer(connfd, client_address);
+            pause_accept(0);
+            return accepted;
         }
-        return false;
     }
-    return true;
+
+    // 用完本轮配额：ET 模式下重新登记监听socket，还有未接受的连接时下一轮 epoll_wait 会再次返回
+    if (1 == m_LISTENTrigmode)
+    {
+        epoll_event event;
+        event.data.fd = m_listenfd;
+        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, m_listenfd, &event);
+    }
+    return accepted;
 }
 
 /**
@@ -330,6 +603,19 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
             case SIGTERM:
                 stop_server = true; /*kill命令信号 */
                 break;
+            case SIGUSR1:
+                /* 降低日志级别，记录更多日志 */
+                Log::getInstance()->set_level(Log::getInstance()->get_level() - 1);
+                LOG_INFO("log level: %d", Log::getInstance()->get_level());
+                break;
+            case SIGUSR2:
+            {
+                /* 提高日志级别，记录更少日志；先记录再生效，调到 INFO 以上时这一条不会被过滤 */
+                int level = Log::getInstance()->get_level();
+                LOG_INFO("log level: %d", level + 1 > 3 ? 3 : level + 1);
+                Log::getInstance()->set_level(level + 1);
+                break;
+            }
             }
         }
     }
@@ -341,17 +627,38 @@ void WebServer::dealwithread(int sockfd)
 {
     util_timer *timer = users_timer[sockfd].timer; /*选取sockfd对应的定时器*/
 
+    // 阶段耗时追踪的起点：本轮 epoll_wait 返回后更新的缓存时间
+    users[sockfd].trace_mark(TRACE_EPOLL, Clock::getInstance()->mono_ns());
+
+    /* 按IP限流：新请求的第一个读事件扣除一个令牌，令牌不足时读出请求、回复 429，不进入线程池 */
+    if (m_ip_rate > 0 && !users[sockfd].request_started() &&
+        !IpLimiter::getInstance()->allow_request(users_timer[sockfd].address.sin_addr.s_addr,
+                                                 (uint32_t)Clock::getInstance()->mono_ms()))
+    {
+        Metrics::getInstance()->inc(M_REQUESTS_RATE_LIMITED);
+        if (users[sockfd].read_once())
+            users[sockfd].shed(429);
+        else
+            deal_timer(timer, sockfd);
+        return;
+    }
+
     // 1:reactor模式
     if (1 == m_actormodel)
     {
-        if (timer)
-        {
-            adjust_timer(timer);
-        }
-
         // 若监测到 读事件，将该事件放入请求队列，让工作线程竞争处理任务
         /* users是动态数组头指针，*/
-        m_pool->append(users + sockfd, 0);
+        users[sockfd].trace_mark(TRACE_QUEUED);
+        if (!m_pool->append(users + sockfd, 0))
+        {
+            /* 队列已满：主线程读出请求，直接回复 503，不等待工作线程 */
+            Metrics::getInstance()->inc(M_SHED_QUEUE_FULL);
+            if (users[sockfd].read_once())
+                users[sockfd].shed();
+            else
+                deal_timer(timer, sockfd);
+            return;
+        }
 
         /* 主线程 一直等待该http连接的请求处理完毕(improv被置1)，如果请求处理失败则关闭该http连接。*/
         while (true)
@@ -365,6 +672,11 @@ void WebServer::dealwithread(int sockfd)
                     deal_timer(timer, sockfd); /* 断开用户的连接, 并从定时器链表中删除对应timer定时器*/
                     users[sockfd].timer_flag = 0;
                 }
+                /* 2： 工作线程已读入数据，按读取进度设置期限 */
+                else if (timer)
+                {
+                    read_timer(timer, sockfd);
+                }
                 users[sockfd].improv = 0;
                 break;
             }
@@ -377,12 +689,20 @@ void WebServer::dealwithread(int sockfd)
         {
             LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
-            // 若监测到读事件，将该事件放入请求队列，让工作线程竞争处理任务
-            m_pool->append_p(users + sockfd);
-
+            // 入队之前按读取进度设置期限（入队后工作线程会修改解析状态）
             if (timer)
             {
-                adjust_timer(timer);
+                users[sockfd].save_read_progress();
+                read_timer(timer, sockfd);
+            }
+
+            // 若监测到读事件，将该事件放入请求队列，让工作线程竞争处理任务
+            users[sockfd].trace_mark(TRACE_QUEUED);
+            if (!m_pool->append_p(users + sockfd))
+            {
+                /* 队列已满：直接回复 503 */
+                Metrics::getInstance()->inc(M_SHED_QUEUE_FULL);
+                users[sockfd].shed();
             }
         }
         else /* 读失败*/
@@ -405,7 +725,14 @@ void WebServer::dealwithwrite(int sockfd)
             adjust_timer(timer);
         }
 
-        m_pool->append(users + sockfd, 1); /*往请求队列添加写任务， 1:写*/
+        /*往请求队列添加写任务， 1:写*/
+        if (!m_pool->append(users + sockfd, 1))
+        {
+            /* 队列已满：主线程直接发送（非阻塞写），不等待工作线程 */
+            if (!users[sockfd].write())
+                deal_timer(timer, sockfd);
+            return;
+        }
 
         while (true)
         {
@@ -449,9 +776,15 @@ void WebServer::eventLoop()
     bool stop_server = false;
     printf("WebServer::eventLoop start!\n");
 
+    // 主线程阻塞在 epoll_wait 时，由后台线程低频更新时间缓存
+    Clock::getInstance()->start_ticker(CLOCK_TICK_MS);
+
     while (!stop_server)
     {
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        // 暂停接受连接期间定时醒来，检查能否恢复
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, m_accept_paused ? ACCEPT_BACKOFF_MS : -1);
+        // 每轮事件循环更新一次时间缓存，本轮的定时器、日志、Date 头都读取缓存
+        Clock::getInstance()->update();
         if (number < 0 && errno != EINTR)
         {
             LOG_ERROR("%s", "epoll failure");
@@ -461,8 +794,13 @@ void WebServer::eventLoop()
         for (int i = 0; i < number; i++)
         {
             int sockfd = events[i].data.fd;
+            // 非阻塞数据库连接上的事件：推进查询
+            if (AsyncDB::getInstance()->owns(sockfd))
+            {
+                AsyncDB::getInstance()->handle_event(sockfd, events[i].events);
+            }
             // 处理新客户连接
-            if (sockfd == m_listenfd)
+            else if (sockfd == m_listenfd)
             {
                 bool flag = dealclinetdata();
                 if (false == flag)
@@ -493,12 +831,24 @@ void WebServer::eventLoop()
             }
         }
 
+        if (m_accept_paused)
+        {
+            resume_accept();
+        }
+
         if (timeout)
         {
             utils.timer_handler();
+            AsyncDB::getInstance()->tick();
 
             LOG_INFO("%s", "timer tick");
 
+            /* 空闲时也按刷新间隔把缓冲的日志写入文件 */
+            if (0 == m_close_log)
+            {
+                Log::getInstance()->flush();
+            }
+
             timeout = false;
         }
     }
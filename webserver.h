@@ -3,6 +3,7 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -11,14 +12,32 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <sys/resource.h>
 
 #include "./http/http_conn.h"
+#include "./http/ip_limiter.h"
 #include "./threadpool/threadpool.h"
+#include "./CGImysql/mysql_user_store.h"
+#include "./metrics/metrics.h"
 
 const int MAX_FD = 65536;           // 最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; // 最大事件数
 const int TIMESLOT = 5;             // 最小超时单位
 
+/* 慢速攻击防护（秒）：读取请求各阶段的期限，由定时器链表执行（精度为 TIMESLOT） */
+const int FIRST_BYTE_TIMEOUT = 10;  // 新连接发来第一个字节的期限
+const int HEADER_TIMEOUT = 10;      // 请求头：从第一个字节起的期限
+const int HEADER_TIMEOUT_MAX = 20;  // 请求头：按传输速率延长后的上限
+const int BODY_TIMEOUT = 10;        // 消息体：从请求头解析完成起的期限
+const int MIN_RATE = 500;           // 最低传输速率（字节/秒）：每收到 MIN_RATE 字节，期限延长1秒
+const int CLOCK_TICK_MS = 10;       // 时间缓存后台更新间隔（毫秒）
+const int REGISTER_BATCH_DELAY_MS = 2; // 注册批量提交的最长等待（毫秒）
+const int SQL_ACQUIRE_TIMEOUT_MS = 1000; // 从数据库连接池取连接的最长等待（毫秒）
+const int MAX_QUEUED_REQUESTS = 10000;  // 线程池队列长度上限，队列满时直接回复 503
+const int ACCEPT_FD_RESERVE = 64;       // 文件描述符上限中预留给日志、数据库连接等的个数
+const int ACCEPT_BACKOFF_MS = 100;      // accept 因文件描述符耗尽失败后，暂停接受连接的时间（毫秒）
+const size_t IP_LIMIT_SLOTS = 1 << 20;  // 按IP限流表的槽位数（16字节/槽，超过 3/4 时清理空闲的IP）
+
 class WebServer
 {
 public:
@@ -28,7 +47,12 @@ public:
     // 初始化
     void init(int port, string user, string passWord, string databaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int log_level = 0,
+              int log_compress = 0, int user_snapshot = 0, int async_db = 0,
+              int register_batch = 0, int user_store = 0, int metrics_port = 0,
+              int trace_slow_ms = 0, int shm_stats_ms = 0, int codel_target_ms = 0,
+              int ip_max_conns = 0, int ip_rate = 0, int accept_budget = 64,
+              int listen_backlog = 1024, int defer_accept = 0);
 
     void thread_pool();
     void sql_pool();
@@ -40,8 +64,11 @@ public:
     // 初始化每个连接客户端用户的定时器, 并将定时器添加到定时器链表中
     void timer(int connfd, struct sockaddr_in client_address);
     void adjust_timer(util_timer *timer);
+    void read_timer(util_timer *timer, int sockfd);
     void deal_timer(util_timer *timer, int sockfd);
     bool dealclinetdata();
+    void pause_accept(long long resume_ms);
+    void resume_accept();
     bool dealwithsignal(bool &timeout, bool &stop_server);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
@@ -52,6 +79,21 @@ public:
     char *m_root;       // root 文件夹（工作目录）绝对路径
     int m_log_write;
     int m_close_log;    // 关闭日志
+    int m_log_level;    // 运行时日志级别 0:DEBUG 1:INFO 2:WARN 3:ERROR
+    int m_log_compress; // 是否 gzip 压缩切分后的日志文件
+    int m_user_snapshot; // 是否使用用户表快照文件
+    int m_async_db;     // 非阻塞数据库连接数量（0：使用同步查询）
+    int m_register_batch; // 注册批量提交的最大行数（0：逐条插入）
+    int m_user_store;   // 用户存储后端 0:MySQL 1:日志文件 2:纯内存
+    int m_metrics_port; // 指标抓取端口（0：不启用）
+    int m_trace_slow_ms; // 阶段耗时追踪，慢请求日志阈值（毫秒，0：不追踪）
+    int m_shm_stats_ms; // 共享内存统计段的发布间隔（毫秒，0：不发布）
+    int m_codel_target_ms; // 排队时间目标值（毫秒，0：不按排队时间丢弃）
+    int m_ip_max_conns; // 单IP并发连接数上限（0：不限制）
+    int m_ip_rate;      // 单IP每秒请求数（0：不限制）
+    int m_accept_budget; // 每轮事件循环最多接受的连接数
+    int m_listen_backlog; // listen 的全连接队列长度
+    int m_defer_accept; // TCP_DEFER_ACCEPT 的最长等待（秒，0：不使用）
     int m_actormodel;   //  1 reactor  0 proactor
 
     int m_pipefd[2];  // 双向管道，调用socketpair()进行初始化
@@ -64,6 +106,7 @@ public:
 
     /* 数据库 */ 
     ConnectionPool *m_connPool;
+    UserStore *m_store;    // 用户存储后端（后台加载线程可能仍在使用，随进程退出释放）
     string m_user;         // 登陆数据库用户名
     string m_passWord;     // 登陆数据库密码
     string m_databaseName; // 使用数据库名
@@ -79,6 +122,13 @@ public:
     int m_LISTENTrigmode;   // 监听触发模式  0：只接受一次客户端连接， 1：循环接受客户端连接，直到accept失败 或 连接数量超过最大
     int m_CONNTrigmode;     // 连接触发模式
 
+    /* 接受连接的节流：连接数达到 m_max_conn 时暂停 accept（新连接留在内核的全连接队列中），
+       降到 m_resume_conn 以下、且已过 m_accept_resume_ms 后恢复 */
+    int m_max_conn;                 // 连接数上限：MAX_FD 与进程文件描述符上限中较小者，减去预留
+    int m_resume_conn;              // 恢复接受连接的连接数水位
+    bool m_accept_paused;           // 监听socket是否已从epoll移除
+    long long m_accept_resume_ms;   // 最早恢复的时间（单调时间，毫秒）
+
     /* 定时器 */
     client_data *users_timer;
     Utils utils;        /* 包含升序定时器链表 */